@@ -0,0 +1,14 @@
+#ifndef _ASM_X86_KSM_H
+#define _ASM_X86_KSM_H
+
+#include <linux/types.h>
+
+/*
+ * SSE2 page helpers for KSM, see arch/x86/lib/ksm_sse2.c. They return
+ * false or -1 when SSE2 cannot be used, the caller then falls back to
+ * the generic code.
+ */
+extern bool arch_ksm_page_sums(const void *addr, u32 *sums);
+extern long arch_ksm_page_diff(const void *addr1, const void *addr2);
+
+#endif /* _ASM_X86_KSM_H */
@@ -142,6 +142,12 @@ static inline unsigned long pmd_pfn(pmd_t pmd)
 	return (pmd_val(pmd) & PTE_PFN_MASK) >> PAGE_SHIFT;
 }
 
+/* Protection of a huge pmd, as it would be for the ptes mapping it */
+static inline pgprot_t pmd_pgprot(pmd_t pmd)
+{
+	return __pgprot(pmd_flags(pmd) & ~_PAGE_PSE);
+}
+
 #define pte_page(pte)	pfn_to_page(pte_pfn(pte))
 
 static inline int pmd_large(pmd_t pte)
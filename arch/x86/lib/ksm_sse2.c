@@ -0,0 +1,105 @@
+/*
+ * SSE2 page hashing and comparison for KSM
+ *
+ * ksmd spends most of its time checksumming and comparing whole pages.
+ * Both are done here 64 bytes at a time in xmm registers; the results
+ * are the same as those of the generic code in mm/ksm.c.
+ */
+#include <linux/hardirq.h>
+#include <linux/sched.h>
+#include <linux/types.h>
+#include <linux/mm.h>
+
+#include <asm/i387.h>
+#include <asm/cpufeature.h>
+#include <asm/ksm.h>
+
+/*
+ * Fletcher-style sums over the page in 16 u32 lanes: sums[0..15] are
+ * the sums of the words, sums[16..31] the sums of those running sums.
+ */
+bool arch_ksm_page_sums(const void *addr, u32 *sums)
+{
+	const char *p = addr;
+	const char *end = p + PAGE_SIZE;
+
+	if (!cpu_has_xmm2 || in_interrupt())
+		return false;
+
+	kernel_fpu_begin();
+
+	asm volatile("pxor %xmm0, %xmm0\n\t"
+		     "pxor %xmm1, %xmm1\n\t"
+		     "pxor %xmm2, %xmm2\n\t"
+		     "pxor %xmm3, %xmm3\n\t"
+		     "pxor %xmm4, %xmm4\n\t"
+		     "pxor %xmm5, %xmm5\n\t"
+		     "pxor %xmm6, %xmm6\n\t"
+		     "pxor %xmm7, %xmm7\n\t");
+
+	for (; p < end; p += 64) {
+		asm volatile("paddd   (%0), %%xmm0\n\t"
+			     "paddd %%xmm0, %%xmm4\n\t"
+			     "paddd 16(%0), %%xmm1\n\t"
+			     "paddd %%xmm1, %%xmm5\n\t"
+			     "paddd 32(%0), %%xmm2\n\t"
+			     "paddd %%xmm2, %%xmm6\n\t"
+			     "paddd 48(%0), %%xmm3\n\t"
+			     "paddd %%xmm3, %%xmm7\n\t"
+			     : : "r" (p));
+	}
+
+	asm volatile("movdqu %%xmm0,    (%0)\n\t"
+		     "movdqu %%xmm1,  16(%0)\n\t"
+		     "movdqu %%xmm2,  32(%0)\n\t"
+		     "movdqu %%xmm3,  48(%0)\n\t"
+		     "movdqu %%xmm4,  64(%0)\n\t"
+		     "movdqu %%xmm5,  80(%0)\n\t"
+		     "movdqu %%xmm6,  96(%0)\n\t"
+		     "movdqu %%xmm7, 112(%0)\n\t"
+		     : : "r" (sums) : "memory");
+
+	kernel_fpu_end();
+
+	return true;
+}
+
+/*
+ * Return the offset of the first 64-byte block differing between the two
+ * pages, PAGE_SIZE if they are identical.
+ */
+long arch_ksm_page_diff(const void *addr1, const void *addr2)
+{
+	const char *p1 = addr1;
+	const char *p2 = addr2;
+	unsigned long off;
+	unsigned int mask;
+
+	if (!cpu_has_xmm2 || in_interrupt())
+		return -1;
+
+	kernel_fpu_begin();
+
+	for (off = 0; off < PAGE_SIZE; off += 64) {
+		asm volatile("movdqa    (%1), %%xmm0\n\t"
+			     "movdqa  16(%1), %%xmm1\n\t"
+			     "movdqa  32(%1), %%xmm2\n\t"
+			     "movdqa  48(%1), %%xmm3\n\t"
+			     "pcmpeqb   (%2), %%xmm0\n\t"
+			     "pcmpeqb 16(%2), %%xmm1\n\t"
+			     "pcmpeqb 32(%2), %%xmm2\n\t"
+			     "pcmpeqb 48(%2), %%xmm3\n\t"
+			     "pand %%xmm1, %%xmm0\n\t"
+			     "pand %%xmm3, %%xmm2\n\t"
+			     "pand %%xmm2, %%xmm0\n\t"
+			     "pmovmskb %%xmm0, %0\n\t"
+			     : "=r" (mask)
+			     : "r" (p1 + off), "r" (p2 + off));
+		if (mask != 0xffff)
+			break;
+	}
+
+	kernel_fpu_end();
+
+	return off;
+}
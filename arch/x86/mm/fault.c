@@ -971,6 +971,21 @@ static int fault_in_kernel_space(unsigned long address)
  * and the problem, and then passes it off to one of the appropriate
  * routines.
  */
+static inline void
+account_fault(struct pt_regs *regs, unsigned long address,
+	      struct task_struct *tsk, int fault)
+{
+	if (fault & VM_FAULT_MAJOR) {
+		tsk->maj_flt++;
+		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
+			      regs, address);
+	} else {
+		tsk->min_flt++;
+		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
+			      regs, address);
+	}
+}
+
 dotraplinkage void __kprobes
 do_page_fault(struct pt_regs *regs, unsigned long error_code)
 {
@@ -1070,6 +1085,21 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * Try to handle a user fault without mmap_sem first: if the vma
+	 * changes meanwhile, or the fault needs anything more than the
+	 * existing page tables, it is redone below. Reads of present pages
+	 * are access errors, which are reported from the slow path.
+	 */
+	if ((error_code & PF_USER) && (write || !(error_code & PF_PROT))) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (!(fault & (VM_FAULT_RETRY | VM_FAULT_ERROR))) {
+			account_fault(regs, address, tsk, fault);
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1159,15 +1189,7 @@ good_area:
 	 * likely that the page will be found in page cache at that point.
 	 */
 	if (flags & FAULT_FLAG_ALLOW_RETRY) {
-		if (fault & VM_FAULT_MAJOR) {
-			tsk->maj_flt++;
-			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
-				      regs, address);
-		} else {
-			tsk->min_flt++;
-			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, 0,
-				      regs, address);
-		}
+		account_fault(regs, address, tsk, fault);
 		if (fault & VM_FAULT_RETRY) {
 			/* Clear FAULT_FLAG_ALLOW_RETRY to avoid any risk
 			 * of starvation. */
@@ -180,6 +180,23 @@ static inline void blkio_update_group_iops(struct blkio_group *blkg,
 	}
 }
 
+static inline void blkio_update_group_lat_target(struct blkio_group *blkg,
+			unsigned int lat_target)
+{
+	struct blkio_policy_type *blkiop;
+
+	list_for_each_entry(blkiop, &blkio_list, list) {
+
+		/* If this policy does not own the blkg, do not send updates */
+		if (blkiop->plid != blkg->plid)
+			continue;
+
+		if (blkiop->ops.blkio_update_group_lat_target_fn)
+			blkiop->ops.blkio_update_group_lat_target_fn(blkg->key,
+							blkg, lat_target);
+	}
+}
+
 /*
  * Add to the appropriate stat variable depending on the request type.
  * This should be called with the blkg->stats_lock held.
@@ -439,6 +456,36 @@ void blkiocg_update_completion_stats(struct blkio_group *blkg,
 }
 EXPORT_SYMBOL_GPL(blkiocg_update_completion_stats);
 
+/*
+ * Latency from request allocation to completion, accounted by the throttling
+ * policy for the groups of a device on which latency targets are set.
+ */
+void blkiocg_update_latency_stats(struct blkio_group *blkg, uint64_t latency,
+					bool direction, bool sync)
+{
+	struct blkio_group_stats *stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&blkg->stats_lock, flags);
+	stats = &blkg->stats;
+	blkio_add_stat(stats->stat_arr[BLKIO_STAT_LATENCY], latency, direction,
+			sync);
+	blkio_add_stat(stats->stat_arr[BLKIO_STAT_COMPLETED], 1, direction,
+			sync);
+	spin_unlock_irqrestore(&blkg->stats_lock, flags);
+}
+EXPORT_SYMBOL_GPL(blkiocg_update_latency_stats);
+
+void blkiocg_update_latency_missed_stats(struct blkio_group *blkg)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&blkg->stats_lock, flags);
+	blkg->stats.latency_missed++;
+	spin_unlock_irqrestore(&blkg->stats_lock, flags);
+}
+EXPORT_SYMBOL_GPL(blkiocg_update_latency_missed_stats);
+
 /*  Merged stats are per cpu.  */
 void blkiocg_update_io_merged_stats(struct blkio_group *blkg, bool direction,
 					bool sync)
@@ -729,6 +776,9 @@ static uint64_t blkio_get_stat(struct blkio_group *blkg,
 	if (type == BLKIO_STAT_TIME)
 		return blkio_fill_stat(key_str, MAX_KEY_LEN - 1,
 					blkg->stats.time, cb, dev);
+	if (type == BLKIO_STAT_LATENCY_MISSED)
+		return blkio_fill_stat(key_str, MAX_KEY_LEN - 1,
+					blkg->stats.latency_missed, cb, dev);
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	if (type == BLKIO_STAT_UNACCOUNTED_TIME)
 		return blkio_fill_stat(key_str, MAX_KEY_LEN - 1,
@@ -866,6 +916,14 @@ static int blkio_policy_parse_and_set(char *buf,
 			newpn->fileid = fileid;
 			newpn->val.iops = (unsigned int)temp;
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			if (temp > THROTL_LAT_TARGET_MAX)
+				return -EINVAL;
+
+			newpn->plid = plid;
+			newpn->fileid = fileid;
+			newpn->val.lat_target = (unsigned int)temp;
+			break;
 		}
 		break;
 	default:
@@ -935,6 +993,17 @@ unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg, dev_t dev)
 		return -1;
 }
 
+unsigned int blkcg_get_lat_target(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device);
+	if (pn)
+		return pn->val.lat_target;
+	else
+		return 0;
+}
+
 /* Checks whether user asked for deleting a policy rule */
 static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 {
@@ -954,6 +1023,10 @@ static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 		case BLKIO_THROTL_write_iops_device:
 			if (pn->val.iops == 0)
 				return 1;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			if (pn->val.lat_target == 0)
+				return 1;
 		}
 		break;
 	default:
@@ -979,6 +1052,9 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
 			oldpn->val.iops = newpn->val.iops;
+			break;
+		case BLKIO_THROTL_latency_target_device:
+			oldpn->val.lat_target = newpn->val.lat_target;
 		}
 		break;
 	default:
@@ -1014,6 +1090,10 @@ static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 			iops = pn->val.iops ? pn->val.iops : (-1);
 			blkio_update_group_iops(blkg, iops, pn->fileid);
 			break;
+		case BLKIO_THROTL_latency_target_device:
+			/* 0 removes the target */
+			blkio_update_group_lat_target(blkg, pn->val.lat_target);
+			break;
 		}
 		break;
 	default:
@@ -1124,6 +1204,10 @@ blkio_print_policy_node(struct seq_file *m, struct blkio_policy_node *pn)
 				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
 					MINOR(pn->dev), pn->val.iops);
 				break;
+			case BLKIO_THROTL_latency_target_device:
+				seq_printf(m, "%u:%u\t%u\n", MAJOR(pn->dev),
+					MINOR(pn->dev), pn->val.lat_target);
+				break;
 			}
 			break;
 		default:
@@ -1173,6 +1257,7 @@ static int blkiocg_file_read(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_write_bps_device:
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
+		case BLKIO_THROTL_latency_target_device:
 			blkio_read_policy_node_files(cft, blkcg, m);
 			return 0;
 		default:
@@ -1285,6 +1370,15 @@ static int blkiocg_file_read_map(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_io_serviced:
 			return blkio_read_blkg_stats(blkcg, cft, cb,
 						BLKIO_STAT_CPU_SERVICED, 1, 1);
+		case BLKIO_THROTL_io_latency:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_LATENCY, 1, 0);
+		case BLKIO_THROTL_io_completed:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+						BLKIO_STAT_COMPLETED, 1, 0);
+		case BLKIO_THROTL_latency_missed:
+			return blkio_read_blkg_stats(blkcg, cft, cb,
+					BLKIO_STAT_LATENCY_MISSED, 0, 0);
 		default:
 			BUG();
 		}
@@ -1481,6 +1575,32 @@ struct cftype blkio_files[] = {
 				BLKIO_THROTL_io_serviced),
 		.read_map = blkiocg_file_read_map,
 	},
+	{
+		.name = "throttle.latency_target_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_target_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+	{
+		.name = "throttle.io_latency",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_io_latency),
+		.read_map = blkiocg_file_read_map,
+	},
+	{
+		.name = "throttle.io_completed",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_io_completed),
+		.read_map = blkiocg_file_read_map,
+	},
+	{
+		.name = "throttle.latency_missed",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_latency_missed),
+		.read_map = blkiocg_file_read_map,
+	},
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
 #ifdef CONFIG_DEBUG_BLK_CGROUP
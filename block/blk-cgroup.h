@@ -23,6 +23,7 @@ enum blkio_policy_id {
 
 /* Max limits for throttle policy */
 #define THROTL_IOPS_MAX		UINT_MAX
+#define THROTL_LAT_TARGET_MAX	(10 * USEC_PER_SEC)	/* usecs */
 
 #if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
 
@@ -39,10 +40,17 @@ enum stat_type {
 	BLKIO_STAT_SERVICE_TIME = 0,
 	/* Total time spent waiting in scheduler queue in ns */
 	BLKIO_STAT_WAIT_TIME,
+	/* Total time (in ns) between request allocation and completion, as
+	 * seen by the throttling policy in latency target mode */
+	BLKIO_STAT_LATENCY,
+	/* Number of requests whose latency was accounted above */
+	BLKIO_STAT_COMPLETED,
 	/* Number of IOs queued up */
 	BLKIO_STAT_QUEUED,
 	/* All the single valued stats go below this */
 	BLKIO_STAT_TIME,
+	/* Number of windows in which the group missed its latency target */
+	BLKIO_STAT_LATENCY_MISSED,
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	/* Time not charged to this cgroup */
 	BLKIO_STAT_UNACCOUNTED_TIME,
@@ -109,6 +117,10 @@ enum blkcg_file_name_throtl {
 	BLKIO_THROTL_write_iops_device,
 	BLKIO_THROTL_io_service_bytes,
 	BLKIO_THROTL_io_serviced,
+	BLKIO_THROTL_latency_target_device,
+	BLKIO_THROTL_io_latency,
+	BLKIO_THROTL_io_completed,
+	BLKIO_THROTL_latency_missed,
 };
 
 struct blkio_cgroup {
@@ -123,6 +135,8 @@ struct blkio_group_stats {
 	/* total disk time and nr sectors dispatched by this group */
 	uint64_t time;
 	uint64_t stat_arr[BLKIO_STAT_QUEUED + 1][BLKIO_STAT_TOTAL];
+	/* windows in which the latency target was missed */
+	uint64_t latency_missed;
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	/* Time not charged to this cgroup */
 	uint64_t unaccounted_time;
@@ -194,6 +208,8 @@ struct blkio_policy_node {
 		 */
 		u64 bps;
 		unsigned int iops;
+		/* Target completion latency in usecs */
+		unsigned int lat_target;
 	} val;
 };
 
@@ -207,6 +223,8 @@ extern unsigned int blkcg_get_read_iops(struct blkio_cgroup *blkcg,
 				     dev_t dev);
 extern unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg,
 				     dev_t dev);
+extern unsigned int blkcg_get_lat_target(struct blkio_cgroup *blkcg,
+				     dev_t dev);
 
 typedef void (blkio_unlink_group_fn) (void *key, struct blkio_group *blkg);
 
@@ -220,6 +238,8 @@ typedef void (blkio_update_group_read_iops_fn) (void *key,
 			struct blkio_group *blkg, unsigned int read_iops);
 typedef void (blkio_update_group_write_iops_fn) (void *key,
 			struct blkio_group *blkg, unsigned int write_iops);
+typedef void (blkio_update_group_lat_target_fn) (void *key,
+			struct blkio_group *blkg, unsigned int lat_target);
 
 struct blkio_policy_ops {
 	blkio_unlink_group_fn *blkio_unlink_group_fn;
@@ -228,6 +248,7 @@ struct blkio_policy_ops {
 	blkio_update_group_write_bps_fn *blkio_update_group_write_bps_fn;
 	blkio_update_group_read_iops_fn *blkio_update_group_read_iops_fn;
 	blkio_update_group_write_iops_fn *blkio_update_group_write_iops_fn;
+	blkio_update_group_lat_target_fn *blkio_update_group_lat_target_fn;
 };
 
 struct blkio_policy_type {
@@ -327,6 +348,9 @@ void blkiocg_update_io_add_stats(struct blkio_group *blkg,
 		struct blkio_group *curr_blkg, bool direction, bool sync);
 void blkiocg_update_io_remove_stats(struct blkio_group *blkg,
 					bool direction, bool sync);
+void blkiocg_update_latency_stats(struct blkio_group *blkg, uint64_t latency,
+					bool direction, bool sync);
+void blkiocg_update_latency_missed_stats(struct blkio_group *blkg);
 #else
 struct cgroup;
 static inline struct blkio_cgroup *
@@ -360,5 +384,9 @@ static inline void blkiocg_update_io_add_stats(struct blkio_group *blkg,
 		struct blkio_group *curr_blkg, bool direction, bool sync) {}
 static inline void blkiocg_update_io_remove_stats(struct blkio_group *blkg,
 						bool direction, bool sync) {}
+static inline void blkiocg_update_latency_stats(struct blkio_group *blkg,
+		uint64_t latency, bool direction, bool sync) {}
+static inline void
+blkiocg_update_latency_missed_stats(struct blkio_group *blkg) {}
 #endif
 #endif /* _BLK_CGROUP_H */
@@ -28,6 +28,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/fault-inject.h>
 #include <linux/list_sort.h>
+#include <linux/blk-mq.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
@@ -55,7 +56,7 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
-static void drive_stat_acct(struct request *rq, int new_io)
+void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
 	int rw = rq_data_dir(rq);
@@ -368,6 +369,9 @@ void blk_cleanup_queue(struct request_queue *q)
 	queue_flag_set_unlocked(QUEUE_FLAG_DEAD, q);
 	mutex_unlock(&q->sysfs_lock);
 
+	if (q->mq_ops)
+		blk_mq_drain_queue(q);
+
 	if (q->queue_lock != &q->__queue_lock)
 		q->queue_lock = &q->__queue_lock;
 
@@ -1035,6 +1039,7 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 		return;
 
 	elv_completed_request(q, req);
+	blk_throtl_put_rq_group(req);
 
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
@@ -1271,6 +1276,7 @@ get_rq:
 	 * often, and the elevators are able to handle it.
 	 */
 	init_request_from_bio(req, bio);
+	blk_throtl_get_rq_group(req);
 
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
 	    bio_flagged(bio, BIO_CPU_AFFINE)) {
@@ -1773,7 +1779,7 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
-static void blk_account_io_done(struct request *req)
+void blk_account_io_done(struct request *req)
 {
 	/*
 	 * Account IO completion.  flush_rq isn't accounted as a
@@ -2206,6 +2212,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_throtl_rq_completed(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -2670,6 +2677,41 @@ static void queue_unplugged(struct request_queue *q, unsigned int depth,
 
 }
 
+static void mq_unplugged(struct request_queue *q, unsigned int depth,
+			 bool from_schedule)
+{
+	trace_block_unplug(q, depth, !from_schedule);
+	blk_mq_run_queues(q, from_schedule);
+}
+
+/*
+ * Multi-queue requests take no queue_lock: move them to their software
+ * queues and run the hardware queues with interrupts enabled.
+ */
+static void flush_plug_mq_list(struct list_head *list, bool from_schedule)
+{
+	struct request_queue *q = NULL;
+	struct request *rq, *tmp;
+	unsigned int depth = 0;
+
+	list_for_each_entry_safe(rq, tmp, list, queuelist) {
+		if (!rq->q->mq_ops)
+			continue;
+		if (rq->q != q) {
+			if (q)
+				mq_unplugged(q, depth, from_schedule);
+			q = rq->q;
+			depth = 0;
+		}
+		list_del_init(&rq->queuelist);
+		blk_mq_insert_request(rq, false, false);
+		depth++;
+	}
+
+	if (q)
+		mq_unplugged(q, depth, from_schedule);
+}
+
 static void flush_plug_callbacks(struct blk_plug *plug)
 {
 	LIST_HEAD(callbacks);
@@ -2709,6 +2751,8 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 		plug->should_sort = 0;
 	}
 
+	flush_plug_mq_list(&list, from_schedule);
+
 	q = NULL;
 	depth = 0;
 
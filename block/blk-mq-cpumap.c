@@ -0,0 +1,57 @@
+/*
+ * Mapping of cpus to the hardware queues of a multi-queue device.
+ */
+#include <linux/kernel.h>
+#include <linux/threads.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/topology.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+
+#include "blk-mq.h"
+
+static unsigned int first_sibling(unsigned int cpu)
+{
+	unsigned int first = cpumask_first(topology_thread_cpumask(cpu));
+
+	return first < nr_cpu_ids ? first : cpu;
+}
+
+/*
+ * Spread the cores evenly over @nr_queues queues. Hyperthread siblings
+ * share a queue, there is nothing to be gained from them competing for
+ * separate ones.
+ */
+void blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int cpu, nr_cores = 0, core = 0;
+
+	for_each_possible_cpu(cpu)
+		if (first_sibling(cpu) == cpu)
+			nr_cores++;
+
+	for_each_possible_cpu(cpu) {
+		unsigned int first = first_sibling(cpu);
+
+		if (first != cpu) {
+			map[cpu] = map[first];
+			continue;
+		}
+		map[cpu] = (core++ * nr_queues) / nr_cores;
+	}
+}
+
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
+{
+	unsigned int *map;
+
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL,
+			   reg->numa_node);
+	if (!map)
+		return NULL;
+
+	blk_mq_update_queue_map(map, reg->nr_hw_queues);
+	return map;
+}
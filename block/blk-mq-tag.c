@@ -0,0 +1,192 @@
+/*
+ * Tag allocation for multi-queue block devices. Each hardware queue has a
+ * bitmap of queue_depth tags, the first reserved_tags of which can only be
+ * taken by callers asking for a reserved tag (typically the driver itself,
+ * for error handling commands). Every cpu remembers where it last found a
+ * free tag and starts searching there, so cpus sharing a hardware queue
+ * mostly touch different words of the bitmap.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/bitops.h>
+
+#include "blk-mq-tag.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned int		nr_reserved_tags;
+
+	unsigned int __percpu	*hint;
+	/* waiters for normal ([0]) and reserved ([1]) tags */
+	wait_queue_head_t	wait[2];
+
+	unsigned long		map[0];
+};
+
+/*
+ * Find and take a free tag in [start, end), looking from @hint to the end
+ * first and then from @start up to @hint.
+ */
+static unsigned int __blk_mq_find_tag(unsigned long *map, unsigned int start,
+				      unsigned int end, unsigned int hint)
+{
+	unsigned int tag = hint;
+
+again:
+	while ((tag = find_next_zero_bit(map, end, tag)) < end) {
+		if (!test_and_set_bit_lock(tag, map))
+			return tag;
+		tag++;
+	}
+	if (hint != start) {
+		end = hint;
+		tag = hint = start;
+		goto again;
+	}
+	return BLK_MQ_TAG_FAIL;
+}
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int tag, hint;
+
+	if (reserved) {
+		if (!tags->nr_reserved_tags)
+			return BLK_MQ_TAG_FAIL;
+		return __blk_mq_find_tag(tags->map, 0, tags->nr_reserved_tags,
+					 0);
+	}
+
+	hint = this_cpu_read(*tags->hint);
+	if (hint < tags->nr_reserved_tags || hint >= tags->nr_tags)
+		hint = tags->nr_reserved_tags;
+
+	tag = __blk_mq_find_tag(tags->map, tags->nr_reserved_tags,
+				tags->nr_tags, hint);
+	if (tag != BLK_MQ_TAG_FAIL)
+		this_cpu_write(*tags->hint, tag + 1);
+	return tag;
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags:	tag map of the hardware queue
+ * @gfp:	allocation mask, sleep for a tag to be freed if it has __GFP_WAIT
+ * @reserved:	allocate from the reserved tags
+ *
+ * Returns the tag, or %BLK_MQ_TAG_FAIL if none was free and @gfp does not
+ * allow sleeping.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved)
+{
+	wait_queue_head_t *wq = &tags->wait[reserved];
+	DEFINE_WAIT(wait);
+	unsigned int tag;
+
+	tag = __blk_mq_get_tag(tags, reserved);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(wq, &wait, TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags, reserved);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	}
+	finish_wait(wq, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	bool reserved = tag < tags->nr_reserved_tags;
+	wait_queue_head_t *wq = &tags->wait[reserved];
+
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit_unlock(tag, tags->map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(wq))
+		wake_up(wq);
+
+	/* the tag just freed is the one most likely still cache hot */
+	if (!reserved)
+		this_cpu_write(*tags->hint, tag);
+}
+
+/*
+ * Sleep until a tag can be allocated, without keeping it. Used when the
+ * hardware queue to allocate from may change once we are woken up.
+ */
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(tags, __GFP_WAIT, reserved);
+	blk_mq_put_tag(tags, tag);
+}
+
+/*
+ * Call @fn for every tag currently allocated. The tags may be freed and
+ * reallocated while we look at them, @fn has to cope with that.
+ */
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+			  void (*fn)(void *data, unsigned int tag), void *data)
+{
+	unsigned int tag;
+
+	for_each_set_bit(tag, tags->map, tags->nr_tags)
+		fn(data, tag);
+}
+
+unsigned int blk_mq_tags_busy(struct blk_mq_tags *tags)
+{
+	return bitmap_weight(tags->map, tags->nr_tags);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+				     unsigned int reserved_tags, int node)
+{
+	unsigned int nr_normal = nr_tags - reserved_tags;
+	struct blk_mq_tags *tags;
+	int cpu;
+
+	if (reserved_tags >= nr_tags)
+		return NULL;
+
+	tags = kzalloc_node(sizeof(*tags) +
+			    BITS_TO_LONGS(nr_tags) * sizeof(unsigned long),
+			    GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = nr_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait[0]);
+	init_waitqueue_head(&tags->wait[1]);
+
+	/* spread the starting points of the cpus over the tag space */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->hint, cpu) = reserved_tags +
+			(nr_normal * cpu) / nr_cpu_ids;
+
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags);
+}
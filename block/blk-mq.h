@@ -0,0 +1,27 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-cpu software queue. Requests are staged here by the submitting cpu
+ * and moved to the dispatch list of the hardware queue it maps to when that
+ * queue is run.
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	struct request_queue	*queue;
+};
+
+/*
+ * CPU -> queue mappings
+ */
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg);
+void blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues);
+
+#endif
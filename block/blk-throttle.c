@@ -20,6 +20,12 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/* Latency targets are checked and the throttling they cause adjusted every */
+static unsigned long throtl_lat_window = HZ/10;	/* 100 ms */
+
+/* Min IOPS left to a group throttled in favour of a latency target */
+static unsigned int throtl_lat_min_iops = 8;
+
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 static void throtl_schedule_delayed_work(struct throtl_data *td,
@@ -67,6 +73,21 @@ struct throtl_grp {
 	/* IOPS limits */
 	unsigned int iops[2];
 
+	/* Target completion latency in usecs, 0 if none */
+	unsigned int lat_target;
+
+	/*
+	 * IOPS limits imposed while a group with a tighter latency target
+	 * misses it. -1 if none.
+	 */
+	unsigned int lat_iops[2];
+
+	/* Requests completed, their total latency in ns and bios dispatched
+	 * in current latency window */
+	unsigned int lat_nr;
+	u64 lat_sum;
+	unsigned int lat_disp[2];
+
 	/* Number of bytes disptached in current slice */
 	uint64_t bytes_disp[2];
 	/* Number of bio's dispatched in current slice */
@@ -105,6 +126,12 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/* Number of groups with a latency target */
+	unsigned int nr_lat_grps;
+
+	/* When did the current latency window start */
+	unsigned long lat_window_start;
 };
 
 enum tg_state_flags {
@@ -153,6 +180,12 @@ static inline struct throtl_grp *throtl_ref_get_tg(struct throtl_grp *tg)
 	return tg;
 }
 
+/* IOPS limit of a group, including the one imposed by latency targets */
+static inline unsigned int tg_iops(struct throtl_grp *tg, bool rw)
+{
+	return min(tg->iops[rw], tg->lat_iops[rw]);
+}
+
 static void throtl_free_tg(struct rcu_head *head)
 {
 	struct throtl_grp *tg;
@@ -191,6 +224,7 @@ static void throtl_init_group(struct throtl_grp *tg)
 	/* Practically unlimited BW */
 	tg->bps[0] = tg->bps[1] = -1;
 	tg->iops[0] = tg->iops[1] = -1;
+	tg->lat_iops[0] = tg->lat_iops[1] = -1;
 
 	/*
 	 * Take the initial reference that will be released on destroy
@@ -258,6 +292,9 @@ static void throtl_init_add_tg_lists(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	tg->lat_target = blkcg_get_lat_target(blkcg, tg->blkg.dev);
+	if (tg->lat_target)
+		td->nr_lat_grps++;
 
 	throtl_add_group_to_td_list(td, tg);
 }
@@ -567,7 +604,7 @@ throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 	do_div(tmp, HZ);
 	bytes_trim = tmp;
 
-	io_trim = (tg->iops[rw] * throtl_slice * nr_slices)/HZ;
+	io_trim = (tg_iops(tg, rw) * throtl_slice * nr_slices)/HZ;
 
 	if (!bytes_trim && !io_trim)
 		return;
@@ -613,7 +650,7 @@ static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
 	 * have been trimmed.
 	 */
 
-	tmp = (u64)tg->iops[rw] * jiffy_elapsed_rnd;
+	tmp = (u64)tg_iops(tg, rw) * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 
 	if (tmp > UINT_MAX)
@@ -628,7 +665,7 @@ static bool tg_with_in_iops_limit(struct throtl_data *td, struct throtl_grp *tg,
 	}
 
 	/* Calc approx time to dispatch */
-	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/tg->iops[rw] + 1;
+	jiffy_wait = ((tg->io_disp[rw] + 1) * HZ)/tg_iops(tg, rw) + 1;
 
 	if (jiffy_wait > jiffy_elapsed)
 		jiffy_wait = jiffy_wait - jiffy_elapsed;
@@ -683,7 +720,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 }
 
 static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
+	if (tg->bps[rw] == -1 && tg_iops(tg, rw) == -1)
 		return 1;
 	return 0;
 }
@@ -707,7 +744,7 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
 
 	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
+	if (tg_no_rule_group(tg, rw)) {
 		if (wait)
 			*wait = 0;
 		return 1;
@@ -751,6 +788,7 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 	/* Charge the bio to the group */
 	tg->bytes_disp[rw] += bio->bi_size;
 	tg->io_disp[rw]++;
+	tg->lat_disp[rw]++;
 
 	blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size, rw, sync);
 }
@@ -876,6 +914,7 @@ static void throtl_process_limit_change(struct throtl_data *td)
 {
 	struct throtl_grp *tg;
 	struct hlist_node *pos, *n;
+	unsigned int nr_lat_grps = 0;
 
 	if (!td->limits_changed)
 		return;
@@ -884,7 +923,22 @@ static void throtl_process_limit_change(struct throtl_data *td)
 
 	throtl_log(td, "limits changed");
 
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		if (tg->lat_target)
+			nr_lat_grps++;
+	td->nr_lat_grps = nr_lat_grps;
+
 	hlist_for_each_entry_safe(tg, pos, n, &td->tg_list, tg_node) {
+		/*
+		 * With the last latency target gone, nothing will lift the
+		 * limits imposed in favour of latency targets any more
+		 */
+		if (!nr_lat_grps && (tg->lat_iops[READ] != -1 ||
+				     tg->lat_iops[WRITE] != -1)) {
+			tg->lat_iops[READ] = tg->lat_iops[WRITE] = -1;
+			tg->limits_changed = true;
+		}
+
 		if (!tg->limits_changed)
 			continue;
 
@@ -909,6 +963,108 @@ static void throtl_process_limit_change(struct throtl_data *td)
 	}
 }
 
+/*
+ * Adjust the IOPS limit of a group at the end of a latency window. If a group
+ * with a tighter latency target than ours (or any, if we have none) missed
+ * it, halve the rate we got through in the window. Once all targets are met
+ * again, give back a quarter of the limit per window, and drop the limit
+ * when it is no longer what holds the group back.
+ */
+static bool tg_update_lat_iops(struct throtl_grp *tg, unsigned int missed,
+				unsigned long elapsed)
+{
+	bool squeeze = missed && (!tg->lat_target || tg->lat_target > missed);
+	bool changed = false;
+	unsigned int iops, rate;
+	int rw;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		iops = tg->lat_iops[rw];
+		rate = div_u64((u64)tg->lat_disp[rw] * HZ, elapsed);
+
+		if (squeeze) {
+			/* An idle direction is not what hurts the target */
+			if (!tg->lat_disp[rw])
+				continue;
+			iops = min(iops, max(rate / 2, throtl_lat_min_iops));
+		} else if (iops != -1) {
+			if (rate < iops / 2)
+				iops = -1;
+			else
+				iops += iops / 4 + 1;
+		}
+
+		if (iops != tg->lat_iops[rw]) {
+			tg->lat_iops[rw] = iops;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Check latency targets once per throtl_lat_window. Called with queue lock
+ * held, from request completion.
+ */
+static void throtl_lat_check_window(struct throtl_data *td)
+{
+	unsigned long elapsed = jiffies - td->lat_window_start;
+	unsigned int missed = 0, nr_lat_grps = 0;
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	if (elapsed < throtl_lat_window)
+		return;
+
+	/* Find the tightest latency target that was missed */
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		if (!tg->lat_target)
+			continue;
+		nr_lat_grps++;
+
+		if (!tg->lat_nr || div_u64(tg->lat_sum, tg->lat_nr) <=
+				(u64)tg->lat_target * NSEC_PER_USEC)
+			continue;
+
+		throtl_log_tg(td, tg, "latency target %uus missed avg=%lluns"
+				" nr=%u", tg->lat_target,
+				div_u64(tg->lat_sum, tg->lat_nr), tg->lat_nr);
+		blkiocg_update_latency_missed_stats(&tg->blkg);
+		if (!missed || tg->lat_target < missed)
+			missed = tg->lat_target;
+	}
+	td->nr_lat_grps = nr_lat_grps;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		bool changed;
+
+		/* No target left to squeeze for, lift all latency limits */
+		if (!nr_lat_grps) {
+			changed = tg->lat_iops[READ] != -1 ||
+				  tg->lat_iops[WRITE] != -1;
+			tg->lat_iops[READ] = tg->lat_iops[WRITE] = -1;
+		} else
+			changed = tg_update_lat_iops(tg, missed, elapsed);
+
+		if (changed) {
+			throtl_log_tg(td, tg, "latency limit riops=%u wiops=%u",
+					tg->lat_iops[READ], tg->lat_iops[WRITE]);
+			throtl_start_new_slice(td, tg, READ);
+			throtl_start_new_slice(td, tg, WRITE);
+			if (throtl_tg_on_rr(tg))
+				tg_update_disptime(td, tg);
+		}
+
+		tg->lat_nr = 0;
+		tg->lat_sum = 0;
+		tg->lat_disp[READ] = tg->lat_disp[WRITE] = 0;
+	}
+
+	td->lat_window_start = jiffies;
+	throtl_schedule_next_dispatch(td);
+}
+
 /* Dispatch throttled bios. Should be called without queue lock held. */
 static int throtl_dispatch(struct request_queue *q)
 {
@@ -990,6 +1146,16 @@ throtl_destroy_tg(struct throtl_data *td, struct throtl_grp *tg)
 
 	hlist_del_init(&tg->tg_node);
 
+	/*
+	 * Groups may have been squeezed in favour of our latency target. Have
+	 * throtl_process_limit_change() recount the targets and lift those
+	 * limits if it was the last one.
+	 */
+	if (tg->lat_target) {
+		xchg(&td->limits_changed, true);
+		throtl_schedule_delayed_work(td, 0);
+	}
+
 	/*
 	 * Put the reference taken at the time of creation so that when all
 	 * queues are gone, group can be destroyed.
@@ -1101,6 +1267,16 @@ static void throtl_update_blkio_group_write_iops(void *key,
 	throtl_update_blkio_group_common(td, tg);
 }
 
+static void throtl_update_blkio_group_lat_target(void *key,
+			struct blkio_group *blkg, unsigned int lat_target)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->lat_target = lat_target;
+	throtl_update_blkio_group_common(td, tg);
+}
+
 static void throtl_shutdown_wq(struct request_queue *q)
 {
 	struct throtl_data *td = q->td;
@@ -1119,6 +1295,8 @@ static struct blkio_policy_type blkio_policy_throtl = {
 					throtl_update_blkio_group_read_iops,
 		.blkio_update_group_write_iops_fn =
 					throtl_update_blkio_group_write_iops,
+		.blkio_update_group_lat_target_fn =
+					throtl_update_blkio_group_lat_target,
 	},
 	.plid = BLKIO_POLICY_THROTL,
 };
@@ -1148,7 +1326,11 @@ int blk_throtl_bio(struct request_queue *q, struct bio **biop)
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
 
-		if (tg_no_rule_group(tg, rw)) {
+		/*
+		 * Groups without rules still need their dispatches counted
+		 * once latency targets are set on the device
+		 */
+		if (tg_no_rule_group(tg, rw) && !td->nr_lat_grps) {
 			blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size,
 					rw, bio->bi_rw & REQ_SYNC);
 			rcu_read_unlock();
@@ -1224,6 +1406,56 @@ out:
 	return 0;
 }
 
+/*
+ * In latency target mode, requests carry a reference to the group of the
+ * task that allocated them until they are freed, so that their completion
+ * latency can be accounted to it. Called without queue lock held.
+ */
+void blk_throtl_get_rq_group(struct request *rq)
+{
+	struct throtl_data *td = rq->q->td;
+	struct throtl_grp *tg;
+
+	if (!td || !td->nr_lat_grps)
+		return;
+
+	rcu_read_lock();
+	tg = throtl_find_tg(td, task_blkio_cgroup(current));
+	if (tg && atomic_inc_not_zero(&tg->ref))
+		rq->throtl_grp = tg;
+	rcu_read_unlock();
+}
+
+void blk_throtl_put_rq_group(struct request *rq)
+{
+	if (!rq->throtl_grp)
+		return;
+
+	throtl_put_tg(rq->throtl_grp);
+	rq->throtl_grp = NULL;
+}
+
+/* Account the latency of a completed request. Call with queue lock held. */
+void blk_throtl_rq_completed(struct request *rq)
+{
+	struct throtl_grp *tg = rq->throtl_grp;
+	unsigned long long now = sched_clock();
+	u64 lat = 0;
+
+	if (!tg)
+		return;
+
+	if (time_after64(now, rq_start_time_ns(rq)))
+		lat = now - rq_start_time_ns(rq);
+
+	tg->lat_nr++;
+	tg->lat_sum += lat;
+	blkiocg_update_latency_stats(&tg->blkg, lat, rq_data_dir(rq),
+					rq_is_sync(rq));
+
+	throtl_lat_check_window(rq->q->td);
+}
+
 int blk_throtl_init(struct request_queue *q)
 {
 	struct throtl_data *td;
@@ -1236,6 +1468,7 @@ int blk_throtl_init(struct request_queue *q)
 	INIT_HLIST_HEAD(&td->tg_list);
 	td->tg_service_tree = THROTL_RB_ROOT;
 	td->limits_changed = false;
+	td->lat_window_start = jiffies;
 	INIT_DELAYED_WORK(&td->throtl_work, blk_throtl_work);
 
 	/* alloc and Init root group. */
@@ -0,0 +1,475 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Read-priority scheduling for devices without seek penalty, such as
+ *  eMMC. Requests are kept in FIFO order per ioprio class and type (reads,
+ *  sync writes, async writes). Reads of the highest class with work are
+ *  served first; writes are dispatched in quanta, once reads have starved
+ *  them for long enough or when there are no reads. No request waits much
+ *  past its expire time, whatever its class.
+ *
+ *  See Documentation/block/flash-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/ktime.h>
+
+static const int read_expire = HZ / 4;	/* max time before a read is submitted */
+static const int write_expire = 2 * HZ;	/* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 4;	/* max reads dispatched while writes wait */
+static const int write_quantum = 16;	/* writes dispatched in one go */
+
+/* ioprio classes, in the order they are served */
+enum {
+	FLASH_CLASS_RT,
+	FLASH_CLASS_BE,
+	FLASH_CLASS_IDLE,
+	FLASH_NR_CLASSES,
+};
+
+enum {
+	FLASH_READ,
+	FLASH_SYNC_WRITE,
+	FLASH_ASYNC_WRITE,
+	FLASH_NR_TYPES,
+};
+
+/*
+ * Completion latency histogram: bucket 0 counts requests that took less
+ * than 250us, bucket n those that took less than 250us << n, the last
+ * bucket everything slower.
+ */
+#define FLASH_LAT_BASE_US	250
+#define FLASH_LAT_BUCKETS	14
+
+struct flash_data {
+	struct list_head fifo_list[FLASH_NR_CLASSES][FLASH_NR_TYPES];
+
+	unsigned int starved;		/* reads dispatched while writes wait */
+	unsigned int batch_left;	/* writes left in this quantum */
+	int batch_class;		/* class of the current quantum */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int writes_starved;
+	int write_quantum;
+
+	/* per class completion latencies of reads and writes */
+	unsigned long lat_hist[FLASH_NR_CLASSES][2][FLASH_LAT_BUCKETS];
+};
+
+/*
+ * elevator_private[0] holds the time the request was queued in usecs,
+ * elevator_private[1] its class + 1 (0 when it was set up without us).
+ */
+#define rq_flash_stamp(rq)	((u32)(unsigned long)(rq)->elevator_private[0])
+#define rq_flash_class(rq)						\
+	((rq)->elevator_private[1] ?					\
+	 (int)(unsigned long)(rq)->elevator_private[1] - 1 : FLASH_CLASS_BE)
+
+static u32 flash_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+static int flash_prio_class(int ioprio)
+{
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_RT:
+		return FLASH_CLASS_RT;
+	case IOPRIO_CLASS_IDLE:
+		return FLASH_CLASS_IDLE;
+	default:
+		return FLASH_CLASS_BE;
+	}
+}
+
+static int flash_task_class(struct task_struct *tsk)
+{
+	struct io_context *ioc = tsk->io_context;
+
+	if (ioc && ioprio_valid(ioc->ioprio))
+		return flash_prio_class(ioc->ioprio);
+	return flash_prio_class(IOPRIO_PRIO_VALUE(task_nice_ioclass(tsk), 0));
+}
+
+static int flash_rq_type(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return FLASH_READ;
+	return rq_is_sync(rq) ? FLASH_SYNC_WRITE : FLASH_ASYNC_WRITE;
+}
+
+/*
+ * Called from the context of the submitting task, when the request is
+ * allocated
+ */
+static int
+flash_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	rq->elevator_private[1] =
+		(void *)(unsigned long)(flash_task_class(current) + 1);
+	return 0;
+}
+
+/*
+ * Only merge requests of the same class and type, so the FIFOs stay
+ * consistent
+ */
+static int
+flash_allow_merge(struct request_queue *q, struct request *rq, struct bio *bio)
+{
+	int bio_type;
+
+	if (bio_data_dir(bio) == READ)
+		bio_type = FLASH_READ;
+	else
+		bio_type = (bio->bi_rw & REQ_SYNC) ? FLASH_SYNC_WRITE :
+						     FLASH_ASYNC_WRITE;
+	if (bio_type != flash_rq_type(rq))
+		return 0;
+
+	return flash_task_class(current) == rq_flash_class(rq);
+}
+
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+	int class;
+
+	/* an explicit priority on the request wins over the task's */
+	if (ioprio_valid(rq->ioprio))
+		rq->elevator_private[1] =
+			(void *)(unsigned long)(flash_prio_class(rq->ioprio) + 1);
+	class = rq_flash_class(rq);
+
+	rq->elevator_private[0] = (void *)(unsigned long)flash_now_us();
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[data_dir]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[class][flash_rq_type(rq)]);
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+			req->elevator_private[0] = next->elevator_private[0];
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	rq_fifo_clear(next);
+}
+
+static void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	rq_fifo_clear(rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+static struct request *flash_fifo_first(struct list_head *fifo)
+{
+	if (list_empty(fifo))
+		return NULL;
+	return rq_entry_fifo(fifo->next);
+}
+
+/*
+ * The request that has waited the longest past its expire time, if any
+ */
+static struct request *flash_expired_request(struct flash_data *fd)
+{
+	struct request *rq, *oldest = NULL;
+	int class, type;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		for (type = 0; type < FLASH_NR_TYPES; type++) {
+			rq = flash_fifo_first(&fd->fifo_list[class][type]);
+			if (!rq || time_before(jiffies, rq_fifo_time(rq)))
+				continue;
+			if (!oldest ||
+			    time_before(rq_fifo_time(rq), rq_fifo_time(oldest)))
+				oldest = rq;
+		}
+	}
+	return oldest;
+}
+
+static struct request *flash_first_write(struct flash_data *fd, int class)
+{
+	struct request *rq;
+
+	rq = flash_fifo_first(&fd->fifo_list[class][FLASH_SYNC_WRITE]);
+	if (!rq)
+		rq = flash_fifo_first(&fd->fifo_list[class][FLASH_ASYNC_WRITE]);
+	return rq;
+}
+
+static void flash_start_write_quantum(struct flash_data *fd, int class)
+{
+	fd->starved = 0;
+	fd->batch_class = class;
+	fd->batch_left = fd->write_quantum > 1 ? fd->write_quantum - 1 : 0;
+}
+
+/*
+ * flash_dispatch_requests selects the best request according to
+ * read/write expire, the write quantum and the ioprio classes
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *rq;
+	int class;
+
+	/*
+	 * finish the write quantum we are in
+	 */
+	if (fd->batch_left) {
+		rq = flash_first_write(fd, fd->batch_class);
+		if (rq) {
+			fd->batch_left--;
+			goto dispatch_request;
+		}
+		fd->batch_left = 0;
+	}
+
+	/*
+	 * then anything that has waited too long, so no class and no
+	 * direction starves for more than its expire time
+	 */
+	rq = flash_expired_request(fd);
+	if (rq) {
+		if (rq_data_dir(rq) == WRITE)
+			flash_start_write_quantum(fd, rq_flash_class(rq));
+		goto dispatch_request;
+	}
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		struct request *read, *write;
+
+		read = flash_fifo_first(&fd->fifo_list[class][FLASH_READ]);
+		write = flash_first_write(fd, class);
+		if (!read && !write)
+			continue;
+
+		if (read && (!write || fd->starved < fd->writes_starved)) {
+			if (write)
+				fd->starved++;
+			rq = read;
+			goto dispatch_request;
+		}
+
+		flash_start_write_quantum(fd, class);
+		rq = write;
+		goto dispatch_request;
+	}
+
+	return 0;
+
+dispatch_request:
+	flash_move_to_dispatch(fd, rq);
+	return 1;
+}
+
+static void
+flash_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	u32 lat = flash_now_us() - rq_flash_stamp(rq);
+	int bucket = min(fls(lat / FLASH_LAT_BASE_US), FLASH_LAT_BUCKETS - 1);
+
+	fd->lat_hist[rq_flash_class(rq)][rq_data_dir(rq)][bucket]++;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int class, type;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		for (type = 0; type < FLASH_NR_TYPES; type++)
+			BUG_ON(!list_empty(&fd->fifo_list[class][type]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int class, type;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		for (type = 0; type < FLASH_NR_TYPES; type++)
+			INIT_LIST_HEAD(&fd->fifo_list[class][type]);
+	fd->fifo_expire[READ] = read_expire;
+	fd->fifo_expire[WRITE] = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_quantum = write_quantum;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[READ], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_quantum_show, fd->write_quantum, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_quantum_store, &fd->write_quantum, 1, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+static ssize_t flash_lat_hist_show(struct flash_data *fd, int class, char *page)
+{
+	unsigned long *reads = fd->lat_hist[class][READ];
+	unsigned long *writes = fd->lat_hist[class][WRITE];
+	char *p = page;
+	int i;
+
+	p += sprintf(p, "%10s %10s %10s\n", "usecs", "reads", "writes");
+	for (i = 0; i < FLASH_LAT_BUCKETS - 1; i++)
+		p += sprintf(p, "<%9u %10lu %10lu\n", FLASH_LAT_BASE_US << i,
+			     reads[i], writes[i]);
+	p += sprintf(p, ">=%8u %10lu %10lu\n", FLASH_LAT_BASE_US << (i - 1),
+		     reads[i], writes[i]);
+	return p - page;
+}
+
+#define LAT_HIST_FUNCTION(__FUNC, __CLASS)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	return flash_lat_hist_show(e->elevator_data, __CLASS, page);	\
+}
+LAT_HIST_FUNCTION(flash_rt_lat_hist_show, FLASH_CLASS_RT);
+LAT_HIST_FUNCTION(flash_be_lat_hist_show, FLASH_CLASS_BE);
+LAT_HIST_FUNCTION(flash_idle_lat_hist_show, FLASH_CLASS_IDLE);
+#undef LAT_HIST_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+#define FD_ATTR_RO(name) \
+	__ATTR(name, S_IRUGO, flash_##name##_show, NULL)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(read_expire),
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_quantum),
+	FD_ATTR_RO(rt_lat_hist),
+	FD_ATTR_RO(be_lat_hist),
+	FD_ATTR_RO(idle_lat_hist),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -0,0 +1,416 @@
+/*
+ * Null test block driver.
+ *
+ * Completes every request without touching its data, so that what is
+ * measured against it is the cost of the block layer: bio submission,
+ * request allocation, queueing and completion. The same device can be set
+ * up as a bio based queue, a request_fn queue with an elevator, or a
+ * multi-queue device, to compare the three paths.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/hrtimer.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+struct nullb {
+	struct list_head	list;
+	unsigned int		index;
+	struct request_queue	*q;
+	struct gendisk		*disk;
+	spinlock_t		lock;		/* queue_lock in NULL_Q_RQ mode */
+	unsigned int		in_flight;	/* NULL_Q_RQ, under lock */
+};
+
+/*
+ * Per-cpu list of requests and bios waiting for the completion timer
+ */
+struct completion_queue {
+	spinlock_t		lock;
+	struct list_head	rqs;
+	struct bio_list		bios;
+	struct hrtimer		timer;
+	bool			armed;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(nullb_mutex);
+static int null_major;
+static unsigned int nullb_indexes;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface to use (0=bio,1=rq,2=multiqueue)");
+
+static int submit_queues = 1;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of hardware queues in multiqueue mode");
+
+static int home_node = -1;
+module_param(home_node, int, S_IRUGO);
+MODULE_PARM_DESC(home_node, "Home node for the device");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-softirq, 2-timer");
+
+static int completion_nsec = 10000;
+module_param(completion_nsec, int, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
+
+static void end_rq(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct nullb *nullb = q->queuedata;
+	unsigned long flags;
+
+	if (queue_mode == NULL_Q_MQ) {
+		blk_mq_end_io(rq, 0);
+		return;
+	}
+
+	/* a slot is free again, let the elevator hand out the next request */
+	spin_lock_irqsave(q->queue_lock, flags);
+	__blk_end_request_all(rq, 0);
+	nullb->in_flight--;
+	blk_run_queue_async(q);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	struct completion_queue *cq;
+	struct request *rq, *tmp;
+	struct bio_list bios;
+	struct bio *bio;
+	LIST_HEAD(rqs);
+	unsigned long flags;
+
+	cq = container_of(timer, struct completion_queue, timer);
+
+	spin_lock_irqsave(&cq->lock, flags);
+	list_splice_init(&cq->rqs, &rqs);
+	bios = cq->bios;
+	bio_list_init(&cq->bios);
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	list_for_each_entry_safe(rq, tmp, &rqs, queuelist) {
+		list_del_init(&rq->queuelist);
+		end_rq(rq);
+	}
+	while ((bio = bio_list_pop(&bios)) != NULL)
+		bio_endio(bio, 0);
+
+	spin_lock_irqsave(&cq->lock, flags);
+	if (list_empty(&cq->rqs) && bio_list_empty(&cq->bios)) {
+		cq->armed = false;
+		spin_unlock_irqrestore(&cq->lock, flags);
+		return HRTIMER_NORESTART;
+	}
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	hrtimer_forward_now(timer, ktime_set(0, completion_nsec));
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Complete @rq or @bio completion_nsec from now, from the timer of this cpu
+ */
+static void null_end_timer(struct request *rq, struct bio *bio)
+{
+	struct completion_queue *cq = &get_cpu_var(completion_queues);
+	unsigned long flags;
+
+	spin_lock_irqsave(&cq->lock, flags);
+	if (rq)
+		list_add_tail(&rq->queuelist, &cq->rqs);
+	else
+		bio_list_add(&cq->bios, bio);
+	if (!cq->armed) {
+		cq->armed = true;
+		hrtimer_start(&cq->timer, ktime_set(0, completion_nsec),
+			      HRTIMER_MODE_REL_PINNED);
+	}
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	put_cpu_var(completion_queues);
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	end_rq(rq);
+}
+
+static void null_handle_rq(struct request *rq)
+{
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		if (queue_mode == NULL_Q_MQ)
+			blk_mq_complete_request(rq);
+		else
+			blk_complete_request(rq);
+		break;
+	case NULL_IRQ_TIMER:
+		null_end_timer(rq, NULL);
+		break;
+	default:
+		end_rq(rq);
+		break;
+	}
+}
+
+static int null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	/* there is no softirq completion for bios, end them inline */
+	if (irqmode == NULL_IRQ_TIMER)
+		null_end_timer(NULL, bio);
+	else
+		bio_endio(bio, 0);
+	return 0;
+}
+
+/*
+ * Like a real device, take no more than hw_queue_depth requests at a time,
+ * so the elevator keeps the rest and gets to choose among them
+ */
+static void null_request_fn(struct request_queue *q)
+{
+	struct nullb *nullb = q->queuedata;
+	struct request *rq;
+
+	while (nullb->in_flight < hw_queue_depth &&
+	       (rq = blk_fetch_request(q)) != NULL) {
+		nullb->in_flight++;
+		spin_unlock_irq(q->queue_lock);
+		null_handle_rq(rq);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	null_handle_rq(rq);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= null_softirq_done_fn,
+};
+
+static struct blk_mq_reg null_mq_reg = {
+	.ops		= &null_mq_ops,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static void null_del_devs(void)
+{
+	struct nullb *nullb;
+
+	mutex_lock(&nullb_mutex);
+	while (!list_empty(&nullb_list)) {
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		null_del_dev(nullb);
+	}
+	mutex_unlock(&nullb_mutex);
+}
+
+static int null_open(struct block_device *bdev, fmode_t mode)
+{
+	return 0;
+}
+
+static int null_release(struct gendisk *disk, fmode_t mode)
+{
+	return 0;
+}
+
+static const struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+	.open =		null_open,
+	.release =	null_release,
+};
+
+static int null_add_dev(void)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	u64 size;
+
+	nullb = kzalloc_node(sizeof(*nullb), GFP_KERNEL, home_node);
+	if (!nullb)
+		return -ENOMEM;
+
+	spin_lock_init(&nullb->lock);
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		null_mq_reg.numa_node = home_node;
+		null_mq_reg.queue_depth = hw_queue_depth;
+		null_mq_reg.nr_hw_queues = submit_queues;
+		nullb->q = blk_mq_init_queue(&null_mq_reg, nullb);
+		break;
+	case NULL_Q_BIO:
+		nullb->q = blk_alloc_queue_node(GFP_KERNEL, home_node);
+		if (nullb->q)
+			blk_queue_make_request(nullb->q, null_queue_bio);
+		break;
+	default:
+		nullb->q = blk_init_queue_node(null_request_fn, &nullb->lock,
+					       home_node);
+		if (nullb->q)
+			blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+		break;
+	}
+	if (!nullb->q)
+		goto out_free;
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+
+	disk = nullb->disk = alloc_disk_node(1, home_node);
+	if (!disk)
+		goto out_cleanup;
+
+	mutex_lock(&nullb_mutex);
+	list_add_tail(&nullb->list, &nullb_list);
+	nullb->index = nullb_indexes++;
+	mutex_unlock(&nullb_mutex);
+
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	size = (u64)gb << 30;
+	do_div(size, bs);
+	set_capacity(disk, size * (bs >> 9));
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+	return 0;
+
+out_cleanup:
+	blk_cleanup_queue(nullb->q);
+out_free:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+
+	if (bs > PAGE_SIZE || bs < 512 || !is_power_of_2(bs)) {
+		pr_warn("null_blk: invalid block size\n");
+		pr_warn("null_blk: defaults block size to 512\n");
+		bs = 512;
+	}
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ)
+		queue_mode = NULL_Q_MQ;
+	if (irqmode < NULL_IRQ_NONE || irqmode > NULL_IRQ_TIMER)
+		irqmode = NULL_IRQ_SOFTIRQ;
+
+	if (queue_mode == NULL_Q_MQ) {
+		if (submit_queues < 1)
+			submit_queues = 1;
+		else if (submit_queues > nr_cpu_ids)
+			submit_queues = nr_cpu_ids;
+	}
+	if (hw_queue_depth < 1)
+		hw_queue_depth = 1;
+	else if (hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = BLK_MQ_MAX_DEPTH;
+
+	for_each_possible_cpu(i) {
+		struct completion_queue *cq = &per_cpu(completion_queues, i);
+
+		spin_lock_init(&cq->lock);
+		INIT_LIST_HEAD(&cq->rqs);
+		bio_list_init(&cq->bios);
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cq->timer.function = null_cmd_timer_expired;
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev()) {
+			null_del_devs();
+			unregister_blkdev(null_major, "nullb");
+			return -ENOMEM;
+		}
+	}
+
+	pr_info("null: module loaded\n");
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	unsigned int cpu;
+
+	unregister_blkdev(null_major, "nullb");
+	null_del_devs();
+
+	for_each_possible_cpu(cpu)
+		hrtimer_cancel(&per_cpu(completion_queues, cpu).timer);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_DESCRIPTION("Null test block driver");
+MODULE_LICENSE("GPL");
@@ -13,100 +13,129 @@
  *
  */
 
-#include <asm/atomic.h>
-
 #include <linux/err.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
 #include <linux/slab.h>
-#include <linux/spinlock.h>
 #include <linux/stat.h>
 #include <linux/uid_stat.h>
 #include <net/activity_stats.h>
 
-static DEFINE_SPINLOCK(uid_lock);
-static LIST_HEAD(uid_list);
+/*
+ * Entries are hashed by uid and looked up under RCU, so the TCP accounting
+ * path never takes a lock once a uid has been seen. Entries are never
+ * freed. Counters are per-cpu and only summed up when read through proc.
+ */
+#define UID_HASH_BITS	8
+
+static DEFINE_MUTEX(uid_lock);
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
 static struct proc_dir_entry *parent;
 
+static int enabled = 1;
+module_param(enabled, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(enabled, "Account TCP traffic per uid");
+
+struct uid_stat_cpu {
+	unsigned long tcp_rcv;
+	unsigned long tcp_snd;
+};
+
 struct uid_stat {
-	struct list_head link;
+	struct hlist_node link;
 	uid_t uid;
-	atomic_t tcp_rcv;
-	atomic_t tcp_snd;
+	struct uid_stat_cpu __percpu *stats;
 };
 
 static struct uid_stat *find_uid_stat(uid_t uid) {
-	unsigned long flags;
+	struct hlist_node *node;
 	struct uid_stat *entry;
 
-	spin_lock_irqsave(&uid_lock, flags);
-	list_for_each_entry(entry, &uid_list, link) {
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(entry, node,
+			&uid_hash[hash_32(uid, UID_HASH_BITS)], link) {
 		if (entry->uid == uid) {
-			spin_unlock_irqrestore(&uid_lock, flags);
+			rcu_read_unlock();
 			return entry;
 		}
 	}
-	spin_unlock_irqrestore(&uid_lock, flags);
+	rcu_read_unlock();
 	return NULL;
 }
 
-static int tcp_snd_read_proc(char *page, char **start, off_t off,
-				int count, int *eof, void *data)
+static int uid_stat_read_proc(char *page, char **start, off_t off,
+				int count, int *eof, unsigned long bytes)
 {
 	int len;
-	unsigned int bytes;
 	char *p = page;
-	struct uid_stat *uid_entry = (struct uid_stat *) data;
-	if (!data)
-		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_snd) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
+	/* Counters wrap, as userspace expects, at 4GB of network traffic. */
+	p += sprintf(p, "%u\n", (unsigned int) bytes);
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
 	*start = page + off;
 	return len;
 }
 
+static int tcp_snd_read_proc(char *page, char **start, off_t off,
+				int count, int *eof, void *data)
+{
+	unsigned long bytes = 0;
+	struct uid_stat *uid_entry = (struct uid_stat *) data;
+	int cpu;
+	if (!data)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		bytes += per_cpu_ptr(uid_entry->stats, cpu)->tcp_snd;
+	return uid_stat_read_proc(page, start, off, count, eof, bytes);
+}
+
 static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 				int count, int *eof, void *data)
 {
-	int len;
-	unsigned int bytes;
-	char *p = page;
+	unsigned long bytes = 0;
 	struct uid_stat *uid_entry = (struct uid_stat *) data;
+	int cpu;
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_rcv) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
-	len = (p - page) - off;
-	*eof = (len <= count) ? 1 : 0;
-	*start = page + off;
-	return len;
+	for_each_possible_cpu(cpu)
+		bytes += per_cpu_ptr(uid_entry->stats, cpu)->tcp_rcv;
+	return uid_stat_read_proc(page, start, off, count, eof, bytes);
 }
 
 /* Create a new entry for tracking the specified uid. */
 static struct uid_stat *create_stat(uid_t uid) {
-	unsigned long flags;
 	char uid_s[32];
 	struct uid_stat *new_uid;
 	struct proc_dir_entry *entry;
 
-	/* Create the uid stat struct and append it to the list. */
+	mutex_lock(&uid_lock);
+	/* Somebody may have been faster. */
+	new_uid = find_uid_stat(uid);
+	if (new_uid)
+		goto out;
+
+	/* Create the uid stat struct and add it to the hash. */
 	if ((new_uid = kmalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
-		return NULL;
+		goto out;
 
 	new_uid->uid = uid;
-	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
-	atomic_set(&new_uid->tcp_rcv, INT_MIN);
-	atomic_set(&new_uid->tcp_snd, INT_MIN);
-
-	spin_lock_irqsave(&uid_lock, flags);
-	list_add_tail(&new_uid->link, &uid_list);
-	spin_unlock_irqrestore(&uid_lock, flags);
+	new_uid->stats = alloc_percpu(struct uid_stat_cpu);
+	if (!new_uid->stats) {
+		kfree(new_uid);
+		new_uid = NULL;
+		goto out;
+	}
 
 	sprintf(uid_s, "%d", uid);
 	entry = proc_mkdir(uid_s, parent);
@@ -118,28 +147,36 @@ static struct uid_stat *create_stat(uid_t uid) {
 	create_proc_read_entry("tcp_rcv", S_IRUGO, entry, tcp_rcv_read_proc,
 		(void *) new_uid);
 
+	hlist_add_head_rcu(&new_uid->link,
+			   &uid_hash[hash_32(uid, UID_HASH_BITS)]);
+out:
+	mutex_unlock(&uid_lock);
 	return new_uid;
 }
 
 int uid_stat_tcp_snd(uid_t uid, int size) {
 	struct uid_stat *entry;
-	activity_stats_update();
+	activity_stats_update(uid);
+	if (!enabled)
+		return 0;
 	if ((entry = find_uid_stat(uid)) == NULL &&
 		((entry = create_stat(uid)) == NULL)) {
 			return -1;
 	}
-	atomic_add(size, &entry->tcp_snd);
+	this_cpu_add(entry->stats->tcp_snd, size);
 	return 0;
 }
 
 int uid_stat_tcp_rcv(uid_t uid, int size) {
 	struct uid_stat *entry;
-	activity_stats_update();
+	activity_stats_update(uid);
+	if (!enabled)
+		return 0;
 	if ((entry = find_uid_stat(uid)) == NULL &&
 		((entry = create_stat(uid)) == NULL)) {
 			return -1;
 	}
-	atomic_add(size, &entry->tcp_rcv);
+	this_cpu_add(entry->stats->tcp_rcv, size);
 	return 0;
 }
 
@@ -27,6 +27,8 @@
 #ifdef CONFIG_MTD_UBI_DEBUG
 
 #include "ubi.h"
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 
@@ -239,4 +241,176 @@ out:
 	return;
 }
 
+/* Root UBI "debugfs" directory entry */
+static struct dentry *dfs_rootdir;
+
+/**
+ * ubi_debugfs_init - create UBI debugfs directory.
+ *
+ * Create UBI debugfs directory. Returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+int ubi_debugfs_init(void)
+{
+	dfs_rootdir = debugfs_create_dir("ubi", NULL);
+	if (IS_ERR_OR_NULL(dfs_rootdir)) {
+		int err = dfs_rootdir ? PTR_ERR(dfs_rootdir) : -ENODEV;
+
+		ubi_err("cannot create \"ubi\" debugfs directory, error %d",
+			err);
+		return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ubi_debugfs_exit - remove UBI debugfs directory.
+ */
+void ubi_debugfs_exit(void)
+{
+	debugfs_remove(dfs_rootdir);
+}
+
+static int ubi_dfs_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+/**
+ * dfs_wl_stats_read - read the "wl_stats" debugfs file.
+ *
+ * The file shows the current length of the work queues, the erase batch size
+ * chosen by the tuner, and the &struct ubi_wl_stats counters.
+ */
+static ssize_t dfs_wl_stats_read(struct file *file, char __user *user_buf,
+				 size_t count, loff_t *ppos)
+{
+	struct ubi_device *ubi = file->private_data;
+	struct ubi_wl_stats *st;
+	int erase_works, works, free_count, batch, i, lat = 1;
+	const int size = 2048;
+	ssize_t ret;
+	char *buf;
+	int len;
+
+	st = kmalloc(sizeof(struct ubi_wl_stats), GFP_KERNEL);
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!st || !buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	erase_works = ubi->erase_works_count;
+	works = ubi->works_count;
+	free_count = ubi->free_count;
+	batch = ubi->erase_batch;
+	spin_unlock(&ubi->wl_lock);
+	ubi_wl_read_stats(ubi, st);
+
+	len = snprintf(buf, size,
+		       "free PEBs:            %d\n"
+		       "erase works:          %d (max %d)\n"
+		       "move works:           %d (max %d)\n"
+		       "erase batch:          %d\n"
+		       "erases:               %llu\n"
+		       "urgent erases:        %llu\n"
+		       "writer stalls:        %llu\n"
+		       "wear-leveling moves:  %llu\n"
+		       "scrubbing moves:      %llu\n"
+		       "moves/second:         %u\n"
+		       "avg. erase time (us): %llu\n"
+		       "erase time histogram (us):\n",
+		       free_count, erase_works, st->max_erase_works,
+		       works - erase_works, st->max_move_works, batch,
+		       st->erases, st->urgent_erases, st->stalls, st->moves,
+		       st->scrubs, st->moves_per_sec,
+		       st->erases ? div64_u64(st->erase_us, st->erases) : 0);
+
+	len += snprintf(buf + len, size - len, "\t<%-8d %lu\n", 1,
+			st->erase_hist[0]);
+	for (i = 1; i < UBI_ERASE_HIST_BUCKETS - 1; i++, lat <<= 1)
+		len += snprintf(buf + len, size - len, "\t%d-%d\t%lu\n",
+				lat, (lat << 1) - 1, st->erase_hist[i]);
+	len += snprintf(buf + len, size - len, "\t>=%-7d %lu\n", lat,
+			st->erase_hist[i]);
+
+	ret = simple_read_from_buffer(user_buf, count, ppos, buf, len);
+out:
+	kfree(buf);
+	kfree(st);
+	return ret;
+}
+
+static const struct file_operations dfs_wl_stats_fops = {
+	.read   = dfs_wl_stats_read,
+	.open   = ubi_dfs_open,
+	.llseek = default_llseek,
+	.owner  = THIS_MODULE,
+};
+
+/**
+ * ubi_debugfs_init_dev - initialize debugfs for an UBI device.
+ * @ubi: UBI device description object
+ *
+ * This function creates all debugfs files for UBI device @ubi. Returns zero in
+ * case of success and a negative error code in case of failure.
+ */
+int ubi_debugfs_init_dev(struct ubi_device *ubi)
+{
+	int err;
+	const char *fname;
+	struct dentry *dent;
+
+	if (!dfs_rootdir)
+		return 0;
+
+	fname = ubi->ubi_name;
+	dent = debugfs_create_dir(fname, dfs_rootdir);
+	if (IS_ERR_OR_NULL(dent))
+		goto out;
+	ubi->dfs_dir = dent;
+
+	fname = "wl_stats";
+	dent = debugfs_create_file(fname, S_IRUSR, ubi->dfs_dir, ubi,
+				   &dfs_wl_stats_fops);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
+	fname = "free_low";
+	dent = debugfs_create_u32(fname, S_IRUSR | S_IWUSR, ubi->dfs_dir,
+				  &ubi->free_low);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
+	fname = "erase_batch_max";
+	dent = debugfs_create_u32(fname, S_IRUSR | S_IWUSR, ubi->dfs_dir,
+				  &ubi->erase_batch_max);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
+	return 0;
+
+out_remove:
+	debugfs_remove_recursive(ubi->dfs_dir);
+	ubi->dfs_dir = NULL;
+out:
+	err = dent ? PTR_ERR(dent) : -ENODEV;
+	ubi_err("cannot create \"%s\" debugfs file or directory, error %d",
+		fname, err);
+	return err;
+}
+
+/**
+ * ubi_debugfs_exit_dev - free all debugfs files corresponding to device @ubi
+ * @ubi: UBI device description object
+ */
+void ubi_debugfs_exit_dev(struct ubi_device *ubi)
+{
+	debugfs_remove_recursive(ubi->dfs_dir);
+	ubi->dfs_dir = NULL;
+}
+
 #endif /* CONFIG_MTD_UBI_DEBUG */
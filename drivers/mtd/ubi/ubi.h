@@ -83,6 +83,13 @@
  */
 #define UBI_PROT_QUEUE_LEN 10
 
+/*
+ * Number of buckets in the erase latency histogram. Bucket %N accounts erase
+ * operations which took from 2^(N-1) to 2^N - 1 microseconds, and the last
+ * bucket accounts all the slower ones.
+ */
+#define UBI_ERASE_HIST_BUCKETS 20
+
 /*
  * Error codes returned by the I/O sub-system.
  *
@@ -197,6 +204,38 @@ struct ubi_rename_entry {
 
 struct ubi_volume_desc;
 
+/**
+ * struct ubi_wl_stats - wear-leveling sub-system statistics.
+ * @erases: count of erased physical eraseblocks
+ * @urgent_erases: count of erasures done synchronously for a waiting writer
+ * @erase_us: total time spent erasing physical eraseblocks, in microseconds
+ * @erase_hist: erase latency histogram (see %UBI_ERASE_HIST_BUCKETS)
+ * @moves: count of wear-leveling data moves
+ * @scrubs: count of scrubbing data moves
+ * @stalls: how many times a writer had to wait for a free PEB
+ * @max_erase_works: maximum observed length of the erase queue
+ * @max_move_works: maximum observed length of the move queue
+ * @rate_stamp: time (in jiffies) when @moves_per_sec was last calculated
+ * @rate_moves: value of @moves + @scrubs at @rate_stamp
+ * @moves_per_sec: data moves per second over the last measurement period
+ *
+ * All the fields are protected by @ubi->wl_lock.
+ */
+struct ubi_wl_stats {
+	unsigned long long erases;
+	unsigned long long urgent_erases;
+	unsigned long long erase_us;
+	unsigned long erase_hist[UBI_ERASE_HIST_BUCKETS];
+	unsigned long long moves;
+	unsigned long long scrubs;
+	unsigned long long stalls;
+	int max_erase_works;
+	int max_move_works;
+	unsigned long rate_stamp;
+	unsigned long long rate_moves;
+	unsigned int moves_per_sec;
+};
+
 /**
  * struct ubi_volume - UBI volume description data structure.
  * @dev: device object to make use of the the Linux device model
@@ -343,8 +382,10 @@ struct ubi_wl_entry;
  *      protected from the wear-leveling worker)
  * @pq_head: protection queue head
  * @wl_lock: protects the @used, @free, @pq, @pq_head, @lookuptbl, @move_from,
- *	     @move_to, @move_to_put @erase_pending, @wl_scheduled, @works,
- *	     @erroneous, and @erroneous_peb_count fields
+ *	     @move_to, @move_to_put @erase_pending, @wl_scheduled,
+ *	     @erase_works, @move_works, @erase_works_count, @works_count,
+ *	     @free_count, @erase_run, @erase_batch, @wl_stats, @erroneous, and
+ *	     @erroneous_peb_count fields
  * @move_mutex: serializes eraseblock moves
  * @work_sem: synchronizes the WL worker with use tasks
  * @wl_scheduled: non-zero if the wear-leveling was scheduled
@@ -353,8 +394,16 @@ struct ubi_wl_entry;
  * @move_from: physical eraseblock from where the data is being moved
  * @move_to: physical eraseblock where the data is being moved to
  * @move_to_put: if the "to" PEB was put
- * @works: list of pending works
- * @works_count: count of pending works
+ * @erase_works: list of pending erase works
+ * @move_works: list of pending wear-leveling and scrubbing works
+ * @erase_works_count: count of pending erase works
+ * @works_count: count of all pending works
+ * @free_count: count of physical eraseblocks in the @free tree
+ * @free_low: free PEB count below which wear-leveling moves are postponed
+ * @erase_run: count of erase works done since the last move work
+ * @erase_batch: how many erase works are done before a move work is allowed
+ * @erase_batch_max: upper limit for @erase_batch
+ * @wl_stats: wear-leveling statistics
  * @bgt_thread: background thread description object
  * @thread_enabled: if the background thread is enabled
  * @bgt_name: background thread name
@@ -392,6 +441,8 @@ struct ubi_wl_entry;
  * @peb_buf2: another buffer of PEB size used for different purposes
  * @buf_mutex: protects @peb_buf1 and @peb_buf2
  * @ckvol_mutex: serializes static volume checking when opening
+ *
+ * @dfs_dir: debugfs directory of this UBI device
  */
 struct ubi_device {
 	struct cdev cdev;
@@ -440,8 +491,16 @@ struct ubi_device {
 	struct ubi_wl_entry *move_from;
 	struct ubi_wl_entry *move_to;
 	int move_to_put;
-	struct list_head works;
+	struct list_head erase_works;
+	struct list_head move_works;
+	int erase_works_count;
 	int works_count;
+	int free_count;
+	unsigned int free_low;
+	unsigned int erase_run;
+	unsigned int erase_batch;
+	unsigned int erase_batch_max;
+	struct ubi_wl_stats wl_stats;
 	struct task_struct *bgt_thread;
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
@@ -474,6 +533,8 @@ struct ubi_device {
 	void *peb_buf2;
 	struct mutex buf_mutex;
 	struct mutex ckvol_mutex;
+
+	struct dentry *dfs_dir;
 };
 
 extern struct kmem_cache *ubi_wl_entry_slab;
@@ -537,6 +598,7 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype);
 int ubi_wl_put_peb(struct ubi_device *ubi, int pnum, int torture);
 int ubi_wl_flush(struct ubi_device *ubi);
 int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
+void ubi_wl_read_stats(struct ubi_device *ubi, struct ubi_wl_stats *stats);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
@@ -49,6 +49,15 @@
  * If the WL sub-system fails to erase a physical eraseblock, it marks it as
  * bad.
  *
+ * Pending works are kept in two queues: erase works, which produce free
+ * physical eraseblocks, and wear-leveling/scrubbing works, which consume
+ * them. Erase works have priority, and a writer which has no free physical
+ * eraseblock to use only runs erase works synchronously. Wear-leveling works
+ * are let through after a batch of @ubi->erase_batch erasures, or whenever
+ * the erase queue is empty. The batch size is tuned at run-time: it grows when
+ * writers have to wait for free eraseblocks and decays when the background
+ * thread goes idle.
+ *
  * This sub-system is also responsible for scrubbing. If a bit-flip is detected
  * in a physical eraseblock, it has to be moved. Technically this is the same
  * as moving it for wear-leveling reasons.
@@ -109,6 +118,7 @@
 #include <linux/crc32.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include "ubi.h"
 
 /* Number of physical eraseblocks reserved for wear-leveling purposes */
@@ -141,10 +151,26 @@
  */
 #define WL_MAX_FAILURES 32
 
+/*
+ * Default free physical eraseblocks watermark. If there are less free PEBs
+ * than this, wear-leveling works are postponed until the erase queue is empty.
+ */
+#define WL_FREE_LOW 4
+
+/* Default upper limit of the erase batch size */
+#define WL_ERASE_BATCH_MAX 64
+
+/* Work types (see &struct ubi_work) */
+enum {
+	UBI_WORK_ERASE,
+	UBI_WORK_MOVE,
+};
+
 /**
  * struct ubi_work - UBI work description data structure.
  * @list: a link in the list of pending works
  * @func: worker function
+ * @type: %UBI_WORK_ERASE or %UBI_WORK_MOVE
  * @e: physical eraseblock to erase
  * @torture: if the physical eraseblock has to be tortured
  *
@@ -156,6 +182,7 @@
 struct ubi_work {
 	struct list_head list;
 	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
+	int type;
 	/* The below fields are only relevant to erasure works */
 	struct ubi_wl_entry *e;
 	int torture;
@@ -208,14 +235,74 @@ static void wl_tree_add(struct ubi_wl_entry *e, struct rb_root *root)
 	rb_insert_color(&e->u.rb, root);
 }
 
+/**
+ * tune_erase_batch - adjust the erase batch size.
+ * @ubi: UBI device description object
+ * @stall: non-zero if a writer had to wait for a free PEB
+ *
+ * Writers waiting for free physical eraseblocks mean that erasures do not keep
+ * up, so the batch size is doubled to give them more priority over
+ * wear-leveling works. Otherwise the batch size decays by one. Note,
+ * @ubi->wl_lock has to be locked.
+ */
+static void tune_erase_batch(struct ubi_device *ubi, int stall)
+{
+	if (stall)
+		ubi->erase_batch = min(ubi->erase_batch * 2,
+				       ubi->erase_batch_max);
+	else if (ubi->erase_batch > 1)
+		ubi->erase_batch -= 1;
+	if (ubi->erase_batch < 1)
+		ubi->erase_batch = 1;
+}
+
+/**
+ * pick_work - pick the next pending work.
+ * @ubi: UBI device description object
+ * @urgent: non-zero if a writer is waiting for a free PEB
+ *
+ * This function removes the work to be done next from the queues and returns
+ * it, or returns %NULL if there are no pending works. Erase works are picked
+ * first, unless @ubi->erase_batch of them were done in a row and there are
+ * enough free PEBs. In @urgent mode wear-leveling works are only picked if
+ * there are no erase works at all. Note, @ubi->wl_lock has to be locked.
+ */
+static struct ubi_work *pick_work(struct ubi_device *ubi, int urgent)
+{
+	struct ubi_work *wrk;
+	int erase = !list_empty(&ubi->erase_works);
+
+	if (erase && !list_empty(&ubi->move_works) && !urgent &&
+	    ubi->erase_run >= ubi->erase_batch &&
+	    ubi->free_count >= ubi->free_low)
+		erase = 0;
+
+	if (erase) {
+		wrk = list_entry(ubi->erase_works.next, struct ubi_work, list);
+		ubi->erase_works_count -= 1;
+		ubi->erase_run += 1;
+		ubi_assert(ubi->erase_works_count >= 0);
+	} else if (!list_empty(&ubi->move_works)) {
+		wrk = list_entry(ubi->move_works.next, struct ubi_work, list);
+		ubi->erase_run = 0;
+	} else
+		return NULL;
+
+	list_del(&wrk->list);
+	ubi->works_count -= 1;
+	ubi_assert(ubi->works_count >= 0);
+	return wrk;
+}
+
 /**
  * do_work - do one pending work.
  * @ubi: UBI device description object
+ * @urgent: non-zero if a writer is waiting for a free PEB
  *
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  */
-static int do_work(struct ubi_device *ubi)
+static int do_work(struct ubi_device *ubi, int urgent)
 {
 	int err;
 	struct ubi_work *wrk;
@@ -230,16 +317,14 @@ static int do_work(struct ubi_device *ubi)
 	 */
 	down_read(&ubi->work_sem);
 	spin_lock(&ubi->wl_lock);
-	if (list_empty(&ubi->works)) {
+	wrk = pick_work(ubi, urgent);
+	if (!wrk) {
 		spin_unlock(&ubi->wl_lock);
 		up_read(&ubi->work_sem);
 		return 0;
 	}
-
-	wrk = list_entry(ubi->works.next, struct ubi_work, list);
-	list_del(&wrk->list);
-	ubi->works_count -= 1;
-	ubi_assert(ubi->works_count >= 0);
+	if (urgent && wrk->type == UBI_WORK_ERASE)
+		ubi->wl_stats.urgent_erases += 1;
 	spin_unlock(&ubi->wl_lock);
 
 	/*
@@ -261,19 +346,21 @@ static int do_work(struct ubi_device *ubi)
  *
  * This function tries to make a free PEB by means of synchronous execution of
  * pending works. This may be needed if, for example the background thread is
- * disabled. Returns zero in case of success and a negative error code in case
- * of failure.
+ * disabled or does not keep up. Returns zero in case of success and a negative
+ * error code in case of failure.
  */
 static int produce_free_peb(struct ubi_device *ubi)
 {
 	int err;
 
 	spin_lock(&ubi->wl_lock);
+	ubi->wl_stats.stalls += 1;
+	tune_erase_batch(ubi, 1);
 	while (!ubi->free.rb_node) {
 		spin_unlock(&ubi->wl_lock);
 
 		dbg_wl("do one work synchronously");
-		err = do_work(ubi);
+		err = do_work(ubi, 1);
 		if (err)
 			return err;
 
@@ -396,7 +483,8 @@ retry:
 	spin_lock(&ubi->wl_lock);
 	if (!ubi->free.rb_node) {
 		if (ubi->works_count == 0) {
-			ubi_assert(list_empty(&ubi->works));
+			ubi_assert(list_empty(&ubi->erase_works));
+			ubi_assert(list_empty(&ubi->move_works));
 			ubi_err("no free eraseblocks");
 			spin_unlock(&ubi->wl_lock);
 			return -ENOSPC;
@@ -456,6 +544,7 @@ retry:
 	 * be protected from being moved for some time.
 	 */
 	rb_erase(&e->u.rb, &ubi->free);
+	ubi->free_count -= 1;
 	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
 	prot_queue_add(ubi, e);
 	spin_unlock(&ubi->wl_lock);
@@ -604,15 +693,27 @@ repeat:
  * @ubi: UBI device description object
  * @wrk: the work to schedule
  *
- * This function adds a work defined by @wrk to the tail of the pending works
- * list.
+ * This function adds a work defined by @wrk to the tail of the pending erase
+ * or move works list, depending on @wrk->type.
  */
 static void schedule_ubi_work(struct ubi_device *ubi, struct ubi_work *wrk)
 {
+	struct ubi_wl_stats *stats = &ubi->wl_stats;
+	int moves;
+
 	spin_lock(&ubi->wl_lock);
-	list_add_tail(&wrk->list, &ubi->works);
+	if (wrk->type == UBI_WORK_ERASE) {
+		list_add_tail(&wrk->list, &ubi->erase_works);
+		ubi->erase_works_count += 1;
+		if (ubi->erase_works_count > stats->max_erase_works)
+			stats->max_erase_works = ubi->erase_works_count;
+	} else
+		list_add_tail(&wrk->list, &ubi->move_works);
 	ubi_assert(ubi->works_count >= 0);
 	ubi->works_count += 1;
+	moves = ubi->works_count - ubi->erase_works_count;
+	if (moves > stats->max_move_works)
+		stats->max_move_works = moves;
 	if (ubi->thread_enabled && !ubi_dbg_is_bgt_disabled())
 		wake_up_process(ubi->bgt_thread);
 	spin_unlock(&ubi->wl_lock);
@@ -643,6 +744,7 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 		return -ENOMEM;
 
 	wl_wrk->func = &erase_worker;
+	wl_wrk->type = UBI_WORK_ERASE;
 	wl_wrk->e = e;
 	wl_wrk->torture = torture;
 
@@ -650,6 +752,51 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	return 0;
 }
 
+/**
+ * update_move_rate - re-calculate the data moves per second rate.
+ * @ubi: UBI device description object
+ *
+ * The rate is re-calculated at most once per second. Note, @ubi->wl_lock has
+ * to be locked.
+ */
+static void update_move_rate(struct ubi_device *ubi)
+{
+	struct ubi_wl_stats *stats = &ubi->wl_stats;
+	unsigned long long moves = stats->moves + stats->scrubs;
+	unsigned long delta = jiffies - stats->rate_stamp;
+
+	if (delta < HZ)
+		return;
+
+	stats->moves_per_sec = div_u64((moves - stats->rate_moves) * HZ, delta);
+	stats->rate_moves = moves;
+	stats->rate_stamp = jiffies;
+}
+
+/**
+ * account_erase - account an erase operation in the statistics.
+ * @ubi: UBI device description object
+ * @start: time when the erase operation was started
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static void account_erase(struct ubi_device *ubi, ktime_t start)
+{
+	struct ubi_wl_stats *stats = &ubi->wl_stats;
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket;
+
+	if (us < 0)
+		us = 0;
+	bucket = fls64(us);
+	if (bucket >= UBI_ERASE_HIST_BUCKETS)
+		bucket = UBI_ERASE_HIST_BUCKETS - 1;
+
+	stats->erases += 1;
+	stats->erase_us += us;
+	stats->erase_hist[bucket] += 1;
+}
+
 /**
  * wear_leveling_worker - wear-leveling worker function.
  * @ubi: UBI device description object
@@ -728,6 +875,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 
 	paranoid_check_in_wl_tree(e2, &ubi->free);
 	rb_erase(&e2->u.rb, &ubi->free);
+	ubi->free_count -= 1;
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -836,6 +984,11 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi_free_vid_hdr(ubi, vid_hdr);
 
 	spin_lock(&ubi->wl_lock);
+	if (scrubbing)
+		ubi->wl_stats.scrubs += 1;
+	else
+		ubi->wl_stats.moves += 1;
+	update_move_rate(ubi);
 	if (!ubi->move_to_put) {
 		wl_tree_add(e2, &ubi->used);
 		e2 = NULL;
@@ -990,6 +1143,7 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	}
 
 	wrk->func = &wear_leveling_worker;
+	wrk->type = UBI_WORK_MOVE;
 	schedule_ubi_work(ubi, wrk);
 	return err;
 
@@ -1017,6 +1171,7 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 {
 	struct ubi_wl_entry *e = wl_wrk->e;
 	int pnum = e->pnum, err, need;
+	ktime_t start;
 
 	if (cancel) {
 		dbg_wl("cancel erasure of PEB %d EC %d", pnum, e->ec);
@@ -1027,13 +1182,16 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 	dbg_wl("erase PEB %d EC %d", pnum, e->ec);
 
+	start = ktime_get();
 	err = sync_erase(ubi, e, wl_wrk->torture);
 	if (!err) {
 		/* Fine, we've erased it successfully */
 		kfree(wl_wrk);
 
 		spin_lock(&ubi->wl_lock);
+		account_erase(ubi, start);
 		wl_tree_add(e, &ubi->free);
+		ubi->free_count += 1;
 		spin_unlock(&ubi->wl_lock);
 
 		/*
@@ -1287,7 +1445,7 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	 */
 	dbg_wl("flush (%d pending works)", ubi->works_count);
 	while (ubi->works_count) {
-		err = do_work(ubi);
+		err = do_work(ubi, 0);
 		if (err)
 			return err;
 	}
@@ -1305,7 +1463,7 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	 */
 	while (ubi->works_count) {
 		dbg_wl("flush more (%d pending works)", ubi->works_count);
-		err = do_work(ubi);
+		err = do_work(ubi, 0);
 		if (err)
 			return err;
 	}
@@ -1313,6 +1471,19 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	return 0;
 }
 
+/**
+ * ubi_wl_read_stats - get a snapshot of the wear-leveling statistics.
+ * @ubi: UBI device description object
+ * @stats: where to store the statistics
+ */
+void ubi_wl_read_stats(struct ubi_device *ubi, struct ubi_wl_stats *stats)
+{
+	spin_lock(&ubi->wl_lock);
+	update_move_rate(ubi);
+	*stats = ubi->wl_stats;
+	spin_unlock(&ubi->wl_lock);
+}
+
 /**
  * tree_destroy - destroy an RB-tree.
  * @root: the root of the tree to destroy
@@ -1367,8 +1538,10 @@ int ubi_thread(void *u)
 			continue;
 
 		spin_lock(&ubi->wl_lock);
-		if (list_empty(&ubi->works) || ubi->ro_mode ||
+		if (!ubi->works_count || ubi->ro_mode ||
 		    !ubi->thread_enabled || ubi_dbg_is_bgt_disabled()) {
+			/* Nothing to do - let the erase batch size decay */
+			tune_erase_batch(ubi, 0);
 			set_current_state(TASK_INTERRUPTIBLE);
 			spin_unlock(&ubi->wl_lock);
 			schedule();
@@ -1376,7 +1549,7 @@ int ubi_thread(void *u)
 		}
 		spin_unlock(&ubi->wl_lock);
 
-		err = do_work(ubi);
+		err = do_work(ubi, 0);
 		if (err) {
 			ubi_err("%s: work failed with error code %d",
 				ubi->bgt_name, err);
@@ -1407,15 +1580,10 @@ int ubi_thread(void *u)
  */
 static void cancel_pending(struct ubi_device *ubi)
 {
-	while (!list_empty(&ubi->works)) {
-		struct ubi_work *wrk;
+	struct ubi_work *wrk;
 
-		wrk = list_entry(ubi->works.next, struct ubi_work, list);
-		list_del(&wrk->list);
+	while ((wrk = pick_work(ubi, 0)))
 		wrk->func(ubi, wrk, 1);
-		ubi->works_count -= 1;
-		ubi_assert(ubi->works_count >= 0);
-	}
 }
 
 /**
@@ -1439,7 +1607,12 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	mutex_init(&ubi->move_mutex);
 	init_rwsem(&ubi->work_sem);
 	ubi->max_ec = si->max_ec;
-	INIT_LIST_HEAD(&ubi->works);
+	INIT_LIST_HEAD(&ubi->erase_works);
+	INIT_LIST_HEAD(&ubi->move_works);
+	ubi->free_low = WL_FREE_LOW;
+	ubi->erase_batch = 1;
+	ubi->erase_batch_max = WL_ERASE_BATCH_MAX;
+	ubi->wl_stats.rate_stamp = jiffies;
 
 	sprintf(ubi->bgt_name, UBI_BGT_NAME_PATTERN, ubi->ubi_num);
 
@@ -1479,6 +1652,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		e->ec = seb->ec;
 		ubi_assert(e->ec >= 0);
 		wl_tree_add(e, &ubi->free);
+		ubi->free_count += 1;
 		ubi->lookuptbl[e->pnum] = e;
 	}
 
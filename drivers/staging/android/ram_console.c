@@ -26,6 +26,12 @@
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 #include <linux/rslib.h>
 #endif
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED
+#include <linux/notifier.h>
+#include <linux/reboot.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#endif
 
 struct ram_console_buffer {
 	uint32_t    sig;
@@ -55,6 +61,15 @@ static int ram_console_bad_blocks;
 #define ECC_SYMSIZE CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_SYMBOL_SIZE
 #define ECC_POLY CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_POLYNOMIAL
 #endif
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED
+/* Parity of the block being written to is brought up to date this late */
+#define ECC_FLUSH_DELAY (HZ / 20)
+static DEFINE_SPINLOCK(ram_console_ecc_lock);
+static struct timer_list ram_console_ecc_timer;
+/* Block aligned range of the data buffer whose parity is out of date */
+static size_t ram_console_dirty_start;
+static size_t ram_console_dirty_end;
+#endif
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 static void ram_console_encode_rs8(uint8_t *data, size_t len, uint8_t *ecc)
@@ -77,29 +92,152 @@ static int ram_console_decode_rs8(void *data, size_t len, uint8_t *ecc)
 	return decode_rs8(ram_console_rs_decoder, data, par, len,
 				NULL, 0, NULL, 0, NULL);
 }
+
+/*
+ * Re-encode the parity of all blocks overlapping the [start, end) range of
+ * the data buffer.
+ */
+static void ram_console_encode_range(size_t start, size_t end)
+{
+	size_t block = start & ~(ECC_BLOCK_SIZE - 1);
+	uint8_t *par = ram_console_par_buffer +
+		       (block / ECC_BLOCK_SIZE) * ECC_SIZE;
+
+	while (block < end) {
+		size_t size = min_t(size_t, ECC_BLOCK_SIZE,
+				    ram_console_buffer_size - block);
+
+		ram_console_encode_rs8(ram_console_buffer->data + block, size,
+				       par);
+		block += ECC_BLOCK_SIZE;
+		par += ECC_SIZE;
+	}
+}
+
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED
+static void __ram_console_flush_ecc(void)
+{
+	if (ram_console_dirty_start < ram_console_dirty_end)
+		ram_console_encode_range(ram_console_dirty_start,
+					 ram_console_dirty_end);
+	ram_console_dirty_start = ram_console_dirty_end = 0;
+}
+
+static void ram_console_flush_ecc(unsigned long unused)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ram_console_ecc_lock, flags);
+	__ram_console_flush_ecc();
+	spin_unlock_irqrestore(&ram_console_ecc_lock, flags);
+}
+
+/*
+ * Mark the [start, end) range of the data buffer as modified. Blocks which
+ * the writer has moved past will not change until the buffer wraps, so
+ * they are encoded right away, exactly once. The block containing the
+ * write position is encoded from a timer, or earlier if the writer leaves
+ * it, or on panic and reboot.
+ */
+static void ram_console_update_ecc(size_t start, size_t end)
+{
+	unsigned long flags;
+	size_t done = end & ~(ECC_BLOCK_SIZE - 1);
+
+	spin_lock_irqsave(&ram_console_ecc_lock, flags);
+	if (ram_console_dirty_start >= ram_console_dirty_end ||
+	    start < ram_console_dirty_start) {
+		/* Nothing pending, or the writer has wrapped */
+		__ram_console_flush_ecc();
+		ram_console_dirty_start = start & ~(ECC_BLOCK_SIZE - 1);
+	}
+	ram_console_dirty_end = max(ram_console_dirty_end, end);
+
+	if (done > ram_console_dirty_start) {
+		ram_console_encode_range(ram_console_dirty_start, done);
+		ram_console_dirty_start = done;
+	}
+	if (ram_console_dirty_start < ram_console_dirty_end &&
+	    !timer_pending(&ram_console_ecc_timer))
+		mod_timer(&ram_console_ecc_timer, jiffies + ECC_FLUSH_DELAY);
+	spin_unlock_irqrestore(&ram_console_ecc_lock, flags);
+}
+
+static int ram_console_panic_notify(struct notifier_block *nb,
+				    unsigned long event, void *unused)
+{
+	/* Other CPUs are stopped, do not risk waiting for the lock */
+	__ram_console_flush_ecc();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ram_console_panic_nb = {
+	.notifier_call = ram_console_panic_notify,
+};
+
+static int ram_console_reboot_notify(struct notifier_block *nb,
+				     unsigned long event, void *unused)
+{
+	ram_console_flush_ecc(0);
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ram_console_reboot_nb = {
+	.notifier_call = ram_console_reboot_notify,
+};
+#else
+/*
+ * Update the parity of the blocks overlapping the [start, start + count)
+ * range, which is about to be overwritten with @s. Only the difference to
+ * the old contents and the data following it in the block are encoded.
+ * Returns non-zero if the RS codec does not support incremental updates.
+ */
+static int ram_console_update_ecc(size_t start, const char *s, size_t count)
+{
+	size_t end = start + count;
+	uint16_t par[ECC_SIZE];
+	int i, ret;
+
+	while (start < end) {
+		size_t block = start & ~(ECC_BLOCK_SIZE - 1);
+		size_t size = min_t(size_t, ECC_BLOCK_SIZE,
+				    ram_console_buffer_size - block);
+		size_t len = min(end, block + size) - start;
+		uint8_t *ecc = ram_console_par_buffer +
+			       (block / ECC_BLOCK_SIZE) * ECC_SIZE;
+
+		for (i = 0; i < ECC_SIZE; i++)
+			par[i] = ecc[i];
+		ret = encode_rs8_update(ram_console_rs_decoder,
+					ram_console_buffer->data + start, s,
+					len, block + size - start - len, par);
+		if (ret)
+			return ret;
+		for (i = 0; i < ECC_SIZE; i++)
+			ecc[i] = par[i];
+
+		start += len;
+		s += len;
+	}
+	return 0;
+}
+#endif
 #endif
 
 static void ram_console_update(const char *s, unsigned int count)
 {
 	struct ram_console_buffer *buffer = ram_console_buffer;
-#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
-	uint8_t *buffer_end = buffer->data + ram_console_buffer_size;
-	uint8_t *block;
-	uint8_t *par;
-	int size = ECC_BLOCK_SIZE;
+#if defined(CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION) && \
+	!defined(CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED)
+	if (ram_console_update_ecc(buffer->start, s, count)) {
+		memcpy(buffer->data + buffer->start, s, count);
+		ram_console_encode_range(buffer->start, buffer->start + count);
+		return;
+	}
 #endif
 	memcpy(buffer->data + buffer->start, s, count);
-#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
-	block = buffer->data + (buffer->start & ~(ECC_BLOCK_SIZE - 1));
-	par = ram_console_par_buffer +
-	      (buffer->start / ECC_BLOCK_SIZE) * ECC_SIZE;
-	do {
-		if (block + ECC_BLOCK_SIZE > buffer_end)
-			size = buffer_end - block;
-		ram_console_encode_rs8(block, size, par);
-		block += ECC_BLOCK_SIZE;
-		par += ECC_SIZE;
-	} while (block < buffer->data + buffer->start + count);
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED
+	ram_console_update_ecc(buffer->start, buffer->start + count);
 #endif
 }
 
@@ -319,6 +457,22 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	buffer->start = 0;
 	buffer->size = 0;
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
+	/*
+	 * The old log is saved. Zeroed data has zero parity, so starting from
+	 * a zeroed buffer keeps the parity consistent for incremental updates.
+	 */
+	memset(buffer->data, 0, ram_console_buffer_size);
+	memset(ram_console_par_buffer, 0,
+	       DIV_ROUND_UP(ram_console_buffer_size, ECC_BLOCK_SIZE) * ECC_SIZE);
+#endif
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_DEFERRED
+	setup_timer(&ram_console_ecc_timer, ram_console_flush_ecc, 0);
+	atomic_notifier_chain_register(&panic_notifier_list,
+				       &ram_console_panic_nb);
+	register_reboot_notifier(&ram_console_reboot_nb);
+#endif
+
 	register_console(&ram_console);
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ENABLE_VERBOSE
 	console_verbose();
@@ -854,6 +854,11 @@ static int exec_mmap(struct mm_struct *mm)
 	}
 	task_unlock(tsk);
 	arch_pick_mmap_layout(mm);
+	/*
+	 * Only now that it is in use: an exec failing before this frees the
+	 * mm with mmdrop(), which does not take it off the list.
+	 */
+	lru_gen_add_mm(mm);
 	if (old_mm) {
 		up_read(&old_mm->mmap_sem);
 		BUG_ON(active_mm != old_mm);
@@ -731,6 +731,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 			__writeback_inodes_sb(work->sb, wb, &wbc);
 		else
 			writeback_inodes_wb(wb, &wbc);
+		bdi_update_bandwidth(wb->bdi, wbc.wb_start);
 		trace_wbc_writeback_written(&wbc, wb->bdi);
 
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
@@ -27,6 +27,7 @@
 #include <linux/writeback.h>
 #include <linux/backing-dev.h>
 #include <linux/pagevec.h>
+#include <linux/swap.h>
 #include <linux/cleancache.h>
 
 /*
@@ -377,19 +378,18 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 
 	map_bh.b_state = 0;
 	map_bh.b_size = 0;
+	nr_pages = add_to_page_cache_list(mapping, pages, GFP_KERNEL);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_entry(pages->prev, struct page, lru);
 
 		prefetchw(&page->flags);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			bio = do_mpage_readpage(bio, page,
-					nr_pages - page_idx,
-					&last_block_in_bio, &map_bh,
-					&first_logical_block,
-					get_block);
-		}
+		lru_cache_add_page_cache(page);
+		bio = do_mpage_readpage(bio, page,
+				nr_pages - page_idx,
+				&last_block_in_bio, &map_bh,
+				&first_logical_block,
+				get_block);
 		page_cache_release(page);
 	}
 	BUG_ON(!list_empty(pages));
@@ -443,6 +443,28 @@ static inline int pmd_write(pmd_t pmd)
 #endif /* __HAVE_ARCH_PMD_WRITE */
 #endif
 
+/*
+ * Like pmd_none_or_clear_bad(), for page table walkers that run without
+ * mmap_sem (unmap_mapping_range() via truncate): a huge pmd may be
+ * established under them by ->pmd_fault. It is not bad, and must be left
+ * to the caller to handle under page_table_lock.
+ */
+static inline int pmd_none_or_trans_huge_or_clear_bad(pmd_t *pmd)
+{
+	pmd_t pmdval = *pmd;
+
+	/* the huge pmd check must see the same value as pmd_none() */
+	barrier();
+	if (pmd_none(pmdval))
+		return 1;
+	if (unlikely(pmd_bad(pmdval))) {
+		if (!pmd_trans_huge(pmdval))
+			pmd_clear_bad(pmd);
+		return 1;
+	}
+	return 0;
+}
+
 #endif /* !__ASSEMBLY__ */
 
 #endif /* _ASM_GENERIC_PGTABLE_H */
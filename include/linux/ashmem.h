@@ -27,6 +27,11 @@
 #define ASHMEM_IS_UNPINNED	0
 #define ASHMEM_IS_PINNED	1
 
+/* Values for ASHMEM_SET_HUGE: map the region with huge pages? */
+#define ASHMEM_HUGE_DEFAULT	0	/* as shmem_enabled in sysfs says */
+#define ASHMEM_HUGE_ALWAYS	1
+#define ASHMEM_HUGE_NEVER	2
+
 struct ashmem_pin {
 	__u32 offset;	/* offset into region, in bytes, page-aligned */
 	__u32 len;	/* length forward from offset, in bytes, page-aligned */
@@ -44,5 +49,7 @@ struct ashmem_pin {
 #define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
 #define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
 #define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+#define ASHMEM_SET_HUGE		_IOW(__ASHMEMIOC, 11, unsigned int)
+#define ASHMEM_GET_HUGE		_IO(__ASHMEMIOC, 12)
 
 #endif	/* _LINUX_ASHMEM_H */
@@ -27,6 +27,9 @@ struct scsi_ioctl_command;
 struct request_queue;
 struct elevator_queue;
 struct request_pm_state;
+struct blk_mq_ops;
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
 struct blk_trace;
 struct request;
 struct sg_io_hdr;
@@ -81,6 +84,7 @@ struct request {
 	struct call_single_data csd;
 
 	struct request_queue *q;
+	struct blk_mq_ctx *mq_ctx;
 
 	unsigned int cmd_flags;
 	enum rq_cmd_type_bits cmd_type;
@@ -126,6 +130,10 @@ struct request {
 #ifdef CONFIG_BLK_CGROUP
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_DEV_THROTTLING
+	/* blkio group charged with the latency, in latency target mode */
+	struct throtl_grp *throtl_grp;
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -295,6 +303,18 @@ struct request_queue
 	 */
 	struct delayed_work	delay_work;
 
+	/*
+	 * Multi-queue: per-cpu software queues, mapped by mq_map onto
+	 * the hardware queues. Only set up by blk_mq_init_queue().
+	 */
+	struct blk_mq_ops	*mq_ops;
+	struct blk_mq_ctx __percpu	*queue_ctx;
+	unsigned int		nr_queues;
+	unsigned int		*mq_map;
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
+	struct list_head	all_q_node;
+
 	struct backing_dev_info	backing_dev_info;
 
 	/*
@@ -409,6 +429,9 @@ struct request_queue
 				 (1 << QUEUE_FLAG_SAME_COMP)	|	\
 				 (1 << QUEUE_FLAG_ADD_RANDOM))
 
+#define QUEUE_FLAG_MQ_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
+				 (1 << QUEUE_FLAG_SAME_COMP))
+
 static inline int queue_is_locked(struct request_queue *q)
 {
 #ifdef CONFIG_SMP
@@ -1133,6 +1156,8 @@ static inline void put_dev_sector(Sector p)
 
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
+int kblockd_schedule_delayed_work(struct request_queue *q,
+				  struct delayed_work *dwork, unsigned long delay);
 
 #ifdef CONFIG_BLK_CGROUP
 /*
@@ -1180,12 +1205,19 @@ static inline uint64_t rq_io_start_time_ns(struct request *req)
 extern int blk_throtl_init(struct request_queue *q);
 extern void blk_throtl_exit(struct request_queue *q);
 extern int blk_throtl_bio(struct request_queue *q, struct bio **bio);
+extern void blk_throtl_get_rq_group(struct request *rq);
+extern void blk_throtl_put_rq_group(struct request *rq);
+extern void blk_throtl_rq_completed(struct request *rq);
 #else /* CONFIG_BLK_DEV_THROTTLING */
 static inline int blk_throtl_bio(struct request_queue *q, struct bio **bio)
 {
 	return 0;
 }
 
+static inline void blk_throtl_get_rq_group(struct request *rq) { }
+static inline void blk_throtl_put_rq_group(struct request *rq) { }
+static inline void blk_throtl_rq_completed(struct request *rq) { }
+
 static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline int blk_throtl_exit(struct request_queue *q) { return 0; }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
@@ -18,12 +18,14 @@ extern struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 					  unsigned int flags);
 extern int zap_huge_pmd(struct mmu_gather *tlb,
 			struct vm_area_struct *vma,
-			pmd_t *pmd);
+			pmd_t *pmd, unsigned long addr);
 extern int mincore_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 			unsigned long addr, unsigned long end,
 			unsigned char *vec);
 extern int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 			unsigned long addr, pgprot_t newprot);
+extern int map_file_huge_pmd(struct vm_area_struct *vma, unsigned long haddr,
+			     pmd_t *pmd, struct page *page);
 
 enum transparent_hugepage_flag {
 	TRANSPARENT_HUGEPAGE_FLAG,
@@ -108,12 +110,25 @@ extern void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 				    unsigned long start,
 				    unsigned long end,
 				    long adjust_next);
+extern void split_file_huge_pmd(struct page *page, struct vm_area_struct *vma,
+				unsigned long address);
+extern void split_file_huge_pmds(struct vm_area_struct *vma);
+/*
+ * Huge pmds in vmas with ->pmd_fault map blocks of page cache: ordinary,
+ * physically contiguous pages rather than a compound page. The pages are
+ * referenced and mapcounted one by one, so splitting such a pmd only has
+ * to replace it with a page table.
+ */
+static inline int vma_has_file_huge_pmd(struct vm_area_struct *vma)
+{
+	return vma->vm_ops && vma->vm_ops->pmd_fault;
+}
 static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 					 unsigned long start,
 					 unsigned long end,
 					 long adjust_next)
 {
-	if (!vma->anon_vma || vma->vm_ops)
+	if (vma->vm_ops ? !vma_has_file_huge_pmd(vma) : !vma->anon_vma)
 		return;
 	__vma_adjust_trans_huge(vma, start, end, adjust_next);
 }
@@ -165,6 +180,18 @@ static inline int hugepage_madvise(struct vm_area_struct *vma,
 	BUG();
 	return 0;
 }
+static inline int vma_has_file_huge_pmd(struct vm_area_struct *vma)
+{
+	return 0;
+}
+static inline void split_file_huge_pmd(struct page *page,
+				       struct vm_area_struct *vma,
+				       unsigned long address)
+{
+}
+static inline void split_file_huge_pmds(struct vm_area_struct *vma)
+{
+}
 static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
 					 unsigned long start,
 					 unsigned long end,
@@ -154,6 +154,11 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						unsigned long *total_scanned);
 u64 mem_cgroup_get_limit(struct mem_cgroup *mem);
 
+void mem_cgroup_vmpressure(gfp_t gfp_mask, struct mem_cgroup *mem,
+			   unsigned long scanned, unsigned long reclaimed);
+void mem_cgroup_vmpressure_prio(gfp_t gfp_mask, struct mem_cgroup *mem,
+				int priority);
+
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 void mem_cgroup_split_huge_fixup(struct page *head, struct page *tail);
@@ -363,6 +368,19 @@ u64 mem_cgroup_get_limit(struct mem_cgroup *mem)
 	return 0;
 }
 
+static inline void mem_cgroup_vmpressure(gfp_t gfp_mask,
+					 struct mem_cgroup *mem,
+					 unsigned long scanned,
+					 unsigned long reclaimed)
+{
+}
+
+static inline void mem_cgroup_vmpressure_prio(gfp_t gfp_mask,
+					      struct mem_cgroup *mem,
+					      int priority)
+{
+}
+
 static inline void mem_cgroup_split_huge_fixup(struct page *head,
 						struct page *tail)
 {
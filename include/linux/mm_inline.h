@@ -30,15 +30,143 @@ __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 	mem_cgroup_add_lru_list(page, l);
 }
 
+#ifdef CONFIG_LRU_GEN
+extern bool lru_gen_on;
+
+static inline bool lru_gen_enabled(void)
+{
+	return lru_gen_on;
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Generation of a page on the multi-generation LRU, or -1 */
+static inline int page_lru_gen(struct page *page)
+{
+	return (int)((ACCESS_ONCE(page->flags) & LRU_GEN_MASK) >>
+		     LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * Page table aging updates the generation without zone->lru_lock, so it
+ * is always replaced atomically. -1 takes the page off the generations.
+ */
+static inline void set_page_lru_gen(struct page *page, int gen)
+{
+	unsigned long old, new;
+
+	do {
+		old = ACCESS_ONCE(page->flags);
+		new = (old & ~LRU_GEN_MASK) |
+		      ((unsigned long)(gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+
+/*
+ * Active pages join the youngest generation and inactive ones the oldest,
+ * where the heads of the active and inactive lists would have put them.
+ * The age is in the generation from then on, so PG_active is cleared and
+ * the page counted as inactive: activating it again promotes it again.
+ */
+static inline bool
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list l)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file = is_file_lru(l);
+	unsigned long seq;
+	int gen;
+
+	if (!lru_gen_enabled() || is_unevictable_lru(l))
+		return false;
+
+	if (is_active_lru(l)) {
+		seq = lrugen->max_seq[file];
+		ClearPageActive(page);
+		l -= LRU_ACTIVE;
+	} else
+		seq = lrugen->min_seq[file];
+
+	gen = lru_gen_from_seq(seq);
+	set_page_lru_gen(page, gen);
+	__add_page_to_lru_list(zone, page, l, &lrugen->lists[gen][file]);
+	return true;
+}
+
+static inline void lru_gen_del_page(struct page *page)
+{
+	if (lru_gen_enabled())
+		set_page_lru_gen(page, -1);
+}
+
+/*
+ * Move an inactive page to the oldest generation, at the end that reclaim
+ * takes from first if @tail.
+ */
+static inline bool
+lru_gen_rotate_page(struct zone *zone, struct page *page, bool tail)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int file = page_is_file_cache(page);
+	int gen;
+
+	if (!lru_gen_enabled())
+		return false;
+
+	gen = lru_gen_from_seq(lrugen->min_seq[file]);
+	set_page_lru_gen(page, gen);
+	if (tail)
+		list_move_tail(&page->lru, &lrugen->lists[gen][file]);
+	else
+		list_move(&page->lru, &lrugen->lists[gen][file]);
+	return true;
+}
+#else
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline int page_lru_gen(struct page *page)
+{
+	return -1;
+}
+
+static inline void set_page_lru_gen(struct page *page, int gen)
+{
+}
+
+static inline bool
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list l)
+{
+	return false;
+}
+
+static inline void lru_gen_del_page(struct page *page)
+{
+}
+
+static inline bool
+lru_gen_rotate_page(struct zone *zone, struct page *page, bool tail)
+{
+	return false;
+}
+#endif /* CONFIG_LRU_GEN */
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	if (lru_gen_add_page(zone, page, l))
+		return;
 	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list);
 }
 
 static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	lru_gen_del_page(page);
 	list_del(&page->lru);
 	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
 	mem_cgroup_del_lru_list(page, l);
@@ -64,6 +192,7 @@ del_page_from_lru(struct zone *zone, struct page *page)
 {
 	enum lru_list l;
 
+	lru_gen_del_page(page);
 	list_del(&page->lru);
 	if (PageUnevictable(page)) {
 		__ClearPageUnevictable(page);
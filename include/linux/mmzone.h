@@ -169,15 +169,33 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp-lists cache order-0 pages and, to keep small high-order
+ * allocations (stacks, slabs, skbs) off zone->lock, orders up to
+ * PAGE_ALLOC_COSTLY_ORDER. There is one list per migrate type and order.
+ */
+#define NR_PCP_ORDERS	(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS	(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, indexed by pcp_list_index(migratetype, order) */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
+static inline int pcp_list_index(int migratetype, unsigned int order)
+{
+	return order * MIGRATE_PCPTYPES + migratetype;
+}
+
+static inline unsigned int pcp_list_order(int index)
+{
+	return index / MIGRATE_PCPTYPES;
+}
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
 #ifdef CONFIG_NUMA
@@ -275,6 +293,29 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generation LRU keeps the evictable pages of a zone on one list
+ * per generation and type (anon in [0], file in [1]) instead of the active
+ * and inactive lists. Generations are numbered by sequence numbers, which
+ * only grow: aging starts a new youngest generation and promotes the pages
+ * it finds young in page tables to it, eviction reclaims the oldest one.
+ * The generation of a page is kept in page->flags and its list is only
+ * corrected when eviction gets to it.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+struct lru_gen {
+	/* youngest and oldest generation of each type */
+	unsigned long		max_seq[2];
+	unsigned long		min_seq[2];
+	/* when each generation was started, in jiffies */
+	unsigned long		timestamps[MAX_NR_GENS][2];
+	struct list_head	lists[MAX_NR_GENS][2];
+};
+#endif
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -345,6 +386,9 @@ struct zone {
 	} lru[NR_LRU_LISTS];
 
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen		lrugen;
+#endif
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
@@ -636,6 +680,10 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -773,6 +821,8 @@ int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int percpu_pagelist_order_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
 int sysctl_min_slab_ratio_sysctl_handler(struct ctl_table *, int,
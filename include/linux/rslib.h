@@ -37,6 +37,9 @@
  * @gffunc:	Function to generate the field, if non-canonical representation
  * @users:	Users of this structure
  * @list:	List entry for the rs control list
+ * @enc_tab:	Encoder feedback table for the 8-bit data width fast path,
+ *		NULL if the code parameters do not allow it
+ * @enc_stride:	Length of an @enc_tab row in bytes
 */
 struct rs_control {
 	int 		mm;
@@ -52,12 +55,22 @@ struct rs_control {
 	int		(*gffunc)(int);
 	int		users;
 	struct list_head list;
+	uint8_t		*enc_tab;
+	int		enc_stride;
 };
 
+/*
+ * Maximum number of roots for which the table driven 8-bit encoder is used.
+ * The encoder table takes (nn + 1) * nroots bytes.
+ */
+#define RS_ENC_TAB_MAX_ROOTS	32
+
 /* General purpose RS codec, 8-bit data width, symbol width 1-15 bit  */
 #ifdef CONFIG_REED_SOLOMON_ENC8
 int encode_rs8(struct rs_control *rs, uint8_t *data, int len, uint16_t *par,
 	       uint16_t invmsk);
+int encode_rs8_update(struct rs_control *rs, const uint8_t *old,
+		      const uint8_t *new, int len, int tail, uint16_t *par);
 #endif
 #ifdef CONFIG_REED_SOLOMON_DEC8
 int decode_rs8(struct rs_control *rs, uint8_t *data, uint16_t *par, int len,
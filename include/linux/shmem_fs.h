@@ -39,8 +39,20 @@ struct shmem_sb_info {
 	gid_t gid;		    /* Mount gid for root directory */
 	mode_t mode;		    /* Mount mode for root directory */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
+	int huge;		    /* SHMEM_HUGE_* for huge pmd mappings */
 };
 
+/*
+ * Huge pmd mappings of tmpfs: per mount (huge= option, and
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled for the internal
+ * mount behind shared anonymous memory, SysV shm and ashmem), and per
+ * file through shmem_set_huge().
+ */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1	/* every shared mapping that fits */
+#define SHMEM_HUGE_ADVISE	2	/* only with madvise(MADV_HUGEPAGE) */
+#define SHMEM_HUGE_DEFAULT	3	/* per file: follow the mount */
+
 static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
 {
 	return container_of(inode, struct shmem_inode_info, vfs_inode);
@@ -61,6 +73,11 @@ extern void shmem_truncate_range(struct inode *inode, loff_t start, loff_t end);
 extern int shmem_unuse(swp_entry_t entry, struct page *page);
 extern void mem_cgroup_get_shmem_target(struct inode *inode, pgoff_t pgoff,
 					struct page **pagep, swp_entry_t *ent);
+extern int shmem_set_huge(struct file *file, int huge);
+extern bool vma_is_shmem(struct vm_area_struct *vma);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+extern struct kobj_attribute shmem_enabled_attr;
+#endif
 
 static inline struct page *shmem_read_mapping_page(
 				struct address_space *mapping, pgoff_t index)
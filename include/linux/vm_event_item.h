@@ -23,6 +23,7 @@
 
 enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGALLOC),
+		PGALLOC_PCP_HIGHORDER, PGALLOC_PCP_HIGHORDER_REFILL,
 		PGFREE, PGACTIVATE, PGDEACTIVATE,
 		PGFAULT, PGMAJFAULT,
 		FOR_ALL_ZONES(PGREFILL),
@@ -39,6 +40,8 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTDIRECTPAGES,
+		KCOMPACTD_WAKE, COMPACTPROACTIVE, COMPACTPROACTIVEPAGES,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -57,6 +60,28 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+		THP_FILE_ALLOC,
+		THP_FILE_FALLBACK,
+		THP_FILE_MAPPED,
+		THP_FILE_SPLIT,
+#endif
+#ifdef CONFIG_SWAP
+		SWAP_SLOTS_CACHE_HIT,
+		SWAP_SLOTS_CACHE_REFILL,
+		SWAP_FREE_BATCHED,
+		SWAP_LOCK_ACQUIRED,
+#ifdef CONFIG_LOCK_STAT
+		SWAP_LOCK_HELD_US,
+#endif
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_FAULT,		/* handled without mmap_sem */
+		SPF_ABORT,		/* redone under mmap_sem */
+#endif
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING,		/* new generations started */
+		LRU_GEN_WALK_SKIP,	/* mms skipped, mmap_sem contended */
+		LRU_GEN_PROMOTED,	/* pages found young in page tables */
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -16,10 +16,16 @@
 #ifndef __activity_stats_h
 #define __activity_stats_h
 
+#include <linux/types.h>
+
+struct net_device;
+
 #ifdef CONFIG_NET_ACTIVITY_STATS
-void activity_stats_update(void);
+void activity_stats_update(uid_t uid);
+void activity_stats_dev_xmit(struct net_device *dev);
 #else
-#define activity_stats_update(void) {}
+static inline void activity_stats_update(uid_t uid) {}
+static inline void activity_stats_dev_xmit(struct net_device *dev) {}
 #endif
 
 #endif /* _NET_ACTIVITY_STATS_H */
@@ -0,0 +1,79 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM launch_ra
+
+#if !defined(_TRACE_LAUNCH_RA_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LAUNCH_RA_H
+
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/tracepoint.h>
+
+/*
+ * A file range accessed by the recorded task. hit is set when the range
+ * lies inside a range issued by the preceding replay.
+ */
+TRACE_EVENT(launch_ra_record,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t start,
+		unsigned long nr, int hit),
+
+	TP_ARGS(mapping, start, nr, hit),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(ino_t, ino)
+		__field(pgoff_t, start)
+		__field(unsigned long, nr)
+		__field(int, hit)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->start = start;
+		__entry->nr = nr;
+		__entry->hit = hit;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu start=%lu nr=%lu %s",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		(unsigned long)__entry->ino,
+		(unsigned long)__entry->start, __entry->nr,
+		__entry->hit ? "hit" : "miss")
+);
+
+/* A merged range submitted by replay, with the pages it actually read */
+TRACE_EVENT(launch_ra_replay,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t start,
+		unsigned long nr, int submitted),
+
+	TP_ARGS(mapping, start, nr, submitted),
+
+	TP_STRUCT__entry(
+		__field(dev_t, dev)
+		__field(ino_t, ino)
+		__field(pgoff_t, start)
+		__field(unsigned long, nr)
+		__field(int, submitted)
+	),
+
+	TP_fast_assign(
+		__entry->dev = mapping->host->i_sb->s_dev;
+		__entry->ino = mapping->host->i_ino;
+		__entry->start = start;
+		__entry->nr = nr;
+		__entry->submitted = submitted;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu start=%lu nr=%lu submitted=%d",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		(unsigned long)__entry->ino,
+		(unsigned long)__entry->start, __entry->nr,
+		__entry->submitted)
+);
+
+#endif /* _TRACE_LAUNCH_RA_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
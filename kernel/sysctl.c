@@ -100,6 +100,7 @@ extern int min_free_order_shift;
 extern int pid_max_min, pid_max_max;
 extern int sysctl_drop_caches;
 extern int percpu_pagelist_fraction;
+extern int percpu_pagelist_order;
 extern int compat_log;
 extern int latencytop_enabled;
 extern int sysctl_nr_open_min, sysctl_nr_open_max;
@@ -133,6 +134,7 @@ static unsigned long dirty_bytes_min = 2 * PAGE_SIZE;
 static int maxolduid = 65535;
 static int minolduid;
 static int min_percpu_pagelist_fract = 8;
+static int max_percpu_pagelist_order = PAGE_ALLOC_COSTLY_ORDER;
 
 static int ngroups_max = NGROUPS_MAX;
 
@@ -1179,6 +1181,31 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "compaction_proactive_target",
+		.data		= &sysctl_compaction_proactive_target,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &max_extfrag_threshold,
+	},
+	{
+		.procname	= "compaction_proactive_orders",
+		.data		= &sysctl_compaction_proactive_orders,
+		.maxlen		= MAX_ORDER,
+		.mode		= 0644,
+		.proc_handler	= proc_do_large_bitmap,
+	},
+	{
+		.procname	= "compaction_cpu_budget",
+		.data		= &sysctl_compaction_cpu_budget,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &one_hundred,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
@@ -1204,6 +1231,15 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= percpu_pagelist_fraction_sysctl_handler,
 		.extra1		= &min_percpu_pagelist_fract,
 	},
+	{
+		.procname	= "percpu_pagelist_order",
+		.data		= &percpu_pagelist_order,
+		.maxlen		= sizeof(percpu_pagelist_order),
+		.mode		= 0644,
+		.proc_handler	= percpu_pagelist_order_sysctl_handler,
+		.extra1		= &zero,
+		.extra2		= &max_percpu_pagelist_order,
+	},
 #ifdef CONFIG_MMU
 	{
 		.procname	= "max_map_count",
@@ -36,6 +36,13 @@
  * Many hw encoders provide a syndrome calculation over the received
  * data + syndrome and can call the second stage directly.
  *
+ * For symbol sizes up to 8 bits a table with the generator polynomial
+ * multiples for every possible feedback value is built as well. The 8-bit
+ * encoder then updates the whole parity register with word sized shifts and
+ * xors instead of doing a log/antilog lookup per root and data symbol. The
+ * encoding is linear, which allows to update the parity of modified data
+ * incrementally (see encode_rs8_update()).
+ *
  */
 
 #include <linux/errno.h>
@@ -45,12 +52,74 @@
 #include <linux/rslib.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
+#include <linux/string.h>
+#include <asm/byteorder.h>
 
 /* This list holds all currently allocated rs control structures */
 static LIST_HEAD (rslist);
 /* Protection for the list */
 static DEFINE_MUTEX(rslistlock);
 
+#ifdef CONFIG_REED_SOLOMON_ENC8
+/**
+ * rs_init_enc_tab - Build the table for the 8-bit encoder fast path
+ * @rs:		the rs control structure
+ *
+ * Row @fb of the table holds the value which is xored on the shifted
+ * parity register when the feedback symbol is @fb. Rows are padded to a
+ * multiple of the machine word size, the padding is zero. If the table
+ * can not be allocated the generic encoder is used.
+ */
+static void rs_init_enc_tab(struct rs_control *rs)
+{
+	int fb, j, nroots = rs->nroots;
+	uint8_t *row;
+
+	rs->enc_stride = ALIGN(nroots, sizeof(unsigned long));
+	rs->enc_tab = kzalloc(rs->enc_stride * (rs->nn + 1), GFP_KERNEL);
+	if (rs->enc_tab == NULL)
+		return;
+
+	for (fb = 1; fb <= rs->nn; fb++) {
+		row = rs->enc_tab + fb * rs->enc_stride;
+		for (j = 0; j < nroots; j++)
+			row[j] = rs->alpha_to[rs_modnn(rs, rs->index_of[fb] +
+					rs->genpoly[nroots - 1 - j])];
+	}
+}
+
+/*
+ * Shift a parity register word by one symbol towards the register start,
+ * pulling in the first symbol of the next word.
+ */
+static inline unsigned long rs_shift_word(unsigned long w, unsigned long next)
+{
+#ifdef __LITTLE_ENDIAN
+	return (w >> 8) | (next << (BITS_PER_LONG - 8));
+#else
+	return (w << 8) | (next >> (BITS_PER_LONG - 8));
+#endif
+}
+
+/**
+ * rs_tab_step - Feed one symbol into the parity register
+ * @rs:		the rs control structure
+ * @reg:	parity register, @rs->enc_stride bytes
+ * @sym:	data symbol, already xored with the first parity symbol
+ */
+static inline void rs_tab_step(struct rs_control *rs, unsigned long *reg,
+			       uint8_t sym)
+{
+	const unsigned long *row;
+	int j, words = rs->enc_stride / sizeof(unsigned long);
+
+	row = (const unsigned long *)(rs->enc_tab + sym * rs->enc_stride);
+	for (j = 0; j < words - 1; j++)
+		reg[j] = rs_shift_word(reg[j], reg[j + 1]) ^ row[j];
+	reg[j] = rs_shift_word(reg[j], 0) ^ row[j];
+}
+#endif
+
 /**
  * rs_init - Initialize a Reed-Solomon codec
  * @symsize:	symbol size, bits (1-8)
@@ -148,6 +217,12 @@ static struct rs_control *rs_init(int symsize, int gfpoly, int (*gffunc)(int),
 	/* convert rs->genpoly[] to index form for quicker encoding */
 	for (i = 0; i <= nroots; i++)
 		rs->genpoly[i] = rs->index_of[rs->genpoly[i]];
+
+	rs->enc_tab = NULL;
+#ifdef CONFIG_REED_SOLOMON_ENC8
+	if (symsize <= 8 && nroots > 0 && nroots <= RS_ENC_TAB_MAX_ROOTS)
+		rs_init_enc_tab(rs);
+#endif
 	return rs;
 
 	/* Error exit */
@@ -174,6 +249,7 @@ void free_rs(struct rs_control *rs)
 	rs->users--;
 	if(!rs->users) {
 		list_del(&rs->list);
+		kfree(rs->enc_tab);
 		kfree(rs->alpha_to);
 		kfree(rs->index_of);
 		kfree(rs->genpoly);
@@ -283,6 +359,81 @@ struct rs_control *init_rs_non_canonical(int symsize, int (*gffunc)(int),
 }
 
 #ifdef CONFIG_REED_SOLOMON_ENC8
+/**
+ * encode_rs8_tab - Table driven variant of encode_rs8()
+ *
+ * Same as encode_rs8(), used when @rs->enc_tab is available.
+ */
+static int encode_rs8_tab(struct rs_control *rs, const uint8_t *data, int len,
+			  uint16_t *par, uint16_t invmsk)
+{
+	unsigned long reg[RS_ENC_TAB_MAX_ROOTS / sizeof(unsigned long)];
+	uint8_t *p = (uint8_t *)reg;
+	uint8_t msk = rs->nn;
+	int i, pad;
+
+	pad = rs->nn - rs->nroots - len;
+	if (pad < 0 || pad >= rs->nn)
+		return -ERANGE;
+
+	memset(reg, 0, rs->enc_stride);
+	for (i = 0; i < rs->nroots; i++)
+		p[i] = par[i];
+
+	for (i = 0; i < len; i++)
+		rs_tab_step(rs, reg, ((data[i] ^ invmsk) & msk) ^ p[0]);
+
+	for (i = 0; i < rs->nroots; i++)
+		par[i] = p[i];
+	return 0;
+}
+
+/**
+ *  encode_rs8_update - Update the parity after a data range was modified
+ *  @rs:	the rs control structure
+ *  @old:	old contents of the modified range
+ *  @new:	new contents of the modified range
+ *  @len:	length of the modified range
+ *  @tail:	number of data symbols following the modified range
+ *  @par:	parity of the whole data field, updated in place
+ *
+ *  The RS code is linear, so the new parity is the old one xored with the
+ *  parity of the difference between the old and the new data. The data
+ *  preceding the modified range does not have to be looked at, and the
+ *  data following it is only accounted by @tail. This makes appending to a
+ *  block much cheaper than re-encoding all of it. The invert mask cancels
+ *  out in the difference, so it does not matter here.
+ *
+ *  Only available with the table driven encoder, returns -EINVAL if @rs does
+ *  not have it, so the caller can fall back to encode_rs8().
+ */
+int encode_rs8_update(struct rs_control *rs, const uint8_t *old,
+		      const uint8_t *new, int len, int tail, uint16_t *par)
+{
+	unsigned long reg[RS_ENC_TAB_MAX_ROOTS / sizeof(unsigned long)];
+	uint8_t *p = (uint8_t *)reg;
+	uint8_t msk = rs->nn;
+	int i, pad;
+
+	if (!rs->enc_tab)
+		return -EINVAL;
+
+	pad = rs->nn - rs->nroots - len - tail;
+	if (len < 0 || tail < 0 || pad < 0 || pad >= rs->nn)
+		return -ERANGE;
+
+	memset(reg, 0, rs->enc_stride);
+	for (i = 0; i < len; i++)
+		rs_tab_step(rs, reg, ((old[i] ^ new[i]) & msk) ^ p[0]);
+	for (i = 0; i < tail; i++)
+		rs_tab_step(rs, reg, p[0]);
+
+	for (i = 0; i < rs->nroots; i++)
+		par[i] ^= p[i];
+	return 0;
+}
+EXPORT_SYMBOL_GPL(encode_rs8_update);
+
 /**
  *  encode_rs8 - Calculate the parity for data values (8bit data width)
  *  @rs:	the rs control structure
@@ -298,6 +449,8 @@ struct rs_control *init_rs_non_canonical(int symsize, int (*gffunc)(int),
 int encode_rs8(struct rs_control *rs, uint8_t *data, int len, uint16_t *par,
 	       uint16_t invmsk)
 {
+	if (rs->enc_tab)
+		return encode_rs8_tab(rs, data, len, par, invmsk);
 #include "encode_rs.c"
 }
 EXPORT_SYMBOL_GPL(encode_rs8);
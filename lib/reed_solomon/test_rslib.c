@@ -0,0 +1,229 @@
+/*
+ * lib/reed_solomon/test_rslib.c
+ *
+ * Overview:
+ *   Tests and benchmarks for the Reed Solomon library 8-bit encoder
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Description:
+ *
+ * Checks the table driven encoder and encode_rs8_update() against the
+ * generic encoder and the decoder, then measures the throughput of
+ * console-like appends to a ring buffer without ECC, with the generic
+ * encoder re-encoding each touched block, with the table driven encoder
+ * doing the same, and with incremental parity updates. The code parameters
+ * match the Android RAM console defaults.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/rslib.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/hrtimer.h>
+
+#define RS_SYMSIZE	8
+#define RS_GFPOLY	0x11d
+#define RS_NROOTS	16
+#define BLOCK_SIZE	128
+#define BUF_SIZE	(64 * BLOCK_SIZE)
+#define LINE_SIZE	64
+#define BENCH_BYTES	(4 << 20)
+
+/* Reference generic encoder, regardless of the fast path */
+static int __init encode_rs8_ref(struct rs_control *rs, uint8_t *data,
+				 int len, uint16_t *par, uint16_t invmsk)
+{
+#include "encode_rs.c"
+}
+
+static struct rs_control *rs;
+static uint8_t *buf;
+static uint8_t *ecc;
+
+static void __init encode_block(uint8_t *data, int len, uint16_t *par, int ref)
+{
+	memset(par, 0, RS_NROOTS * sizeof(uint16_t));
+	if (ref)
+		encode_rs8_ref(rs, data, len, par, 0);
+	else
+		encode_rs8(rs, data, len, par, 0);
+}
+
+static int __init test_encode(void)
+{
+	uint16_t par[RS_NROOTS], ref[RS_NROOTS];
+	uint8_t saved[BLOCK_SIZE];
+	int i, len, off, err = 0;
+
+	get_random_bytes(buf, BUF_SIZE);
+	for (i = 0; i < BUF_SIZE / BLOCK_SIZE; i++) {
+		uint8_t *data = buf + i * BLOCK_SIZE;
+
+		/* Fast path against the generic encoder, odd lengths too */
+		len = BLOCK_SIZE - (i & 7);
+		encode_block(data, len, par, 0);
+		encode_block(data, len, ref, 1);
+		if (memcmp(par, ref, sizeof(par))) {
+			pr_err("test_rslib: block %d: parity mismatch\n", i);
+			err = -EINVAL;
+			continue;
+		}
+
+		/* Incremental update against a full re-encode */
+		off = random32() % len;
+		len -= off;
+		len = 1 + random32() % len;
+		memcpy(saved, data + off, len);
+		get_random_bytes(data + off, len);
+		if (encode_rs8_update(rs, saved, data + off, len,
+				      BLOCK_SIZE - (i & 7) - off - len, par)) {
+			pr_err("test_rslib: no incremental update support\n");
+			return -EINVAL;
+		}
+		encode_block(data, BLOCK_SIZE - (i & 7), ref, 1);
+		if (memcmp(par, ref, sizeof(par))) {
+			pr_err("test_rslib: block %d: update mismatch\n", i);
+			err = -EINVAL;
+			continue;
+		}
+
+		/* And the decoder has to be able to correct errors */
+		memcpy(saved, data, BLOCK_SIZE);
+		data[random32() % (BLOCK_SIZE - (i & 7))] ^= 0x5a;
+		if (decode_rs8(rs, data, par, BLOCK_SIZE - (i & 7), NULL, 0,
+			       NULL, 0, NULL) < 0 ||
+		    memcmp(saved, data, BLOCK_SIZE)) {
+			pr_err("test_rslib: block %d: not corrected\n", i);
+			err = -EINVAL;
+		}
+	}
+	return err;
+}
+
+enum {
+	BENCH_NO_ECC,
+	BENCH_GENERIC,
+	BENCH_TABLE,
+	BENCH_UPDATE,
+};
+
+static const char * const bench_names[] __initconst = {
+	"no ECC", "generic encoder", "table encoder", "incremental update",
+};
+
+static void __init bench_encode_range(int start, int end, int ref)
+{
+	uint16_t par[RS_NROOTS];
+	int block, i;
+
+	for (block = start & ~(BLOCK_SIZE - 1); block < end;
+	     block += BLOCK_SIZE) {
+		encode_block(buf + block, BLOCK_SIZE, par, ref);
+		for (i = 0; i < RS_NROOTS; i++)
+			ecc[block / BLOCK_SIZE * RS_NROOTS + i] = par[i];
+	}
+}
+
+static void __init bench_update(int start, const uint8_t *s, int count)
+{
+	uint16_t par[RS_NROOTS];
+	int end = start + count;
+	int i;
+
+	while (start < end) {
+		int block = start & ~(BLOCK_SIZE - 1);
+		int len = min(end, block + BLOCK_SIZE) - start;
+		uint8_t *e = ecc + block / BLOCK_SIZE * RS_NROOTS;
+
+		for (i = 0; i < RS_NROOTS; i++)
+			par[i] = e[i];
+		encode_rs8_update(rs, buf + start, s, len,
+				  block + BLOCK_SIZE - start - len, par);
+		for (i = 0; i < RS_NROOTS; i++)
+			e[i] = par[i];
+		memcpy(buf + start, s, len);
+		start += len;
+		s += len;
+	}
+}
+
+static void __init bench(int mode)
+{
+	uint8_t line[LINE_SIZE];
+	unsigned long long ns;
+	ktime_t t0;
+	int done, pos = 0;
+
+	memset(line, 'x', sizeof(line));
+	memset(buf, 0, BUF_SIZE);
+	memset(ecc, 0, BUF_SIZE / BLOCK_SIZE * RS_NROOTS);
+
+	t0 = ktime_get();
+	for (done = 0; done < BENCH_BYTES; done += LINE_SIZE) {
+		if (pos + LINE_SIZE > BUF_SIZE)
+			pos = 0;
+		switch (mode) {
+		case BENCH_NO_ECC:
+			memcpy(buf + pos, line, LINE_SIZE);
+			break;
+		case BENCH_GENERIC:
+		case BENCH_TABLE:
+			memcpy(buf + pos, line, LINE_SIZE);
+			bench_encode_range(pos, pos + LINE_SIZE,
+					   mode == BENCH_GENERIC);
+			break;
+		case BENCH_UPDATE:
+			bench_update(pos, line, LINE_SIZE);
+			break;
+		}
+		pos += LINE_SIZE;
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+	if (!ns)
+		ns = 1;
+
+	pr_info("test_rslib: %-20s %llu KiB/s\n", bench_names[mode],
+		div64_u64((unsigned long long)BENCH_BYTES * NSEC_PER_SEC,
+			  ns * 1024));
+}
+
+static int __init test_rslib_init(void)
+{
+	int err = -ENOMEM, mode;
+
+	rs = init_rs(RS_SYMSIZE, RS_GFPOLY, 0, 1, RS_NROOTS);
+	buf = kmalloc(BUF_SIZE, GFP_KERNEL);
+	ecc = kmalloc(BUF_SIZE / BLOCK_SIZE * RS_NROOTS, GFP_KERNEL);
+	if (!rs || !buf || !ecc)
+		goto out;
+
+	err = test_encode();
+	if (err)
+		goto out;
+	pr_info("test_rslib: encoder tests passed\n");
+
+	for (mode = BENCH_NO_ECC; mode <= BENCH_UPDATE; mode++)
+		bench(mode);
+
+out:
+	kfree(ecc);
+	kfree(buf);
+	if (rs)
+		free_rs(rs);
+	return err;
+}
+
+static void __exit test_rslib_exit(void)
+{
+}
+
+module_init(test_rslib_init);
+module_exit(test_rslib_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Reed Solomon library tests and benchmark");
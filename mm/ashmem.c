@@ -46,6 +46,7 @@ struct ashmem_area {
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
+	unsigned int huge;		/* ASHMEM_HUGE_* */
 };
 
 /*
@@ -280,6 +281,19 @@ calc_vm_may_flags(unsigned long prot)
 	       _calc_vm_trans(prot, PROT_EXEC,  VM_MAYEXEC);
 }
 
+/* ASHMEM_HUGE_* to the policy shmem_set_huge() takes */
+static int ashmem_shmem_huge(unsigned int huge)
+{
+	switch (huge) {
+	case ASHMEM_HUGE_ALWAYS:
+		return SHMEM_HUGE_ALWAYS;
+	case ASHMEM_HUGE_NEVER:
+		return SHMEM_HUGE_NEVER;
+	default:
+		return SHMEM_HUGE_DEFAULT;
+	}
+}
+
 static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct ashmem_area *asma = file->private_data;
@@ -315,6 +329,8 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 			goto out;
 		}
 		asma->file = vmfile;
+		if (asma->huge != ASHMEM_HUGE_DEFAULT)
+			shmem_set_huge(vmfile, ashmem_shmem_huge(asma->huge));
 	}
 	get_file(asma->file);
 
@@ -404,6 +420,22 @@ out:
 	return ret;
 }
 
+static int set_huge(struct ashmem_area *asma, unsigned long huge)
+{
+	int ret = 0;
+
+	if (huge > ASHMEM_HUGE_NEVER)
+		return -EINVAL;
+
+	mutex_lock(&ashmem_mutex);
+	asma->huge = huge;
+	/* only faults from now on see it, as for madvise() */
+	if (asma->file)
+		ret = shmem_set_huge(asma->file, ashmem_shmem_huge(huge));
+	mutex_unlock(&ashmem_mutex);
+	return ret;
+}
+
 static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	/*
@@ -660,6 +692,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case ASHMEM_GET_PROT_MASK:
 		ret = asma->prot_mask;
 		break;
+	case ASHMEM_SET_HUGE:
+		ret = set_huge(asma, arg);
+		break;
+	case ASHMEM_GET_HUGE:
+		ret = asma->huge;
+		break;
 	case ASHMEM_PIN:
 	case ASHMEM_UNPIN:
 	case ASHMEM_GET_PIN_STATUS:
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -42,6 +44,8 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+
+	bool proactive;			/* kcompactd, toward a frag target */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -464,6 +468,16 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* Proactive compaction: stop once the target is met */
+	if (cc->proactive) {
+		if (kthread_should_stop())
+			return COMPACT_PARTIAL;
+		if (unusable_free_index(zone, cc->order) <=
+		    sysctl_compaction_proactive_target)
+			return COMPACT_PARTIAL;
+		return COMPACT_CONTINUE;
+	}
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -542,11 +556,34 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	return COMPACT_CONTINUE;
 }
 
+/*
+ * proactive_suitable: Can kcompactd compact this zone for @order now?
+ * Unlike compaction_suitable(), it does not care whether an allocation
+ * of @order would succeed, only that there is room for migration.
+ */
+static unsigned long proactive_suitable(struct zone *zone, int order)
+{
+	unsigned long watermark;
+
+	watermark = low_wmark_pages(zone) + (2UL << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return COMPACT_SKIPPED;
+
+	if (unusable_free_index(zone, order) <=
+	    sysctl_compaction_proactive_target)
+		return COMPACT_PARTIAL;
+
+	return COMPACT_CONTINUE;
+}
+
 static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	if (cc->proactive)
+		ret = proactive_suitable(zone, cc->order);
+	else
+		ret = compaction_suitable(zone, cc->order);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -587,6 +624,12 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
+		if (cc->proactive)
+			count_vm_events(COMPACTPROACTIVEPAGES,
+					nr_migrate - nr_remaining);
+		else if (cc->order != -1)
+			count_vm_events(COMPACTDIRECTPAGES,
+					nr_migrate - nr_remaining);
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
@@ -672,9 +715,249 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	/* Somebody stalled: let kcompactd get ahead of the next one */
+	first_zones_zonelist(zonelist, high_zoneidx, nodemask, &zone);
+	if (zone)
+		wakeup_kcompactd(zone->zone_pgdat);
+
 	return rc;
 }
 
+/*
+ * Proactive compaction. A kcompactd thread per node keeps the unusable
+ * free space index (see /sys/kernel/debug/extfrag/unusable_index) of
+ * the configured orders at or below a target, so that high-order
+ * allocations from drivers find free blocks instead of stalling in
+ * direct compaction. The fragmentation index used by compaction_suitable()
+ * is no good for this: it only makes sense once allocations fail.
+ *
+ * kcompactd uses asynchronous migration and limits itself to a share of
+ * one CPU: after compacting for some time, it sleeps long enough to stay
+ * within sysctl_compaction_cpu_budget percent.
+ */
+
+/* 0: keep all free memory usable for the orders, 1000: disabled */
+int sysctl_compaction_proactive_target = 750;
+
+/* Orders kcompactd compacts for, default: 2-4 */
+unsigned long sysctl_compaction_proactive_orders[BITS_TO_LONGS(MAX_ORDER)] = {
+	[0] = (1UL << 2) | (1UL << 3) | (1UL << 4),
+};
+
+/* Percentage of one CPU kcompactd may use */
+int sysctl_compaction_cpu_budget = 5;
+
+/* How often kcompactd checks the target when idle */
+#define KCOMPACTD_INTERVAL		(HZ / 2)
+/* Back off up to 32 intervals when compaction makes no progress */
+#define KCOMPACTD_MAX_BACKOFF		5
+
+static bool kcompactd_order_needed(struct zone *zone, int order)
+{
+	return proactive_suitable(zone, order) == COMPACT_CONTINUE;
+}
+
+static bool kcompactd_node_needed(pg_data_t *pgdat)
+{
+	int zoneid, order;
+
+	if (sysctl_compaction_proactive_target >= 1000)
+		return false;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		for_each_set_bit(order, sysctl_compaction_proactive_orders,
+				 MAX_ORDER) {
+			if (order && kcompactd_order_needed(zone, order))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Compact every zone of the node toward the target for each configured
+ * order. Returns true if any order got closer to the target.
+ */
+static bool kcompactd_do_work(pg_data_t *pgdat)
+{
+	int zoneid, order;
+	bool progress = false;
+
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		/* Highest orders first, they also help the lower ones */
+		for (order = MAX_ORDER - 1; order > 0; order--) {
+			struct compact_control cc = {
+				.nr_freepages = 0,
+				.nr_migratepages = 0,
+				.order = order,
+				.migratetype = MIGRATE_MOVABLE,
+				.zone = zone,
+				.sync = false,
+				.proactive = true,
+			};
+			int before;
+
+			if (!test_bit(order, sysctl_compaction_proactive_orders))
+				continue;
+			if (kthread_should_stop())
+				return progress;
+			if (!kcompactd_order_needed(zone, order))
+				continue;
+
+			INIT_LIST_HEAD(&cc.freepages);
+			INIT_LIST_HEAD(&cc.migratepages);
+
+			count_vm_event(COMPACTPROACTIVE);
+			before = unusable_free_index(zone, order);
+			compact_zone(zone, &cc);
+			if (unusable_free_index(zone, order) < before)
+				progress = true;
+
+			VM_BUG_ON(!list_empty(&cc.freepages));
+			VM_BUG_ON(!list_empty(&cc.migratepages));
+		}
+	}
+
+	return progress;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned long timeout = KCOMPACTD_INTERVAL;
+	unsigned long throttle_until = jiffies;
+	unsigned int backoff = 0;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+	set_user_nice(tsk, 5);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		unsigned long now, throttle;
+		u64 runtime, budget;
+
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+					     kthread_should_stop(), timeout);
+		if (kthread_should_stop())
+			break;
+
+		/* Being woken up does not extend the CPU budget */
+		now = jiffies;
+		if (time_before(now, throttle_until)) {
+			timeout = throttle_until - now;
+			continue;
+		}
+
+		timeout = KCOMPACTD_INTERVAL;
+		if (!kcompactd_node_needed(pgdat)) {
+			backoff = 0;
+			continue;
+		}
+
+		/* Flush pending updates to the LRU lists */
+		lru_add_drain();
+
+		runtime = tsk->se.sum_exec_runtime;
+		if (kcompactd_do_work(pgdat))
+			backoff = 0;
+		else if (backoff < KCOMPACTD_MAX_BACKOFF)
+			backoff++;
+		runtime = tsk->se.sum_exec_runtime - runtime;
+
+		/*
+		 * Sleep long enough for the time spent compacting to be
+		 * sysctl_compaction_cpu_budget percent of the total.
+		 */
+		budget = sysctl_compaction_cpu_budget;
+		runtime *= 100 - budget;
+		do_div(runtime, budget);
+		now = jiffies;
+		throttle_until = now + nsecs_to_jiffies(runtime);
+		throttle = time_after(throttle_until, now) ?
+			   throttle_until - now : 0;
+		timeout = min_t(unsigned long, MAX_SCHEDULE_TIMEOUT,
+				max(timeout << backoff, throttle));
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - make kcompactd check its node now
+ * @pgdat: the node, may be NULL
+ *
+ * Called when an allocation had to compact directly.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat)
+{
+	if (!pgdat || !pgdat->kcompactd)
+		return;
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 
 /* Compact all zones within a node */
 static int compact_node(int nid)
@@ -509,6 +509,105 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/*
+ * Drop a page that add_to_page_cache_list() could not insert: it is
+ * charged and locked but holds no pagecache reference.
+ */
+static void add_to_page_cache_drop(struct page *page)
+{
+	list_del(&page->lru);
+	mem_cgroup_uncharge_cache_page(page);
+	__clear_page_locked(page);
+	page_cache_release(page);
+}
+
+/**
+ * add_to_page_cache_list - add a run of new pages to the pagecache
+ * @mapping:	the page's address_space
+ * @pages:	list of newly allocated pages, with ->index set
+ * @gfp_mask:	page allocation mode
+ *
+ * Does add_to_page_cache() for every page on @pages, in list order from
+ * the tail, but inserts them into the radix tree under a single hold of
+ * mapping->tree_lock. The lock is only dropped when the radix tree
+ * preload runs dry.
+ *
+ * Pages that cannot be added, e.g. because their index is already cached,
+ * are removed from @pages and released. The pages left on @pages are
+ * locked and in the pagecache; the caller still owns its reference to
+ * each of them, and puts them on the LRU with lru_cache_add_page_cache()
+ * once it has taken them off @pages, which shares page->lru with the LRU.
+ *
+ * Returns the number of pages left on @pages.
+ */
+int add_to_page_cache_list(struct address_space *mapping,
+			   struct list_head *pages, gfp_t gfp_mask)
+{
+	int swap_backed = mapping_cap_swap_backed(mapping);
+	struct page *page, *next;
+	int nr = 0;
+	int error;
+
+	/* Charging may sleep, do it before taking the tree lock */
+	list_for_each_entry_safe_reverse(page, next, pages, lru) {
+		if (swap_backed)
+			SetPageSwapBacked(page);
+		__set_page_locked(page);
+		if (mem_cgroup_cache_charge(page, current->mm,
+					    gfp_mask & GFP_RECLAIM_MASK)) {
+			list_del(&page->lru);
+			__clear_page_locked(page);
+			page_cache_release(page);
+		}
+	}
+
+	page = list_entry(pages->prev, struct page, lru);
+	while (&page->lru != pages) {
+		error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+		if (error)
+			break;
+
+		spin_lock_irq(&mapping->tree_lock);
+		while (&page->lru != pages) {
+			next = list_entry(page->lru.prev, struct page, lru);
+
+			page->mapping = mapping;
+			error = radix_tree_insert(&mapping->page_tree,
+						  page->index, page);
+			if (unlikely(error)) {
+				page->mapping = NULL;
+				/* Out of preloaded nodes, refill and retry */
+				if (error == -ENOMEM)
+					break;
+				spin_unlock_irq(&mapping->tree_lock);
+				add_to_page_cache_drop(page);
+				spin_lock_irq(&mapping->tree_lock);
+				page = next;
+				continue;
+			}
+			page_cache_get(page);
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			if (swap_backed)
+				__inc_zone_page_state(page, NR_SHMEM);
+			nr++;
+			page = next;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		radix_tree_preload_end();
+	}
+
+	/* Preloading failed: give up on the pages not inserted yet */
+	while (&page->lru != pages) {
+		next = list_entry(page->lru.prev, struct page, lru);
+		add_to_page_cache_drop(page);
+		page = next;
+	}
+
+	return nr;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_list);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -1085,6 +1184,8 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 	last_index = (*ppos + desc->count + PAGE_CACHE_SIZE-1) >> PAGE_CACHE_SHIFT;
 	offset = *ppos & ~PAGE_CACHE_MASK;
 
+	launch_ra_record(filp, index, last_index - index);
+
 	for (;;) {
 		struct page *page;
 		pgoff_t end_index;
@@ -1633,6 +1734,8 @@ int filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	if (offset >= size)
 		return VM_FAULT_SIGBUS;
 
+	launch_ra_record(file, offset, 1);
+
 	/*
 	 * Do we have something in the page cache already?
 	 */
@@ -17,6 +17,7 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/shmem_fs.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -314,6 +315,9 @@ static struct kobj_attribute debug_cow_attr =
 static struct attribute *hugepage_attr[] = {
 	&enabled_attr.attr,
 	&defrag_attr.attr,
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
+#endif
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
 #endif
@@ -717,6 +721,62 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/**
+ * map_file_huge_pmd - map a block of page cache with a huge pmd
+ * @vma:	the vma, with ->pmd_fault
+ * @haddr:	huge page aligned address of the block in @vma
+ * @pmd:	the pmd to populate
+ * @page:	first of HPAGE_PMD_NR physically contiguous, naturally aligned
+ *		pages holding consecutive indexes of the file
+ *
+ * The pages must be locked, uptodate and in the page cache, with a
+ * reference held on each. On success the references are taken over by
+ * the mapping; the pages stay locked either way.
+ *
+ * The pages are all dirtied up front, as for an anonymous huge page: the
+ * dirty bit of the pmd cannot say which of them were written to, and is
+ * not transferred when the pmd goes away.
+ *
+ * Returns 0 on success, -EAGAIN if @pmd was populated meanwhile and
+ * -ENOMEM if no page table could be preallocated for a later split.
+ */
+int map_file_huge_pmd(struct vm_area_struct *vma, unsigned long haddr,
+		      pmd_t *pmd, struct page *page)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgtable_t pgtable;
+	pmd_t entry;
+	int i;
+
+	VM_BUG_ON(!vma_has_file_huge_pmd(vma));
+	VM_BUG_ON(page_to_pfn(page) & (HPAGE_PMD_NR - 1));
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		return -ENOMEM;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		set_page_dirty(page + i);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		return -EAGAIN;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(page + i);
+	entry = mk_pmd(page, vma->vm_page_prot);
+	entry = pmd_mkhuge(pmd_mkdirty(entry));
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -750,6 +810,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* page cache: leave it to the child to fault it in */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -972,7 +1038,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	VM_BUG_ON(PageAnon(page) && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -987,16 +1053,47 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(PageAnon(page) && !PageCompound(page));
 	if (flags & FOLL_GET)
 		get_page_foll(page);
+	if (flags & FOLL_TOUCH && !PageAnon(page))
+		mark_page_accessed(page);
 
 out:
 	return page;
 }
 
+/* Called with page_table_lock held, which it drops */
+static void zap_file_huge_pmd(struct mmu_gather *tlb,
+			      struct vm_area_struct *vma,
+			      pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t orig_pmd;
+	int i;
+
+	pgtable = get_pmd_huge_pte(mm);
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	page = pmd_page(orig_pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_young(orig_pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	spin_unlock(&mm->page_table_lock);
+
+	/* the references are dropped once the TLB has been flushed */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		tlb_remove_page(tlb, page + i);
+	pte_free(mm, pgtable);
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
-		 pmd_t *pmd)
+		 pmd_t *pmd, unsigned long addr)
 {
 	int ret = 0;
 
@@ -1006,6 +1103,9 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			spin_unlock(&tlb->mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma,
 					     pmd);
+		} else if (!PageAnon(pmd_page(*pmd))) {
+			zap_file_huge_pmd(tlb, vma, pmd, addr);
+			ret = 1;
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
@@ -1087,8 +1187,10 @@ pmd_t *page_check_address_pmd(struct page *page,
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd, *ret = NULL;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
 
-	if (address & ~HPAGE_PMD_MASK)
+	/* page cache blocks are not compound: any of their pages may come */
+	if (PageAnon(page) && address != haddr)
 		goto out;
 
 	pgd = pgd_offset(mm, address);
@@ -1102,7 +1204,7 @@ pmd_t *page_check_address_pmd(struct page *page,
 	pmd = pmd_offset(pud, address);
 	if (pmd_none(*pmd))
 		goto out;
-	if (pmd_page(*pmd) != page)
+	if (pmd_page(*pmd) + ((address - haddr) >> PAGE_SHIFT) != page)
 		goto out;
 	/*
 	 * split_vma() may create temporary aliased mappings. There is
@@ -1429,12 +1531,18 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = VM_NO_THP;
+
+	/* shared mappings of page cache which ->pmd_fault can map huge */
+	if (vma_has_file_huge_pmd(vma))
+		no_thp &= ~(VM_SHARED | VM_MAYSHARE);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -1450,7 +1558,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1867,6 +1975,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 		goto out;
 
 	anon_vma_lock(vma->anon_vma);
+	/* a speculative fault must not use the page table from now on */
+	vm_write_begin(vma);
 
 	pte = pte_offset_map(pmd, address);
 	ptl = pte_lockptr(mm, pmd);
@@ -1891,6 +2001,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		BUG_ON(!pmd_none(*pmd));
 		set_pmd_at(mm, address, pmd, _pmd);
 		spin_unlock(&mm->page_table_lock);
+		vm_write_end(vma);
 		anon_vma_unlock(vma->anon_vma);
 		goto out;
 	}
@@ -1927,6 +2038,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	prepare_pmd_huge_pte(pgtable, mm);
 	mm->nr_ptes--;
 	spin_unlock(&mm->page_table_lock);
+	vm_write_end(vma);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
@@ -2317,6 +2429,70 @@ static int khugepaged(void *none)
 	return 0;
 }
 
+/*
+ * Replace a huge pmd mapping page cache with the page table deposited by
+ * map_file_huge_pmd(), mapping the same pages. Their references and
+ * mapcounts carry over to the ptes, and so do the protection, young and
+ * dirty bits. As in __split_huge_page_map(), the huge pmd is made not
+ * present and flushed before the page table goes in.
+ *
+ * Only the pmd is needed, not its address, so this can be reached through
+ * split_huge_page_pmd(); x86 flushes whole mms in flush_tlb_range()
+ * anyway.
+ */
+static void __split_file_huge_pmd(struct mm_struct *mm, pmd_t *pmd)
+{
+	pmd_t orig_pmd = *pmd, _pmd;
+	unsigned long pfn = pmd_pfn(orig_pmd);
+	pgprot_t prot = pmd_pgprot(orig_pmd);
+	pgtable_t pgtable;
+	pte_t *pte;
+	int i;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+	/* pte_index() is 0 for the huge page aligned address */
+	pte = pte_offset_map(&_pmd, 0);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		VM_BUG_ON(!pte_none(pte[i]));
+		set_pte(pte + i, pfn_pte(pfn + i, prot));
+	}
+	pte_unmap(pte);
+
+	mm->nr_ptes++;
+	smp_wmb(); /* make pte visible before pmd */
+	set_pmd(pmd, pmd_mknotpresent(orig_pmd));
+	flush_tlb_mm(mm);
+	pmd_populate(mm, pmd, pgtable);
+
+	count_vm_event(THP_FILE_SPLIT);
+}
+
+/**
+ * split_file_huge_pmd - split the huge pmd mapping a page cache page
+ * @page:	the page
+ * @vma:	a vma mapping the page's file
+ * @address:	where @page is mapped in @vma
+ *
+ * For the file rmap walks, which work on ptes: if @page is mapped at
+ * @address by a huge pmd, replace it by a page table.
+ */
+void split_file_huge_pmd(struct page *page, struct vm_area_struct *vma,
+			 unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pmd_t *pmd;
+
+	spin_lock(&mm->page_table_lock);
+	pmd = page_check_address_pmd(page, mm, address,
+				     PAGE_CHECK_ADDRESS_PMD_FLAG);
+	if (pmd)
+		__split_file_huge_pmd(mm, pmd);
+	spin_unlock(&mm->page_table_lock);
+}
+
 void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 {
 	struct page *page;
@@ -2327,6 +2503,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		__split_file_huge_pmd(mm, pmd);
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2337,15 +2518,13 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
-				    unsigned long address)
+static void __split_huge_page_address(struct mm_struct *mm,
+				      unsigned long address)
 {
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd;
 
-	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
-
 	pgd = pgd_offset(mm, address);
 	if (!pgd_present(*pgd))
 		return;
@@ -2364,6 +2543,26 @@ static void split_huge_page_address(struct mm_struct *mm,
 	split_huge_page_pmd(mm, pmd);
 }
 
+static void split_huge_page_address(struct mm_struct *mm,
+				    unsigned long address)
+{
+	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
+	__split_huge_page_address(mm, address);
+}
+
+/*
+ * Replace every huge pmd of page cache in @vma by a page table, before
+ * remap_file_pages() makes it nonlinear: those are only walked by pte.
+ * Caller holds the mmap_sem write mode.
+ */
+void split_file_huge_pmds(struct vm_area_struct *vma)
+{
+	unsigned long addr = ALIGN(vma->vm_start, HPAGE_PMD_SIZE);
+
+	for (; addr + HPAGE_PMD_SIZE <= vma->vm_end; addr += HPAGE_PMD_SIZE)
+		__split_huge_page_address(vma->vm_mm, addr);
+}
+
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 			     unsigned long start,
 			     unsigned long end,
@@ -16,6 +16,27 @@
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
+#ifdef CONFIG_LAUNCH_READAHEAD
+extern pid_t launch_ra_tgid;
+void __launch_ra_record(struct file *file, pgoff_t start, unsigned long nr);
+
+/*
+ * Record a file access of the process whose launch is being recorded.
+ * __launch_ra_record() checks that current is that process.
+ */
+static inline void launch_ra_record(struct file *file, pgoff_t start,
+				    unsigned long nr)
+{
+	if (unlikely(launch_ra_tgid))
+		__launch_ra_record(file, start, nr);
+}
+#else
+static inline void launch_ra_record(struct file *file, pgoff_t start,
+				    unsigned long nr)
+{
+}
+#endif
+
 static inline void set_page_count(struct page *page, int v)
 {
 	atomic_set(&page->_count, v);
@@ -188,6 +209,23 @@ static inline void mlock_migrate_page(struct page *newpage, struct page *page)
 extern unsigned long vma_address(struct page *page,
 				 struct vm_area_struct *vma);
 #endif
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct vm_area_struct *get_vma(struct mm_struct *mm,
+				      unsigned long addr);
+extern void put_vma(struct vm_area_struct *vma);
+
+/*
+ * Whether a vma found by get_vma() was unmapped, or changed since @seq
+ * was read from its vm_sequence.
+ */
+static inline bool vma_has_changed(struct vm_area_struct *vma,
+				   unsigned int seq)
+{
+	return RB_EMPTY_NODE(&vma->vm_rb) ||
+		read_seqcount_retry(&vma->vm_sequence, seq);
+}
+#endif
 #else /* !CONFIG_MMU */
 static inline int is_mlocked_vma(struct vm_area_struct *v, struct page *p)
 {
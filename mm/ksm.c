@@ -38,6 +38,19 @@
 #include <linux/oom.h>
 
 #include <asm/tlbflush.h>
+#ifdef CONFIG_HAVE_ARCH_KSM_PAGE_OPS
+#include <asm/ksm.h>
+#else
+static inline bool arch_ksm_page_sums(const void *addr, u32 *sums)
+{
+	return false;
+}
+
+static inline long arch_ksm_page_diff(const void *addr1, const void *addr2)
+{
+	return -1;
+}
+#endif
 #include "internal.h"
 
 /*
@@ -86,12 +99,38 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @areas: list of ksm_areas, the merge history of this mm's vmas
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	struct list_head areas;
+};
+
+/**
+ * struct ksm_area - merge history of a VM_MERGEABLE vma
+ * @list: link into the mm_slot's areas list
+ * @start: vm_start of the vma
+ * @seqnr: last full scan in which the vma was seen, or the area created
+ * @scanned: pages of the vma compared in this scan
+ * @merged: pages of the vma merged in this scan
+ * @fails: number of consecutive scans without any merge
+ * @skip: number of scans still to skip the vma for
+ * @fresh: newly madvised, never skipped
+ *
+ * Protected by the mm's mmap_sem, the counters by ksm_thread_mutex.
+ */
+struct ksm_area {
+	struct list_head list;
+	unsigned long start;
+	unsigned long seqnr;
+	unsigned long scanned;
+	unsigned long merged;
+	unsigned int fails;
+	unsigned int skip;
+	bool fresh;
 };
 
 /**
@@ -100,6 +139,7 @@ struct mm_slot {
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
  * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @area: merge history of the vma being scanned, if any
  *
  * There is only the one ksm_scan instance of this cursor structure.
  */
@@ -108,6 +148,7 @@ struct ksm_scan {
 	unsigned long address;
 	struct rmap_item **rmap_list;
 	unsigned long seqnr;
+	struct ksm_area *area;
 };
 
 /**
@@ -129,6 +170,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @oldprehash: previous partial checksum of the page, 0 if none yet
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +181,7 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	unsigned int oldprehash;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -170,6 +213,7 @@ static struct ksm_scan ksm_scan = {
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
+static struct kmem_cache *ksm_area_cache;
 
 /* The number of nodes in the stable tree */
 static unsigned long ksm_pages_shared;
@@ -183,6 +227,31 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* Scan statistics, updated by ksmd */
+static unsigned long ksm_pages_scanned;
+static unsigned long ksm_pages_merged;
+static unsigned long ksm_pages_skipped_volatile;
+static u64 ksm_thread_cpu_time;		/* ns */
+
+/* Rates over the last KSM_STATS_INTERVAL */
+#define KSM_STATS_INTERVAL	HZ
+static unsigned long ksm_pages_scanned_per_sec;
+static unsigned long ksm_merges_per_sec;
+
+/* Number of times ksmd skipped an unproductive vma */
+static unsigned long ksm_areas_skipped;
+
+/*
+ * A vma with no merge in that many consecutive scans is skipped for the
+ * next 1, 3, 7, ... up to 2^(KSM_AREA_MAX_FAILS - 1) - 1 scans. It takes
+ * two scans to merge a page through the unstable tree, so one failed
+ * scan is not enough to judge.
+ */
+#define KSM_AREA_MAX_FAILS	5
+
+/* Share of one CPU ksmd may use, in 1/1000, 0 for no limit */
+static unsigned int ksm_thread_cpu_budget;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
@@ -216,8 +285,14 @@ static int __init ksm_slab_init(void)
 	if (!mm_slot_cache)
 		goto out_free2;
 
+	ksm_area_cache = KSM_KMEM_CACHE(ksm_area, 0);
+	if (!ksm_area_cache)
+		goto out_free3;
+
 	return 0;
 
+out_free3:
+	kmem_cache_destroy(mm_slot_cache);
 out_free2:
 	kmem_cache_destroy(stable_node_cache);
 out_free1:
@@ -228,6 +303,7 @@ out:
 
 static void __init ksm_slab_free(void)
 {
+	kmem_cache_destroy(ksm_area_cache);
 	kmem_cache_destroy(mm_slot_cache);
 	kmem_cache_destroy(stable_node_cache);
 	kmem_cache_destroy(rmap_item_cache);
@@ -263,16 +339,52 @@ static inline void free_stable_node(struct stable_node *stable_node)
 
 static inline struct mm_slot *alloc_mm_slot(void)
 {
+	struct mm_slot *mm_slot;
+
 	if (!mm_slot_cache)	/* initialization failed */
 		return NULL;
-	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+	mm_slot = kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+	if (mm_slot)
+		INIT_LIST_HEAD(&mm_slot->areas);
+	return mm_slot;
+}
+
+static inline void free_ksm_area(struct ksm_area *area)
+{
+	list_del(&area->list);
+	kmem_cache_free(ksm_area_cache, area);
 }
 
 static inline void free_mm_slot(struct mm_slot *mm_slot)
 {
+	struct ksm_area *area, *next;
+
+	list_for_each_entry_safe(area, next, &mm_slot->areas, list)
+		free_ksm_area(area);
 	kmem_cache_free(mm_slot_cache, mm_slot);
 }
 
+static struct ksm_area *get_ksm_area(struct mm_slot *mm_slot,
+				     unsigned long start, bool create)
+{
+	struct ksm_area *area;
+
+	list_for_each_entry(area, &mm_slot->areas, list)
+		if (area->start == start)
+			return area;
+
+	if (!create)
+		return NULL;
+
+	area = kmem_cache_zalloc(ksm_area_cache, GFP_KERNEL);
+	if (area) {
+		area->start = start;
+		area->seqnr = ksm_scan.seqnr;
+		list_add_tail(&area->list, &mm_slot->areas);
+	}
+	return area;
+}
+
 static struct mm_slot *get_mm_slot(struct mm_struct *mm)
 {
 	struct mm_slot *mm_slot;
@@ -617,6 +729,7 @@ static int unmerge_and_remove_all_rmap_items(void)
 	struct vm_area_struct *vma;
 	int err = 0;
 
+	ksm_scan.area = NULL;
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
@@ -669,23 +782,96 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * Pages are checksummed and compared in blocks of KSM_BLOCK_SIZE bytes,
+ * which the architecture may do with vector instructions: see
+ * arch_ksm_page_sums() and arch_ksm_page_diff().
+ */
+#define KSM_BLOCK_SIZE		64
+#define KSM_SUM_LANES		(KSM_BLOCK_SIZE / sizeof(u32))
+
+/*
+ * Fletcher-style sums over the page in KSM_SUM_LANES u32 lanes: the first
+ * half of @sums gets the sums of the words, the second half the sums of
+ * those running sums, which depend on where each word is in the page.
+ */
+static void ksm_page_sums(const void *addr, u32 *sums)
+{
+	const u32 *p = addr;
+	u32 *a = sums, *b = sums + KSM_SUM_LANES;
+	unsigned int i, j;
+
+	memset(sums, 0, 2 * KSM_SUM_LANES * sizeof(u32));
+	for (i = 0; i < PAGE_SIZE / sizeof(u32); i += KSM_SUM_LANES) {
+		for (j = 0; j < KSM_SUM_LANES; j++) {
+			a[j] += p[i + j];
+			b[j] += a[j];
+		}
+	}
+}
+
+/* Offset of the first block differing between two pages, or PAGE_SIZE */
+static unsigned long ksm_page_diff(const void *addr1, const void *addr2)
+{
+	const unsigned long *p1 = addr1, *p2 = addr2;
+	const unsigned int words = KSM_BLOCK_SIZE / sizeof(long);
+	unsigned int i, j;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(long); i += words) {
+		unsigned long diff = 0;
+
+		for (j = 0; j < words; j++)
+			diff |= p1[i + j] ^ p2[i + j];
+		if (diff)
+			return i * sizeof(long);
+	}
+	return PAGE_SIZE;
+}
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
+	u32 sums[2 * KSM_SUM_LANES];
 	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	if (!arch_ksm_page_sums(addr, sums))
+		ksm_page_sums(addr, sums);
 	kunmap_atomic(addr, KM_USER0);
-	return checksum;
+	return jhash2(sums, ARRAY_SIZE(sums), 17);
+}
+
+/*
+ * Partial checksum over a few blocks spread across the page: enough to
+ * tell most of the pages being written to, for a fraction of the cost of
+ * a full checksum or of a stable tree search. Never 0.
+ */
+#define KSM_PREHASH_BLOCKS	8
+
+static u32 calc_prehash(struct page *page)
+{
+	u32 words[KSM_PREHASH_BLOCKS * 4];
+	char *addr = kmap_atomic(page, KM_USER0);
+	unsigned int i;
+
+	for (i = 0; i < KSM_PREHASH_BLOCKS; i++)
+		memcpy(&words[i * 4], addr + i * (PAGE_SIZE / KSM_PREHASH_BLOCKS),
+		       4 * sizeof(u32));
+	kunmap_atomic(addr, KM_USER0);
+	return jhash2(words, ARRAY_SIZE(words), 17) | 1;
 }
 
 static int memcmp_pages(struct page *page1, struct page *page2)
 {
 	char *addr1, *addr2;
-	int ret;
+	long off;
+	int ret = 0;
 
 	addr1 = kmap_atomic(page1, KM_USER0);
 	addr2 = kmap_atomic(page2, KM_USER1);
-	ret = memcmp(addr1, addr2, PAGE_SIZE);
+	off = arch_ksm_page_diff(addr1, addr2);
+	if (off < 0)
+		off = ksm_page_diff(addr1, addr2);
+	/* Same ordering as memcmp() over the whole pages */
+	if (off < PAGE_SIZE)
+		ret = memcmp(addr1 + off, addr2 + off, KSM_BLOCK_SIZE);
 	kunmap_atomic(addr2, KM_USER1);
 	kunmap_atomic(addr1, KM_USER0);
 	return ret;
@@ -1152,6 +1338,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
+	ksm_pages_merged++;
 
 	if (rmap_item->hlist.next)
 		ksm_pages_sharing++;
@@ -1175,10 +1362,26 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	struct stable_node *stable_node;
 	struct page *kpage;
 	unsigned int checksum;
+	unsigned int prehash;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	/*
+	 * A page whose partial checksum changed since the last scan is
+	 * being written to: don't even search the stable tree for it.
+	 */
+	prehash = calc_prehash(page);
+	if (rmap_item->oldprehash != prehash) {
+		bool volatile_page = rmap_item->oldprehash != 0;
+
+		rmap_item->oldprehash = prehash;
+		if (volatile_page) {
+			ksm_pages_skipped_volatile++;
+			return;
+		}
+	}
+
 	/* We first start with searching the page inside the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage) {
@@ -1272,6 +1475,101 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Step the scan cursor over the rmap_items of a vma being skipped. Only
+ * those in the stable tree are kept: an unstable tree entry would be
+ * older than one scan by the time the vma is scanned again, which
+ * remove_rmap_item_from_tree() does not expect.
+ */
+static void skip_rmap_items(struct vm_area_struct *vma)
+{
+	struct rmap_item *rmap_item;
+
+	while ((rmap_item = *ksm_scan.rmap_list)) {
+		unsigned long addr = rmap_item->address & PAGE_MASK;
+
+		if (addr >= vma->vm_end)
+			break;
+		/*
+		 * Left over from an unmapped area, as in get_next, or not
+		 * in the stable tree
+		 */
+		if (addr < vma->vm_start ||
+		    !(rmap_item->address & STABLE_FLAG)) {
+			*ksm_scan.rmap_list = rmap_item->rmap_list;
+			remove_rmap_item_from_tree(rmap_item);
+			free_rmap_item(rmap_item);
+			continue;
+		}
+		ksm_scan.rmap_list = &rmap_item->rmap_list;
+	}
+}
+
+/* Account the merge yield of the vma ksmd has just finished scanning */
+static void ksm_area_done(struct ksm_area *area)
+{
+	if (area->scanned) {
+		if (area->merged || area->fresh) {
+			area->fails = 0;
+		} else {
+			if (area->fails < KSM_AREA_MAX_FAILS)
+				area->fails++;
+			area->skip = (1 << (area->fails - 1)) - 1;
+		}
+		area->fresh = false;
+	}
+	area->scanned = 0;
+	area->merged = 0;
+}
+
+/*
+ * ksm_area_enter - ksmd starts scanning @vma
+ * Returns false if the vma has been unproductive and is to be skipped.
+ */
+static bool ksm_area_enter(struct mm_slot *slot, struct vm_area_struct *vma)
+{
+	struct ksm_area *area = ksm_scan.area;
+
+	if (area && area->start == vma->vm_start)
+		return true;
+
+	if (area)
+		ksm_area_done(area);
+
+	area = get_ksm_area(slot, vma->vm_start, true);
+	ksm_scan.area = area;
+	if (!area)
+		return true;
+
+	area->seqnr = ksm_scan.seqnr;
+	if (area->skip && !area->fresh) {
+		area->skip--;
+		ksm_areas_skipped++;
+		ksm_scan.area = NULL;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Forget about the vmas which have gone since the last scan. A fresh area
+ * which no vma started at for a whole scan, because the madvised range was
+ * merged into the previous vma or unmapped, goes too.
+ */
+static void ksm_areas_prune(struct mm_slot *slot)
+{
+	struct ksm_area *area, *next;
+
+	if (ksm_scan.area) {
+		ksm_area_done(ksm_scan.area);
+		ksm_scan.area = NULL;
+	}
+
+	list_for_each_entry_safe(area, next, &slot->areas, list)
+		if (area->seqnr != ksm_scan.seqnr)
+			free_ksm_area(area);
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1311,6 +1609,7 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
+		ksm_scan.area = NULL;
 	}
 
 	mm = slot->mm;
@@ -1327,6 +1626,10 @@ next_mm:
 			ksm_scan.address = vma->vm_start;
 		if (!vma->anon_vma)
 			ksm_scan.address = vma->vm_end;
+		else if (!ksm_area_enter(slot, vma)) {
+			skip_rmap_items(vma);
+			ksm_scan.address = vma->vm_end;
+		}
 
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
@@ -1362,6 +1665,7 @@ next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
 	}
+	ksm_areas_prune(slot);
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
@@ -1417,33 +1721,90 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
+		ksm_pages_scanned++;
+		if (!PageKsm(page) || !in_stable_tree(rmap_item)) {
+			unsigned long merged = ksm_pages_merged;
+
 			cmp_and_merge_page(page, rmap_item);
+			if (ksm_scan.area) {
+				ksm_scan.area->scanned++;
+				ksm_scan.area->merged +=
+					ksm_pages_merged - merged;
+			}
+		}
 		put_page(page);
 	}
 }
 
+/*
+ * ksm_update_stats - refresh ksmd's CPU time and scan rates
+ * Called by ksmd with ksm_thread_mutex held.
+ */
+static void ksm_update_stats(void)
+{
+	static unsigned long stamp, scanned_stamp, merged_stamp;
+	unsigned long elapsed = jiffies - stamp;
+
+	ksm_thread_cpu_time = current->se.sum_exec_runtime;
+
+	if (elapsed < KSM_STATS_INTERVAL)
+		return;
+
+	ksm_pages_scanned_per_sec =
+		(ksm_pages_scanned - scanned_stamp) * HZ / elapsed;
+	ksm_merges_per_sec = (ksm_pages_merged - merged_stamp) * HZ / elapsed;
+
+	scanned_stamp = ksm_pages_scanned;
+	merged_stamp = ksm_pages_merged;
+	stamp = jiffies;
+}
+
 static int ksmd_should_run(void)
 {
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
 }
 
+/*
+ * ksm_sleep_jiffies - how long ksmd should sleep after a batch
+ * @runtime: CPU time the batch took, in ns
+ *
+ * At least sleep_millisecs, more if needed to keep ksmd within its CPU
+ * budget: the scan rate then follows how expensive pages are to merge.
+ */
+static unsigned long ksm_sleep_jiffies(u64 runtime)
+{
+	unsigned long sleep = msecs_to_jiffies(ksm_thread_sleep_millisecs);
+	unsigned int budget = ksm_thread_cpu_budget;
+
+	if (budget) {
+		runtime *= 1000 - budget;
+		do_div(runtime, budget);
+		sleep = max(sleep, nsecs_to_jiffies(runtime));
+	}
+	return sleep;
+}
+
 static int ksm_scan_thread(void *nothing)
 {
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
+		u64 runtime = current->se.sum_exec_runtime;
+
 		mutex_lock(&ksm_thread_mutex);
 		if (ksmd_should_run())
 			ksm_do_scan(ksm_thread_pages_to_scan);
+		ksm_update_stats();
 		mutex_unlock(&ksm_thread_mutex);
 
+		runtime = current->se.sum_exec_runtime - runtime;
+
 		try_to_freeze();
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+				ksm_sleep_jiffies(runtime));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1452,6 +1813,33 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/*
+ * A newly madvised area is likely to have a lot to merge: make ksmd scan
+ * its mm next, and never skip it before its first merge attempt.
+ */
+static void ksm_prioritize(struct mm_struct *mm, unsigned long start)
+{
+	struct mm_slot *mm_slot;
+	struct ksm_area *area;
+
+	spin_lock(&ksm_mmlist_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && mm_slot != ksm_scan.mm_slot)
+		list_move(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	spin_unlock(&ksm_mmlist_lock);
+
+	if (!mm_slot)
+		return;
+
+	/* mmap_sem is held for writing: ksmd is not looking at the areas */
+	area = get_ksm_area(mm_slot, start, true);
+	if (area) {
+		area->fresh = true;
+		area->fails = 0;
+		area->skip = 0;
+	}
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1476,6 +1864,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		}
 
 		*vm_flags |= VM_MERGEABLE;
+		ksm_prioritize(mm, start);
 		break;
 
 	case MADV_UNMERGEABLE:
@@ -1872,6 +2261,29 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t cpu_budget_permille_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_cpu_budget);
+}
+
+static ssize_t cpu_budget_permille_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	int err;
+	unsigned long budget;
+
+	err = strict_strtoul(buf, 10, &budget);
+	if (err || budget > 1000)
+		return -EINVAL;
+
+	ksm_thread_cpu_budget = budget;
+
+	return count;
+}
+KSM_ATTR(cpu_budget_permille);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1966,15 +2378,77 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_scanned_per_sec_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned_per_sec);
+}
+KSM_ATTR_RO(pages_scanned_per_sec);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t merges_per_sec_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_merges_per_sec);
+}
+KSM_ATTR_RO(merges_per_sec);
+
+static ssize_t pages_skipped_volatile_show(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped_volatile);
+}
+KSM_ATTR_RO(pages_skipped_volatile);
+
+static ssize_t cpu_time_ms_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	u64 cpu_time = ksm_thread_cpu_time;
+
+	do_div(cpu_time, NSEC_PER_MSEC);
+	return sprintf(buf, "%llu\n", (unsigned long long)cpu_time);
+}
+KSM_ATTR_RO(cpu_time_ms);
+
+static ssize_t areas_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_areas_skipped);
+}
+KSM_ATTR_RO(areas_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&cpu_budget_permille_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_scanned_per_sec_attr.attr,
+	&pages_merged_attr.attr,
+	&merges_per_sec_attr.attr,
+	&pages_skipped_volatile_attr.attr,
+	&cpu_time_ms_attr.attr,
+	&areas_skipped_attr.attr,
 	NULL,
 };
 
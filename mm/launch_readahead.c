@@ -0,0 +1,617 @@
+/*
+ * mm/launch_readahead.c - record and replay the file reads of app launches
+ *
+ * Copyright (C) 2011
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A cold application start reads small scattered pieces of its .apk,
+ * .odex and shared libraries, which the on-demand readahead heuristics
+ * cannot predict. Userspace asks the kernel to record the file ranges read
+ * or faulted by a freshly started process during its first moments:
+ *
+ *	echo "record <pid> <msecs>" > /proc/launch_readahead
+ *
+ * Reading /proc/launch_readahead returns the last recording, one
+ * "<first page> <pages> <path>" line per range in access order, which
+ * userspace stores. On the next start of the same application it is handed
+ * back before the process is forked:
+ *
+ *	echo "replay <recording file>" > /proc/launch_readahead
+ *
+ * The ranges are sorted per file, merged across small gaps and submitted
+ * through force_page_cache_readahead() as a few large requests. If the
+ * launch is recorded again, every recorded range is checked against the
+ * replayed ones; the launch_ra tracepoints show recorded and replayed
+ * ranges and the hit rate is kept in the recording header.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/path.h>
+#include <linux/dcache.h>
+#include <linux/sched.h>
+#include <linux/pid.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/ctype.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
+#include <linux/uaccess.h>
+
+#include "internal.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/launch_ra.h>
+
+#define LRA_MAX_FILES		256
+#define LRA_MAX_RANGES		4096
+#define LRA_MAX_MSECS		60000
+#define LRA_MAX_LOG		(1 << 20)
+/* Ranges of a file closer than this are read as one request on replay */
+#define LRA_MERGE_GAP		16
+/* Recent ranges searched for one to extend before appending a new one */
+#define LRA_MERGE_LOOKBACK	8
+
+struct lra_range {
+	unsigned int file;
+	unsigned int nr;
+	pgoff_t start;
+};
+
+struct lra_file {
+	struct address_space *mapping;
+	struct path path;
+};
+
+struct lra_recording {
+	pid_t tgid;
+	unsigned long deadline;
+	unsigned int nr_files;
+	unsigned int nr_ranges;
+	unsigned long pages;
+	unsigned long hit_pages;
+	struct lra_file files[LRA_MAX_FILES];
+	struct lra_range ranges[LRA_MAX_RANGES];
+};
+
+struct lra_replay {
+	int recorded;		/* a recording has been started since */
+	unsigned long expires;	/* drop the files by then if not recording */
+	unsigned int nr_files;
+	unsigned int nr_ranges;
+	struct file *files[LRA_MAX_FILES];
+	struct lra_range ranges[LRA_MAX_RANGES];	/* sorted by file, start */
+};
+
+/* Tgid being recorded, 0 if none. Checked locklessly by the hooks. */
+pid_t launch_ra_tgid __read_mostly;
+
+static DEFINE_SPINLOCK(lra_lock);
+static DEFINE_MUTEX(lra_mutex);
+static struct lra_recording *lra_rec;		/* protected by both locks */
+static struct lra_replay *lra_replay;		/* protected by both locks */
+
+static void lra_end_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(lra_end_work, lra_end_fn);
+
+static int lra_replay_hit(struct lra_replay *rp, struct address_space *mapping,
+			  pgoff_t start, unsigned long nr)
+{
+	unsigned int file, lo, hi;
+
+	for (file = 0; file < rp->nr_files; file++)
+		if (rp->files[file]->f_mapping == mapping)
+			break;
+	if (file == rp->nr_files)
+		return 0;
+
+	/* Last range of the file starting at or before start */
+	lo = 0;
+	hi = rp->nr_ranges;
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		struct lra_range *r = &rp->ranges[mid];
+
+		if (r->file < file || (r->file == file && r->start <= start))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo || rp->ranges[lo - 1].file != file)
+		return 0;
+	return start + nr <= rp->ranges[lo - 1].start + rp->ranges[lo - 1].nr;
+}
+
+static unsigned int lra_file_index(struct lra_recording *rec, struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned int i;
+
+	for (i = rec->nr_files; i > 0; i--)
+		if (rec->files[i - 1].mapping == mapping)
+			return i - 1;
+	if (rec->nr_files == LRA_MAX_FILES)
+		return LRA_MAX_FILES;
+
+	i = rec->nr_files++;
+	rec->files[i].mapping = mapping;
+	rec->files[i].path = file->f_path;
+	path_get(&rec->files[i].path);
+	return i;
+}
+
+/*
+ * Note that the recorded task accessed pages [start, start + nr) of file.
+ * Called from the read and fault paths through launch_ra_record().
+ */
+void __launch_ra_record(struct file *file, pgoff_t start, unsigned long nr)
+{
+	struct lra_recording *rec;
+	struct lra_range *r;
+	unsigned int idx, i;
+	int hit = 0;
+
+	if (!nr || launch_ra_tgid != current->tgid)
+		return;
+
+	spin_lock(&lra_lock);
+	rec = lra_rec;
+	if (!rec || rec->tgid != current->tgid)
+		goto out;
+	/* lra_end_work is late */
+	if (time_after(jiffies, rec->deadline)) {
+		launch_ra_tgid = 0;
+		goto out;
+	}
+
+	idx = lra_file_index(rec, file);
+	if (idx == LRA_MAX_FILES)
+		goto out;
+
+	if (lra_replay) {
+		hit = lra_replay_hit(lra_replay, file->f_mapping, start, nr);
+		if (hit)
+			rec->hit_pages += nr;
+	}
+	rec->pages += nr;
+	trace_launch_ra_record(file->f_mapping, start, nr, hit);
+
+	/* Extend a recent range of the same file that this one touches */
+	for (i = rec->nr_ranges; i > 0 && i + LRA_MERGE_LOOKBACK > rec->nr_ranges;
+	     i--) {
+		r = &rec->ranges[i - 1];
+		if (r->file != idx || start > r->start + r->nr ||
+		    start + nr < r->start)
+			continue;
+		if (start < r->start) {
+			r->nr += r->start - start;
+			r->start = start;
+		}
+		if (start + nr > r->start + r->nr)
+			r->nr = start + nr - r->start;
+		goto out;
+	}
+
+	if (rec->nr_ranges == LRA_MAX_RANGES)
+		goto out;
+	r = &rec->ranges[rec->nr_ranges++];
+	r->file = idx;
+	r->start = start;
+	r->nr = nr;
+out:
+	spin_unlock(&lra_lock);
+}
+
+static void lra_free_recording(struct lra_recording *rec)
+{
+	unsigned int i;
+
+	if (!rec)
+		return;
+	for (i = 0; i < rec->nr_files; i++)
+		path_put(&rec->files[i].path);
+	vfree(rec);
+}
+
+static void lra_free_replay(struct lra_replay *rp)
+{
+	unsigned int i;
+
+	if (!rp)
+		return;
+	for (i = 0; i < rp->nr_files; i++)
+		fput(rp->files[i]);
+	vfree(rp);
+}
+
+/*
+ * Runs when the recording window is over, or LRA_MAX_MSECS after a replay
+ * that was not followed by a recording. Stop recording, and drop the
+ * replayed files, which are held open only while a recording can still
+ * report hits against them.
+ */
+static void lra_end_fn(struct work_struct *work)
+{
+	struct lra_replay *rp;
+
+	mutex_lock(&lra_mutex);
+	spin_lock(&lra_lock);
+	if (lra_rec && !time_before(jiffies, lra_rec->deadline))
+		launch_ra_tgid = 0;
+	rp = NULL;
+	if (!launch_ra_tgid && lra_replay &&
+	    (lra_replay->recorded ||
+	     !time_before(jiffies, lra_replay->expires))) {
+		rp = lra_replay;
+		lra_replay = NULL;
+	}
+	spin_unlock(&lra_lock);
+	mutex_unlock(&lra_mutex);
+	lra_free_replay(rp);
+}
+
+/* Called with lra_mutex held */
+static void lra_schedule_end(unsigned long deadline)
+{
+	cancel_delayed_work(&lra_end_work);
+	schedule_delayed_work(&lra_end_work,
+			      time_after(deadline, jiffies) ?
+			      deadline - jiffies : 0);
+}
+
+static int lra_record(pid_t pid, unsigned int msecs)
+{
+	struct lra_recording *rec, *old;
+	struct task_struct *task;
+
+	if (!msecs || msecs > LRA_MAX_MSECS)
+		return -EINVAL;
+
+	rec = vzalloc(sizeof(*rec));
+	if (!rec)
+		return -ENOMEM;
+
+	rcu_read_lock();
+	task = find_task_by_vpid(pid);
+	if (task)
+		rec->tgid = task->tgid;
+	rcu_read_unlock();
+	if (!task) {
+		vfree(rec);
+		return -ESRCH;
+	}
+	rec->deadline = jiffies + msecs_to_jiffies(msecs);
+
+	spin_lock(&lra_lock);
+	old = lra_rec;
+	lra_rec = rec;
+	launch_ra_tgid = rec->tgid;
+	if (lra_replay)
+		lra_replay->recorded = 1;
+	spin_unlock(&lra_lock);
+
+	lra_schedule_end(rec->deadline);
+	lra_free_recording(old);
+	return 0;
+}
+
+static void lra_stop(void)
+{
+	struct lra_replay *rp;
+
+	spin_lock(&lra_lock);
+	launch_ra_tgid = 0;
+	rp = lra_replay;
+	lra_replay = NULL;
+	spin_unlock(&lra_lock);
+
+	lra_free_replay(rp);
+}
+
+static int lra_cmp_range(const void *a, const void *b)
+{
+	const struct lra_range *ra = a, *rb = b;
+
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/* Undo the octal escapes seq_path() put into the recorded path */
+static void lra_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+				(s[3] - '0');
+			s += 4;
+		} else
+			*d++ = *s++;
+	}
+	*d = '\0';
+}
+
+static unsigned int lra_replay_file(struct lra_replay *rp, char **names,
+				    const char *name)
+{
+	struct file *file;
+	unsigned int i;
+
+	for (i = rp->nr_files; i > 0; i--)
+		if (!strcmp(names[i - 1], name))
+			return i - 1;
+	if (rp->nr_files == LRA_MAX_FILES)
+		return LRA_MAX_FILES;
+
+	file = filp_open(name, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(file))
+		return LRA_MAX_FILES;
+	names[rp->nr_files] = kstrdup(name, GFP_KERNEL);
+	if (!names[rp->nr_files]) {
+		fput(file);
+		return LRA_MAX_FILES;
+	}
+	rp->files[rp->nr_files] = file;
+	return rp->nr_files++;
+}
+
+/* Parse a stored recording into rp->ranges, opening the files it names */
+static void lra_parse(struct lra_replay *rp, char **names, char *buf)
+{
+	char *line;
+
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		unsigned long start, nr;
+		struct lra_range *r;
+		unsigned int file;
+		char *p;
+
+		if (rp->nr_ranges == LRA_MAX_RANGES)
+			break;
+		if (*line == '#' || !*line)
+			continue;
+
+		start = simple_strtoul(line, &p, 10);
+		if (*p != ' ')
+			continue;
+		nr = simple_strtoul(p + 1, &p, 10);
+		if (*p != ' ' || !nr || nr > UINT_MAX)
+			continue;
+		p++;
+		lra_unescape(p);
+
+		file = lra_replay_file(rp, names, p);
+		if (file == LRA_MAX_FILES)
+			continue;
+		r = &rp->ranges[rp->nr_ranges++];
+		r->file = file;
+		r->start = start;
+		r->nr = nr;
+	}
+}
+
+/*
+ * Sort the ranges by file and offset and merge ranges that overlap or are
+ * less than LRA_MERGE_GAP pages apart.
+ */
+static void lra_merge(struct lra_replay *rp)
+{
+	unsigned int i, n = 0;
+
+	if (!rp->nr_ranges)
+		return;
+	sort(rp->ranges, rp->nr_ranges, sizeof(struct lra_range),
+	     lra_cmp_range, NULL);
+
+	for (i = 1; i < rp->nr_ranges; i++) {
+		struct lra_range *cur = &rp->ranges[n];
+		struct lra_range *next = &rp->ranges[i];
+
+		if (next->file == cur->file &&
+		    next->start <= cur->start + cur->nr + LRA_MERGE_GAP) {
+			if (next->start + next->nr > cur->start + cur->nr)
+				cur->nr = next->start + next->nr - cur->start;
+			continue;
+		}
+		rp->ranges[++n] = *next;
+	}
+	rp->nr_ranges = n + 1;
+}
+
+static int lra_do_replay(const char *log)
+{
+	struct lra_replay *rp, *old;
+	struct file *file;
+	char **names;
+	char *buf;
+	loff_t size;
+	unsigned int i;
+	int ret;
+
+	file = filp_open(log, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	ret = -EFBIG;
+	size = i_size_read(file->f_mapping->host);
+	if (size > LRA_MAX_LOG)
+		goto out_fput;
+
+	ret = -ENOMEM;
+	rp = vzalloc(sizeof(*rp));
+	names = kcalloc(LRA_MAX_FILES, sizeof(char *), GFP_KERNEL);
+	buf = vmalloc(size + 1);
+	if (!rp || !names || !buf)
+		goto out_free;
+
+	ret = kernel_read(file, 0, buf, size);
+	if (ret < 0)
+		goto out_free;
+	buf[ret] = '\0';
+
+	lra_parse(rp, names, buf);
+	lra_merge(rp);
+
+	for (i = 0; i < rp->nr_ranges; i++) {
+		struct lra_range *r = &rp->ranges[i];
+		struct file *f = rp->files[r->file];
+
+		ret = force_page_cache_readahead(f->f_mapping, f, r->start,
+						 r->nr);
+		trace_launch_ra_replay(f->f_mapping, r->start, r->nr, ret);
+	}
+
+	rp->expires = jiffies + msecs_to_jiffies(LRA_MAX_MSECS);
+	spin_lock(&lra_lock);
+	old = lra_replay;
+	lra_replay = rp;
+	spin_unlock(&lra_lock);
+	/* A recording in progress drops the files when it ends */
+	if (!launch_ra_tgid)
+		lra_schedule_end(rp->expires);
+	lra_free_replay(old);
+	rp = NULL;
+	ret = 0;
+
+out_free:
+	if (names)
+		for (i = 0; i < LRA_MAX_FILES; i++)
+			kfree(names[i]);
+	kfree(names);
+	vfree(buf);
+	lra_free_replay(rp);
+out_fput:
+	fput(file);
+	return ret;
+}
+
+static ssize_t lra_write(struct file *file, const char __user *ubuf,
+			 size_t count, loff_t *ppos)
+{
+	char *buf, *cmd, *arg;
+	int ret;
+
+	if (count >= PATH_MAX + 16)
+		return -EINVAL;
+	buf = kmalloc(count + 1, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	ret = -EFAULT;
+	if (copy_from_user(buf, ubuf, count))
+		goto out;
+	buf[count] = '\0';
+
+	arg = strim(buf);
+	cmd = strsep(&arg, " ");
+	arg = arg ? skip_spaces(arg) : NULL;
+
+	mutex_lock(&lra_mutex);
+	ret = -EINVAL;
+	if (!strcmp(cmd, "record") && arg) {
+		unsigned long pid, msecs;
+		char *p;
+
+		pid = simple_strtoul(arg, &p, 10);
+		if (*p == ' ') {
+			msecs = simple_strtoul(skip_spaces(p), &p, 10);
+			if (!*p)
+				ret = lra_record(pid, msecs);
+		}
+	} else if (!strcmp(cmd, "replay") && arg) {
+		ret = lra_do_replay(arg);
+	} else if (!strcmp(cmd, "stop") && !arg) {
+		lra_stop();
+		ret = 0;
+	}
+	mutex_unlock(&lra_mutex);
+out:
+	kfree(buf);
+	return ret ? ret : count;
+}
+
+/*
+ * lra_mutex keeps the recording from being replaced, lra_lock from being
+ * appended to while it is shown
+ */
+static void *lra_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&lra_mutex);
+	spin_lock(&lra_lock);
+	if (!lra_rec)
+		return NULL;
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	return *pos <= lra_rec->nr_ranges ? &lra_rec->ranges[*pos - 1] : NULL;
+}
+
+static void *lra_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return *pos <= lra_rec->nr_ranges ? &lra_rec->ranges[*pos - 1] : NULL;
+}
+
+static void lra_seq_stop(struct seq_file *m, void *v)
+{
+	spin_unlock(&lra_lock);
+	mutex_unlock(&lra_mutex);
+}
+
+static int lra_seq_show(struct seq_file *m, void *v)
+{
+	struct lra_recording *rec = lra_rec;
+	struct lra_range *r = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "# tgid %d%s ranges %u pages %lu hit %lu\n",
+			   rec->tgid,
+			   launch_ra_tgid == rec->tgid ? " (recording)" : "",
+			   rec->nr_ranges, rec->pages, rec->hit_pages);
+		return 0;
+	}
+
+	seq_printf(m, "%lu %u ", (unsigned long)r->start, r->nr);
+	seq_path(m, &rec->files[r->file].path, " \t\n\\");
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static const struct seq_operations lra_seq_ops = {
+	.start	= lra_seq_start,
+	.next	= lra_seq_next,
+	.stop	= lra_seq_stop,
+	.show	= lra_seq_show,
+};
+
+static int lra_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &lra_seq_ops);
+}
+
+static const struct file_operations lra_fops = {
+	.open		= lra_open,
+	.read		= seq_read,
+	.write		= lra_write,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int __init launch_ra_init(void)
+{
+	proc_create("launch_readahead", S_IRUSR | S_IWUSR, NULL, &lra_fops);
+	return 0;
+}
+module_init(launch_ra_init);
@@ -205,6 +205,51 @@ struct mem_cgroup_eventfd_list {
 static void mem_cgroup_threshold(struct mem_cgroup *mem);
 static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
 
+/*
+ * Memory pressure levels. vmscan reports how many pages it scanned and
+ * reclaimed on behalf of a mem_cgroup (the root one for global reclaim);
+ * once a window of pages has been scanned, the share that could not be
+ * reclaimed gives the pressure level signalled to userspace.
+ */
+enum mem_cgroup_pressure_level {
+	MEM_CGROUP_PRESSURE_LOW,
+	MEM_CGROUP_PRESSURE_MEDIUM,
+	MEM_CGROUP_PRESSURE_CRITICAL,
+	MEM_CGROUP_NR_PRESSURE_LEVELS,
+};
+
+static const char * const pressure_level_names[] = {
+	[MEM_CGROUP_PRESSURE_LOW] = "low",
+	[MEM_CGROUP_PRESSURE_MEDIUM] = "medium",
+	[MEM_CGROUP_PRESSURE_CRITICAL] = "critical",
+};
+
+/* Pages scanned before a level is computed */
+#define MEM_CGROUP_PRESSURE_WIN		(SWAP_CLUSTER_MAX * 16)
+/* Percentage of scanned pages not reclaimed for each level */
+#define MEM_CGROUP_PRESSURE_MEDIUM_PCT	60
+#define MEM_CGROUP_PRESSURE_CRITICAL_PCT	95
+/* Reclaim priority at which pressure is critical whatever the efficiency */
+#define MEM_CGROUP_PRESSURE_CRITICAL_PRIO	3
+
+struct mem_cgroup_pressure {
+	spinlock_t sr_lock;
+	unsigned long scanned;
+	unsigned long reclaimed;
+	/* last level computed, for reading */
+	int level;
+
+	struct mutex events_lock;
+	struct list_head events;
+	struct work_struct work;
+};
+
+struct mem_cgroup_pressure_event {
+	struct list_head list;
+	struct eventfd_ctx *eventfd;
+	int level;
+};
+
 /*
  * The memory controller data structure. The memory controller controls both
  * page cache and RSS per cgroup. We would eventually like to provide
@@ -268,6 +313,9 @@ struct mem_cgroup {
 	/* For oom notifier event fd */
 	struct list_head oom_notify;
 
+	/* For memory pressure level event fd */
+	struct mem_cgroup_pressure pressure;
+
 	/*
 	 * Should we move charges of a task when a task is moved into this
 	 * mem_cgroup ? And what type of charges should we move ?
@@ -344,6 +392,7 @@ enum charge_type {
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
+#define _PRESSURE_TYPE		(3)
 #define MEMFILE_PRIVATE(x, val)	(((x) << 16) | (val))
 #define MEMFILE_TYPE(val)	(((val) >> 16) & 0xffff)
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
@@ -1288,6 +1337,9 @@ unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
 		ret = __isolate_lru_page(page, mode, file);
 		switch (ret) {
 		case 0:
+			/* off the generation list as well, see lru_gen_del_page */
+			if (lru_gen_enabled())
+				set_page_lru_gen(page, -1);
 			list_move(&page->lru, dst);
 			mem_cgroup_del_lru(page);
 			nr_taken += hpage_nr_pages(page);
@@ -4656,6 +4708,216 @@ static void mem_cgroup_oom_unregister_event(struct cgroup *cgrp,
 	mutex_unlock(&memcg_oom_mutex);
 }
 
+static int mem_cgroup_pressure_level(unsigned long scanned,
+				     unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	if (reclaimed >= scanned)
+		return MEM_CGROUP_PRESSURE_LOW;
+
+	pressure = 100 - reclaimed * 100 / scanned;
+	if (pressure >= MEM_CGROUP_PRESSURE_CRITICAL_PCT)
+		return MEM_CGROUP_PRESSURE_CRITICAL;
+	if (pressure >= MEM_CGROUP_PRESSURE_MEDIUM_PCT)
+		return MEM_CGROUP_PRESSURE_MEDIUM;
+	return MEM_CGROUP_PRESSURE_LOW;
+}
+
+/* Returns true if somebody listens to @mem's pressure events */
+static bool mem_cgroup_pressure_signal(struct mem_cgroup *mem, int level)
+{
+	struct mem_cgroup_pressure_event *ev;
+	bool signalled = false;
+
+	mutex_lock(&mem->pressure.events_lock);
+	list_for_each_entry(ev, &mem->pressure.events, list) {
+		if (level >= ev->level)
+			eventfd_signal(ev->eventfd, 1);
+		signalled = true;
+	}
+	mutex_unlock(&mem->pressure.events_lock);
+
+	return signalled;
+}
+
+/*
+ * The work does not run after mem_cgroup_destroy(), and a cgroup can't be
+ * removed before its children.
+ */
+static struct mem_cgroup *mem_cgroup_pressure_parent(struct mem_cgroup *mem)
+{
+	struct cgroup *parent = mem->css.cgroup->parent;
+
+	return parent ? mem_cgroup_from_cont(parent) : NULL;
+}
+
+static void mem_cgroup_pressure_work(struct work_struct *work)
+{
+	struct mem_cgroup_pressure *pr = container_of(work,
+					struct mem_cgroup_pressure, work);
+	struct mem_cgroup *mem = container_of(pr, struct mem_cgroup, pressure);
+	struct mem_cgroup *iter;
+	unsigned long scanned, reclaimed;
+	int level;
+
+	spin_lock(&pr->sr_lock);
+	scanned = pr->scanned;
+	reclaimed = pr->reclaimed;
+	pr->scanned = 0;
+	pr->reclaimed = 0;
+	spin_unlock(&pr->sr_lock);
+
+	if (scanned) {
+		level = mem_cgroup_pressure_level(scanned, reclaimed);
+		pr->level = level;
+
+		/*
+		 * Pressure in a child is pressure in its parents too, let
+		 * the closest cgroup with listeners know. Walk the cgroup
+		 * tree rather than parent_mem_cgroup(), so that this works
+		 * without use_hierarchy too.
+		 */
+		for (iter = mem; iter; iter = mem_cgroup_pressure_parent(iter))
+			if (mem_cgroup_pressure_signal(iter, level))
+				break;
+	}
+
+	/* Taken when the work was queued */
+	mem_cgroup_put(mem);
+}
+
+/**
+ * mem_cgroup_vmpressure - account reclaim efficiency for pressure levels
+ * @gfp_mask: reclaim context
+ * @mem: mem_cgroup under reclaim, NULL for global reclaim
+ * @scanned: number of pages scanned
+ * @reclaimed: number of pages reclaimed out of @scanned
+ *
+ * Called from vmscan. Listeners are signalled from a work item once
+ * enough pages have been scanned.
+ */
+void mem_cgroup_vmpressure(gfp_t gfp_mask, struct mem_cgroup *mem,
+			   unsigned long scanned, unsigned long reclaimed)
+{
+	struct mem_cgroup_pressure *pr;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	/*
+	 * Reclaim for GFP_NOIO and GFP_NOFS allocations can't write back
+	 * dirty pages, and its poor efficiency says nothing about memory
+	 * pressure. Only count reclaim that could do all it can.
+	 */
+	if (!(gfp_mask & __GFP_FS))
+		return;
+	if (!scanned)
+		return;
+
+	if (!mem)
+		mem = root_mem_cgroup;
+	pr = &mem->pressure;
+
+	spin_lock(&pr->sr_lock);
+	pr->scanned += scanned;
+	pr->reclaimed += reclaimed;
+	scanned = pr->scanned;
+	spin_unlock(&pr->sr_lock);
+
+	if (scanned < MEM_CGROUP_PRESSURE_WIN)
+		return;
+
+	mem_cgroup_get(mem);
+	if (!schedule_work(&pr->work))
+		mem_cgroup_put(mem);
+}
+
+/**
+ * mem_cgroup_vmpressure_prio - account reclaim priority for pressure levels
+ * @gfp_mask: reclaim context
+ * @mem: mem_cgroup under reclaim, NULL for global reclaim
+ * @priority: current reclaim priority
+ *
+ * Reclaim getting down to a low priority means it is struggling, whatever
+ * its efficiency so far: report critical pressure.
+ */
+void mem_cgroup_vmpressure_prio(gfp_t gfp_mask, struct mem_cgroup *mem,
+				int priority)
+{
+	if (priority > MEM_CGROUP_PRESSURE_CRITICAL_PRIO)
+		return;
+
+	/* A whole window scanned without reclaiming anything */
+	mem_cgroup_vmpressure(gfp_mask, mem, MEM_CGROUP_PRESSURE_WIN, 0);
+}
+
+static int mem_cgroup_pressure_register_event(struct cgroup *cgrp,
+	struct cftype *cft, struct eventfd_ctx *eventfd, const char *args)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct mem_cgroup_pressure_event *event;
+	int level;
+
+	BUG_ON(MEMFILE_TYPE(cft->private) != _PRESSURE_TYPE);
+
+	for (level = 0; level < MEM_CGROUP_NR_PRESSURE_LEVELS; level++)
+		if (!strcmp(pressure_level_names[level], args))
+			break;
+	if (level == MEM_CGROUP_NR_PRESSURE_LEVELS)
+		return -EINVAL;
+
+	event = kmalloc(sizeof(*event), GFP_KERNEL);
+	if (!event)
+		return -ENOMEM;
+
+	event->eventfd = eventfd;
+	event->level = level;
+
+	mutex_lock(&memcg->pressure.events_lock);
+	list_add(&event->list, &memcg->pressure.events);
+	mutex_unlock(&memcg->pressure.events_lock);
+
+	return 0;
+}
+
+static void mem_cgroup_pressure_unregister_event(struct cgroup *cgrp,
+	struct cftype *cft, struct eventfd_ctx *eventfd)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	struct mem_cgroup_pressure_event *ev, *tmp;
+
+	BUG_ON(MEMFILE_TYPE(cft->private) != _PRESSURE_TYPE);
+
+	mutex_lock(&memcg->pressure.events_lock);
+	list_for_each_entry_safe(ev, tmp, &memcg->pressure.events, list) {
+		if (ev->eventfd == eventfd) {
+			list_del(&ev->list);
+			kfree(ev);
+		}
+	}
+	mutex_unlock(&memcg->pressure.events_lock);
+}
+
+static int mem_cgroup_pressure_level_read(struct cgroup *cgrp,
+	struct cftype *cft, struct seq_file *m)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	seq_printf(m, "%s\n", pressure_level_names[memcg->pressure.level]);
+	return 0;
+}
+
+static void mem_cgroup_pressure_init(struct mem_cgroup *mem)
+{
+	struct mem_cgroup_pressure *pr = &mem->pressure;
+
+	spin_lock_init(&pr->sr_lock);
+	mutex_init(&pr->events_lock);
+	INIT_LIST_HEAD(&pr->events);
+	INIT_WORK(&pr->work, mem_cgroup_pressure_work);
+}
+
 static int mem_cgroup_oom_control_read(struct cgroup *cgrp,
 	struct cftype *cft,  struct cgroup_map_cb *cb)
 {
@@ -4775,6 +5037,13 @@ static struct cftype mem_cgroup_files[] = {
 		.unregister_event = mem_cgroup_oom_unregister_event,
 		.private = MEMFILE_PRIVATE(_OOM_TYPE, OOM_CONTROL),
 	},
+	{
+		.name = "pressure_level",
+		.read_seq_string = mem_cgroup_pressure_level_read,
+		.register_event = mem_cgroup_pressure_register_event,
+		.unregister_event = mem_cgroup_pressure_unregister_event,
+		.private = MEMFILE_PRIVATE(_PRESSURE_TYPE, 0),
+	},
 #ifdef CONFIG_NUMA
 	{
 		.name = "numa_stat",
@@ -5039,6 +5308,7 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	mem->last_scanned_child = 0;
 	mem->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&mem->oom_notify);
+	mem_cgroup_pressure_init(mem);
 
 	if (parent)
 		mem->swappiness = get_swappiness(parent);
@@ -5064,6 +5334,9 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 {
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
 
+	/* Drop the reference taken when the work was queued */
+	if (cancel_work_sync(&mem->pressure.work))
+		mem_cgroup_put(mem);
 	mem_cgroup_put(mem);
 }
 
@@ -57,6 +57,8 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/debugfs.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1115,9 +1117,11 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	spinlock_t *ptl;
 	pte_t *start_pte;
 	pte_t *pte;
+	struct swap_free_batch swap_batch;
 
 again:
 	init_rss_vec(rss);
+	swap_batch.nr = 0;
 	start_pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	pte = start_pte;
 	arch_enter_lazy_mmu_mode();
@@ -1191,12 +1195,13 @@ again:
 
 			if (!non_swap_entry(entry))
 				rss[MM_SWAPENTS]--;
-			if (unlikely(!free_swap_and_cache(entry)))
+			if (unlikely(!swap_free_batch_add(&swap_batch, entry)))
 				print_bad_pte(vma, addr, ptent, NULL);
 		}
 		pte_clear_not_present_full(mm, addr, pte, tlb->fullmm);
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 
+	swap_free_batch_flush(&swap_batch);
 	add_mm_rss_vec(mm, rss);
 	arch_leave_lazy_mmu_mode();
 	pte_unmap_unlock(start_pte, ptl);
@@ -1229,13 +1234,16 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next-addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
+				/* truncation of page cache holds no mmap_sem */
+				VM_BUG_ON(!vma->vm_ops &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
 				split_huge_page_pmd(vma->vm_mm, pmd);
-			} else if (zap_huge_pmd(tlb, vma, pmd))
+			} else if (zap_huge_pmd(tlb, vma, pmd, addr))
 				continue;
 			/* fall through */
 		}
-		if (pmd_none_or_clear_bad(pmd))
+		/* a huge pmd may be faulted in meanwhile, if not truncating */
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 		cond_resched();
@@ -1483,6 +1491,12 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 			if (unlikely(pmd_trans_splitting(*pmd))) {
 				spin_unlock(&mm->page_table_lock);
 				wait_split_huge_page(vma->anon_vma, pmd);
+			} else if (flags & FOLL_MLOCK &&
+				   !PageAnon(pmd_page(*pmd))) {
+				/* mlock works on the ptes of page cache */
+				spin_unlock(&mm->page_table_lock);
+				split_huge_page_pmd(mm, pmd);
+				goto split_fallthrough;
 			} else {
 				page = follow_trans_huge_pmd(mm, address,
 							     pmd, flags);
@@ -2430,6 +2444,71 @@ static inline int pte_unmap_same(struct mm_struct *mm, pmd_t *pmd,
 	return same;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * A speculative fault holds no mmap_sem, so the vma may change and its
+ * page tables may be freed at any time, until the fault holds the page
+ * table lock of a vma which has not changed since the fault began:
+ * munmap, mprotect, mremap and khugepaged need that lock after changing
+ * the vma, and only free page tables after a TLB flush IPI, which waits
+ * for this CPU to enable interrupts again. The lock is only tried, as its
+ * holder may be waiting for that IPI.
+ */
+static bool pte_spinlock_speculative(struct mm_struct *mm,
+				     struct vm_area_struct *vma, pmd_t *pmd,
+				     unsigned int seq, spinlock_t **ptlp)
+{
+	spinlock_t *ptl;
+
+	local_irq_disable();
+	if (vma_has_changed(vma, seq))
+		goto out;
+	ptl = pte_lockptr(mm, pmd);
+	if (!spin_trylock(ptl))
+		goto out;
+	if (vma_has_changed(vma, seq)) {
+		spin_unlock(ptl);
+		goto out;
+	}
+	local_irq_enable();
+	*ptlp = ptl;
+	return true;
+out:
+	local_irq_enable();
+	return false;
+}
+#endif
+
+/*
+ * Take the page table lock for a fault. Fails only for a speculative
+ * fault, see above, which then has to undo what it did and return
+ * VM_FAULT_RETRY.
+ */
+static inline bool pte_spinlock(struct mm_struct *mm,
+				struct vm_area_struct *vma, pmd_t *pmd,
+				unsigned int flags, unsigned int seq,
+				spinlock_t **ptlp)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (flags & FAULT_FLAG_SPECULATIVE)
+		return pte_spinlock_speculative(mm, vma, pmd, seq, ptlp);
+#endif
+	*ptlp = pte_lockptr(mm, pmd);
+	spin_lock(*ptlp);
+	return true;
+}
+
+static inline bool pte_map_lock(struct mm_struct *mm,
+				struct vm_area_struct *vma, pmd_t *pmd,
+				unsigned long address, unsigned int flags,
+				unsigned int seq, pte_t **ptep, spinlock_t **ptlp)
+{
+	if (!pte_spinlock(mm, vma, pmd, flags, seq, ptlp))
+		return false;
+	*ptep = pte_offset_map(pmd, address);
+	return true;
+}
+
 static inline void cow_user_page(struct page *dst, struct page *src, unsigned long va, struct vm_area_struct *vma)
 {
 	/*
@@ -2473,10 +2552,12 @@ static inline void cow_user_page(struct page *dst, struct page *src, unsigned lo
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), with pte both mapped and locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
+ * A speculative fault (@seq) enters and returns without mmap_sem.
  */
 static int do_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		spinlock_t *ptl, pte_t orig_pte)
+		spinlock_t *ptl, pte_t orig_pte, unsigned int flags,
+		unsigned int seq)
 	__releases(ptl)
 {
 	struct page *old_page, *new_page;
@@ -2509,8 +2590,12 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			page_cache_get(old_page);
 			pte_unmap_unlock(page_table, ptl);
 			lock_page(old_page);
-			page_table = pte_offset_map_lock(mm, pmd, address,
-							 &ptl);
+			if (!pte_map_lock(mm, vma, pmd, address, flags, seq,
+					  &page_table, &ptl)) {
+				unlock_page(old_page);
+				page_cache_release(old_page);
+				return VM_FAULT_RETRY;
+			}
 			if (!pte_same(*page_table, orig_pte)) {
 				unlock_page(old_page);
 				goto unlock;
@@ -2665,7 +2750,14 @@ gotten:
 	/*
 	 * Re-check the pte - we dropped the lock
 	 */
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, pmd, address, flags, seq, &page_table,
+			  &ptl)) {
+		mem_cgroup_uncharge_page(new_page);
+		page_cache_release(new_page);
+		if (old_page)
+			page_cache_release(old_page);
+		return VM_FAULT_RETRY;
+	}
 	if (likely(pte_same(*page_table, orig_pte))) {
 		if (old_page) {
 			if (!PageAnon(old_page)) {
@@ -3012,7 +3104,8 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 
 	if (flags & FAULT_FLAG_WRITE) {
-		ret |= do_wp_page(mm, vma, address, page_table, pmd, ptl, pte);
+		ret |= do_wp_page(mm, vma, address, page_table, pmd, ptl, pte,
+				  flags, 0);
 		if (ret & VM_FAULT_ERROR)
 			ret &= VM_FAULT_ERROR;
 		goto out;
@@ -3079,7 +3172,7 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
  */
 static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags)
+		unsigned int flags, unsigned int seq)
 {
 	struct page *page;
 	spinlock_t *ptl;
@@ -3095,7 +3188,9 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
 						vma->vm_page_prot));
-		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		if (!pte_map_lock(mm, vma, pmd, address, flags, seq,
+				  &page_table, &ptl))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*page_table))
 			goto unlock;
 		goto setpte;
@@ -3116,7 +3211,12 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, pmd, address, flags, seq, &page_table,
+			  &ptl)) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*page_table))
 		goto release;
 
@@ -3140,6 +3240,121 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/*
+ * On a read fault of a file mapping, also map the uptodate page cache
+ * pages around the faulting address, up to fault_around_bytes aligned.
+ * Tunable through debugfs, PAGE_SIZE disables it.
+ */
+static unsigned long fault_around_bytes = 65536;
+
+#define FAULT_AROUND_BATCH	16
+
+static inline bool can_fault_around(struct vm_area_struct *vma)
+{
+	return fault_around_bytes > PAGE_SIZE &&
+		vma->vm_ops->fault == filemap_fault &&
+		!(vma->vm_flags & (VM_NONLINEAR | VM_RAND_READ));
+}
+
+/*
+ * Called with the pte lock held, after the pte for @address (@page_table)
+ * has been set up. Only pages which are already uptodate, and which we
+ * can lock without waiting, are mapped: the rest are left to be faulted
+ * in as usual, which also keeps readahead markers working.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *page_table, pgoff_t pgoff)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long nr = ACCESS_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+	struct page *pages[FAULT_AROUND_BATCH];
+	unsigned long start, end, addr;
+	pgoff_t start_index, index, end_index, max_index;
+	pte_t *start_pte, *pte;
+	int i, found;
+
+	start = max(address & ~(nr * PAGE_SIZE - 1), vma->vm_start);
+	start = max(start, address & PMD_MASK);
+	end = pmd_addr_end(start, min(start + nr * PAGE_SIZE, vma->vm_end));
+
+	start_pte = page_table - ((address - start) >> PAGE_SHIFT);
+	start_index = pgoff - ((address - start) >> PAGE_SHIFT);
+	end_index = start_index + ((end - start) >> PAGE_SHIFT);
+	max_index = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_CACHE_SIZE);
+	if (end_index > max_index)
+		end_index = max_index;
+
+	index = start_index;
+	while (index < end_index) {
+		found = find_get_pages(mapping, index,
+				min_t(unsigned long, end_index - index,
+				      FAULT_AROUND_BATCH), pages);
+		if (!found)
+			break;
+
+		for (i = 0; i < found; i++) {
+			struct page *page = pages[i];
+
+			index = max(index, page->index + 1);
+			if (page->index >= end_index || page->index == pgoff)
+				goto skip;
+			pte = start_pte + (page->index - start_index);
+			if (!pte_none(*pte))
+				goto skip;
+			if (PageReadahead(page) || PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+			if (page->mapping != mapping || !PageUptodate(page)) {
+				unlock_page(page);
+				goto skip;
+			}
+
+			addr = start + ((page->index - start_index) << PAGE_SHIFT);
+			flush_icache_page(vma, page);
+			inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+			page_add_file_rmap(page);
+			set_pte_at(vma->vm_mm, addr, pte,
+				   mk_pte(page, vma->vm_page_prot));
+			update_mmu_cache(vma, addr, pte);
+			unlock_page(page);
+			/* The page reference now belongs to the pte. */
+			continue;
+skip:
+			page_cache_release(page);
+		}
+	}
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			    &fault_around_bytes_fops);
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3155,7 +3370,8 @@ oom:
  */
 static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pmd_t *pmd,
-		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
+		pgoff_t pgoff, unsigned int flags, pte_t orig_pte,
+		unsigned int seq)
 {
 	pte_t *page_table;
 	spinlock_t *ptl;
@@ -3250,7 +3466,18 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	}
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, pmd, address, flags, seq, &page_table,
+			  &ptl)) {
+		/* undone as if the pte had changed, see below */
+		if (charged)
+			mem_cgroup_uncharge_page(page);
+		if (anon)
+			page_cache_release(page);
+		else
+			anon = 1;
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
 
 	/*
 	 * This silly early PAGE_DIRTY setting removes a race
@@ -3283,6 +3510,9 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 		/* no need to invalidate: a not-present page won't be cached */
 		update_mmu_cache(vma, address, page_table);
+
+		if (!(flags & FAULT_FLAG_WRITE) && can_fault_around(vma))
+			do_fault_around(vma, address, page_table, pgoff);
 	} else {
 		if (charged)
 			mem_cgroup_uncharge_page(page);
@@ -3328,13 +3558,13 @@ unwritable_page:
 
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags, pte_t orig_pte)
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
 	pte_unmap(page_table);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, seq);
 }
 
 /*
@@ -3366,7 +3596,7 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 
 	pgoff = pte_to_pgoff(orig_pte);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, 0);
 }
 
 /*
@@ -3382,9 +3612,10 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
-int handle_pte_fault(struct mm_struct *mm,
-		     struct vm_area_struct *vma, unsigned long address,
-		     pte_t *pte, pmd_t *pmd, unsigned int flags)
+static int __handle_pte_fault(struct mm_struct *mm,
+			      struct vm_area_struct *vma, unsigned long address,
+			      pte_t *pte, pmd_t *pmd, unsigned int flags,
+			      unsigned int seq)
 {
 	pte_t entry;
 	spinlock_t *ptl;
@@ -3395,10 +3626,15 @@ int handle_pte_fault(struct mm_struct *mm,
 			if (vma->vm_ops) {
 				if (likely(vma->vm_ops->fault))
 					return do_linear_fault(mm, vma, address,
-						pte, pmd, flags, entry);
+						pte, pmd, flags, entry, seq);
 			}
 			return do_anonymous_page(mm, vma, address,
-						 pte, pmd, flags);
+						 pte, pmd, flags, seq);
+		}
+		/* swap-in and nonlinear faults sleep with the pte unlocked */
+		if (flags & FAULT_FLAG_SPECULATIVE) {
+			pte_unmap(pte);
+			return VM_FAULT_RETRY;
 		}
 		if (pte_file(entry))
 			return do_nonlinear_fault(mm, vma, address,
@@ -3407,14 +3643,16 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
-	ptl = pte_lockptr(mm, pmd);
-	spin_lock(ptl);
+	if (!pte_spinlock(mm, vma, pmd, flags, seq, &ptl)) {
+		pte_unmap(pte);
+		return VM_FAULT_RETRY;
+	}
 	if (unlikely(!pte_same(*pte, entry)))
 		goto unlock;
 	if (flags & FAULT_FLAG_WRITE) {
 		if (!pte_write(entry))
 			return do_wp_page(mm, vma, address,
-					pte, pmd, ptl, entry);
+					pte, pmd, ptl, entry, flags, seq);
 		entry = pte_mkdirty(entry);
 	}
 	entry = pte_mkyoung(entry);
@@ -3435,6 +3673,13 @@ unlock:
 	return 0;
 }
 
+int handle_pte_fault(struct mm_struct *mm,
+		     struct vm_area_struct *vma, unsigned long address,
+		     pte_t *pte, pmd_t *pmd, unsigned int flags)
+{
+	return __handle_pte_fault(mm, vma, address, pte, pmd, flags, 0);
+}
+
 /*
  * By the time we get here, we already hold the mm semaphore
  */
@@ -3464,7 +3709,12 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) && vma_has_file_huge_pmd(vma)) {
+		int ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	} else if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
 		if (!vma->vm_ops)
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
@@ -3474,10 +3724,14 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		if (pmd_trans_huge(orig_pmd)) {
 			if (flags & FAULT_FLAG_WRITE &&
 			    !pmd_write(orig_pmd) &&
-			    !pmd_trans_splitting(orig_pmd))
-				return do_huge_pmd_wp_page(mm, vma, address,
-							   pmd, orig_pmd);
-			return 0;
+			    !pmd_trans_splitting(orig_pmd)) {
+				if (PageAnon(pmd_page(orig_pmd)))
+					return do_huge_pmd_wp_page(mm, vma,
+							address, pmd, orig_pmd);
+				/* page cache: let do_wp_page() see the pte */
+				split_huge_page_pmd(mm, pmd);
+			} else
+				return 0;
 		}
 	}
 
@@ -3488,8 +3742,11 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	if (unlikely(pmd_none(*pmd)) && __pte_alloc(mm, vma, pmd, address))
 		return VM_FAULT_OOM;
-	/* if an huge pmd materialized from under us just retry later */
-	if (unlikely(pmd_trans_huge(*pmd)))
+	/*
+	 * If an huge pmd materialized from under us just retry later, and
+	 * likewise if a huge pmd of page cache was truncated meanwhile.
+	 */
+	if (unlikely(pmd_none_or_trans_huge_or_clear_bad(pmd)))
 		return 0;
 	/*
 	 * A regular pmd is established and it can't morph into a huge pmd
@@ -3502,6 +3759,128 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Only faults which can be completed under the page table lock of an
+ * existing page table, without sleeping on anything the vma owns, are
+ * handled speculatively: everything else is left to handle_mm_fault().
+ */
+static bool vma_can_speculate(struct vm_area_struct *vma,
+			      unsigned long address, unsigned int flags)
+{
+	if (address < vma->vm_start || address >= vma->vm_end)
+		return false;
+	/* stack expansion changes the vma, mlock faults pages in itself */
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_LOCKED |
+			     VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO))
+		return false;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			return false;
+		/* anon_vma_prepare() takes mmap_sem's place for the first COW */
+		if (!(vma->vm_flags & VM_SHARED) && !vma->anon_vma)
+			return false;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		return false;
+	if (!vma->vm_ops)
+		return true;
+	/* ->fault and ->page_mkwrite of other mappings may rely on mmap_sem */
+	if (vma->vm_ops->fault != filemap_fault && !vma_is_shmem(vma))
+		return false;
+	if ((flags & FAULT_FLAG_WRITE) && (vma->vm_flags & VM_SHARED) &&
+	    vma->vm_ops->page_mkwrite)
+		return false;
+	return true;
+}
+
+/**
+ * handle_speculative_fault - handle a user page fault without mmap_sem
+ * @mm:		mm_struct of the faulting task
+ * @address:	faulting user address
+ * @flags:	FAULT_FLAG_xxx flags
+ *
+ * Looks the vma up under mm->mm_rb_lock instead of mmap_sem and handles
+ * the fault against its existing page tables, validating vma->vm_sequence
+ * whenever the page table lock is taken. Returns VM_FAULT_RETRY if the
+ * fault could not be handled this way, in which case nothing was done and
+ * the caller must take mmap_sem and call handle_mm_fault(); any other
+ * return value is that of handle_mm_fault().
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte;
+	int ret;
+
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_RETRY_NOWAIT |
+		   FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		goto out;
+
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out_put;
+	if (!vma_can_speculate(vma, address, flags))
+		goto out_put;
+
+	/*
+	 * Page tables are only freed after a TLB flush IPI, so with
+	 * interrupts disabled the walk is safe against a concurrent munmap
+	 * or khugepaged, as long as the vma is found unchanged afterwards.
+	 * Missing or huge pmds are left to handle_mm_fault().
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out_walk;
+	if (vma_has_changed(vma, seq))
+		goto out_walk;
+	pte = pte_offset_map(&pmdval, address);
+	local_irq_enable();
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	ret = __handle_pte_fault(mm, vma, address, pte, pmd, flags, seq);
+	put_vma(vma);
+	if (ret & (VM_FAULT_RETRY | VM_FAULT_ERROR)) {
+		count_vm_event(SPF_ABORT);
+		return ret;
+	}
+
+	count_vm_event(PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	count_vm_event(SPF_FAULT);
+	return ret;
+
+out_walk:
+	local_irq_enable();
+out_put:
+	put_vma(vma);
+out:
+	count_vm_event(SPF_ABORT);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -0,0 +1,190 @@
+/*
+ * mm/page_alloc_bench.c
+ *
+ * Overview:
+ *   Page allocator microbenchmark for the per-cpu page lists
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Description:
+ *
+ * For every order up to PAGE_ALLOC_COSTLY_ORDER and for 1, 2, 4, ... up to
+ * all online CPUs, one kthread per CPU repeatedly allocates a handful of
+ * pages of that order and frees them again. The average cost of an
+ * allocation plus free is reported, together with the share of high-order
+ * allocations that had to refill the per-cpu lists and so took
+ * zone->lock. Load the module once with vm.percpu_pagelist_order at its
+ * default and once with it set to 0 to compare; CONFIG_LOCK_STAT shows the
+ * zone->lock contention directly in /proc/lock_stat.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/vmstat.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/hrtimer.h>
+
+static unsigned int loops = 20000;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "Allocate/free rounds per thread (default 20000)");
+
+static unsigned int burst = 8;
+module_param(burst, uint, 0444);
+MODULE_PARM_DESC(burst, "Pages held at once per round, at most 64 (default 8)");
+
+#define MAX_BURST	64
+
+struct bench_thread {
+	unsigned int order;
+	u64 ns;
+	unsigned long failed;
+};
+
+static DEFINE_PER_CPU(struct bench_thread, bench_threads);
+static DECLARE_WAIT_QUEUE_HEAD(bench_start_wait);
+static DECLARE_COMPLETION(bench_done);
+static atomic_t bench_running;
+static int bench_go;
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	struct page *pages[MAX_BURST];
+	unsigned int i, j;
+	ktime_t start;
+
+	wait_event(bench_start_wait, bench_go);
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < burst; j++) {
+			pages[j] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+					       bt->order);
+			if (!pages[j])
+				bt->failed++;
+		}
+		for (j = 0; j < burst; j++)
+			if (pages[j])
+				__free_pages(pages[j], bt->order);
+		if (need_resched())
+			cond_resched();
+	}
+	bt->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+	return 0;
+}
+
+#ifdef CONFIG_VM_EVENT_COUNTERS
+static void bench_read_events(unsigned long *hits, unsigned long *refills)
+{
+	static unsigned long events[NR_VM_EVENT_ITEMS];
+
+	all_vm_events(events);
+	*hits = events[PGALLOC_PCP_HIGHORDER];
+	*refills = events[PGALLOC_PCP_HIGHORDER_REFILL];
+}
+#else
+static void bench_read_events(unsigned long *hits, unsigned long *refills)
+{
+	*hits = *refills = 0;
+}
+#endif
+
+static int __init bench_run(unsigned int order, unsigned int nr_threads)
+{
+	unsigned long hits, refills, hits0, refills0, failed = 0;
+	unsigned int cpu, started = 0;
+	u64 ns = 0;
+
+	bench_go = 0;
+	INIT_COMPLETION(bench_done);
+	atomic_set(&bench_running, nr_threads);
+
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &per_cpu(bench_threads, cpu);
+		struct task_struct *tsk;
+
+		if (started == nr_threads)
+			break;
+		memset(bt, 0, sizeof(*bt));
+		bt->order = order;
+		tsk = kthread_create(bench_thread_fn, bt, "pa_bench/%u", cpu);
+		if (IS_ERR(tsk)) {
+			/* let the threads already created finish */
+			atomic_sub(nr_threads - started, &bench_running);
+			nr_threads = started;
+			break;
+		}
+		kthread_bind(tsk, cpu);
+		wake_up_process(tsk);
+		started++;
+	}
+	if (!started)
+		return -ENOMEM;
+
+	bench_read_events(&hits0, &refills0);
+	bench_go = 1;
+	wake_up_all(&bench_start_wait);
+	wait_for_completion(&bench_done);
+	bench_read_events(&hits, &refills);
+
+	started = 0;
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &per_cpu(bench_threads, cpu);
+
+		if (started++ == nr_threads)
+			break;
+		ns += bt->ns;
+		failed += bt->failed;
+	}
+
+	hits -= hits0;
+	refills -= refills0;
+	pr_info("page_alloc_bench: order %u threads %2u: %6llu ns/page, "
+		"%lu pcp hits, %lu refills, %lu failed\n", order, nr_threads,
+		div64_u64(ns, (u64)nr_threads * loops * burst), hits, refills,
+		failed);
+	return 0;
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned int order, nr_threads, max_threads = num_online_cpus();
+	int err = 0;
+
+	if (!loops || !burst || burst > MAX_BURST)
+		return -EINVAL;
+
+	pr_info("page_alloc_bench: %u loops of %u pages per thread\n",
+		loops, burst);
+	for (order = 0; order <= PAGE_ALLOC_COSTLY_ORDER && !err; order++) {
+		for (nr_threads = 1; !err; nr_threads *= 2) {
+			nr_threads = min(nr_threads, max_threads);
+			err = bench_run(order, nr_threads);
+			if (nr_threads == max_threads)
+				break;
+		}
+	}
+
+	/* Nothing to keep loaded, the results are in the log */
+	return err ? err : -EAGAIN;
+}
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+
+module_init(page_alloc_bench_init);
+module_exit(page_alloc_bench_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator per-cpu list microbenchmark");
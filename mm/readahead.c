@@ -17,6 +17,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/swap.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -122,13 +123,12 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
+	nr_pages = add_to_page_cache_list(mapping, pages, GFP_KERNEL);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_to_page(pages);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
-		}
+		lru_cache_add_page_cache(page);
+		mapping->a_ops->readpage(filp, page);
 		page_cache_release(page);
 	}
 	ret = 0;
@@ -655,7 +655,7 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 	struct mm_struct *mm = vma->vm_mm;
 	int referenced = 0;
 
-	if (unlikely(PageTransHuge(page))) {
+	if (unlikely(PageTransHuge(page) || vma_has_file_huge_pmd(vma))) {
 		pmd_t *pmd;
 
 		spin_lock(&mm->page_table_lock);
@@ -667,6 +667,9 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 					     PAGE_CHECK_ADDRESS_PMD_FLAG);
 		if (!pmd) {
 			spin_unlock(&mm->page_table_lock);
+			/* page cache may be mapped by ptes all the same */
+			if (!PageTransHuge(page))
+				goto pte;
 			goto out;
 		}
 
@@ -677,13 +680,19 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 			goto out;
 		}
 
-		/* go ahead even if the pmd is pmd_trans_splitting() */
-		if (pmdp_clear_flush_young_notify(vma, address, pmd))
+		/*
+		 * go ahead even if the pmd is pmd_trans_splitting(). For
+		 * page cache the pmd stands for HPAGE_PMD_NR separate pages,
+		 * and the first of them to be checked takes the young bit.
+		 */
+		if (pmdp_clear_flush_young_notify(vma, address & HPAGE_PMD_MASK,
+						  pmd))
 			referenced++;
 		spin_unlock(&mm->page_table_lock);
 	} else {
 		pte_t *pte;
 		spinlock_t *ptl;
+pte:
 
 		/*
 		 * rmap might return false positives; we must filter
@@ -1176,6 +1185,10 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	/* page cache mapped by a huge pmd is unmapped one pte at a time */
+	if (vma_has_file_huge_pmd(vma) && !PageAnon(page))
+		split_file_huge_pmd(page, vma, address);
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
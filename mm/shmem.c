@@ -50,6 +50,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/backing-dev.h>
 #include <linux/shmem_fs.h>
 #include <linux/writeback.h>
+#include <linux/pagevec.h>
 #include <linux/blkdev.h>
 #include <linux/security.h>
 #include <linux/swapops.h>
@@ -214,6 +215,13 @@ static inline int shmem_acct_block(unsigned long flags)
 		security_vm_enough_memory_kern(VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
+static inline int shmem_acct_blocks(unsigned long flags, long pages)
+{
+	return (flags & VM_NORESERVE) ?
+		security_vm_enough_memory_kern(pages * VM_ACCT(PAGE_CACHE_SIZE)) :
+		0;
+}
+
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
 {
 	if (flags & VM_NORESERVE)
@@ -1200,6 +1208,23 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long idx)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = idx;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, idx);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0,
+			       numa_node_id());
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *p)
@@ -1218,6 +1243,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, unsigned long idx)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -1555,6 +1588,382 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret | VM_FAULT_LOCKED;
 }
 
+#if defined(CONFIG_TMPFS) || defined(CONFIG_TRANSPARENT_HUGEPAGE)
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+#endif
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	default:
+		return "never";
+	}
+}
+#endif
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/**
+ * shmem_set_huge - choose huge pmd mappings for a single file
+ * @file:	the tmpfs file
+ * @huge:	SHMEM_HUGE_ALWAYS, SHMEM_HUGE_NEVER, or SHMEM_HUGE_DEFAULT to
+ *		follow the huge= setting of its mount
+ *
+ * Overrides the mount for faults from now on; what is mapped already
+ * stays as it is.
+ */
+int shmem_set_huge(struct file *file, int huge)
+{
+	struct inode *inode = file->f_path.dentry->d_inode;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+
+	if (file->f_op != &shmem_file_operations)
+		return -EINVAL;
+	if (huge != SHMEM_HUGE_ALWAYS && huge != SHMEM_HUGE_NEVER &&
+	    huge != SHMEM_HUGE_DEFAULT)
+		return -EINVAL;
+
+	spin_lock(&info->lock);
+	info->flags &= ~(VM_HUGEPAGE | VM_NOHUGEPAGE);
+	if (huge == SHMEM_HUGE_ALWAYS)
+		info->flags |= VM_HUGEPAGE;
+	else if (huge == SHMEM_HUGE_NEVER)
+		info->flags |= VM_NOHUGEPAGE;
+	spin_unlock(&info->lock);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(shmem_set_huge);
+
+/*
+ * A huge pmd maps HPAGE_PMD_NR ordinary pages of the page cache which are
+ * physically contiguous, naturally aligned, and hold an aligned run of
+ * indexes. They come from one split high order allocation, and are
+ * reclaimed, swapped, migrated and truncated one by one like any other
+ * tmpfs page: the pmd is replaced by a page table first (see
+ * split_file_huge_pmd()), and later faults fall back to ptes once the
+ * block is broken up.
+ */
+static bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long flags = SHMEM_I(inode)->flags;
+
+	/* private mappings would have to COW; mlock and nonlinear need ptes */
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    vma->vm_flags & (VM_LOCKED | VM_NONLINEAR | VM_NOHUGEPAGE))
+		return false;
+	if (flags & VM_NOHUGEPAGE)
+		return false;
+	if (flags & VM_HUGEPAGE)
+		return true;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_ADVISE:
+		return vma->vm_flags & VM_HUGEPAGE;
+	default:
+		return false;
+	}
+}
+
+static inline bool shmem_huge_beyond_eof(struct inode *inode, pgoff_t index)
+{
+	return ((loff_t)(index + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+		i_size_read(inode);
+}
+
+/*
+ * Find a block of pages left by shmem_alloc_huge_block() at @index.
+ * Returns its first page with all HPAGE_PMD_NR of them referenced and
+ * locked, or NULL.
+ */
+static struct page *shmem_find_huge_block(struct address_space *mapping,
+					  pgoff_t index)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	struct page *head;
+	unsigned int nr, found, i;
+
+	head = find_get_page(mapping, index);
+	if (!head)
+		return NULL;
+	nr = 1;
+	/* cheap test first, most files are not laid out in blocks */
+	if (page_to_pfn(head) & (HPAGE_PMD_NR - 1))
+		goto release;
+
+	while (nr < HPAGE_PMD_NR) {
+		found = find_get_pages_contig(mapping, index + nr,
+				min_t(unsigned int, PAGEVEC_SIZE,
+				      HPAGE_PMD_NR - nr), pages);
+		for (i = 0; i < found && pages[i] == head + nr; i++)
+			nr++;
+		if (i < found || !found) {
+			while (i < found)
+				page_cache_release(pages[i++]);
+			goto release;
+		}
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *page = head + i;
+
+		if (!trylock_page(page))
+			goto unlock;
+		if (page->mapping != mapping || page->index != index + i ||
+		    !PageUptodate(page)) {
+			unlock_page(page);
+			goto unlock;
+		}
+	}
+	return head;
+
+unlock:
+	while (i--)
+		unlock_page(head + i);
+release:
+	while (nr--)
+		page_cache_release(head + nr);
+	return NULL;
+}
+
+/*
+ * Allocate a block of pages for the hole at @index, as shmem_getpage()
+ * would one page at a time. Returns its first page with all HPAGE_PMD_NR
+ * of them referenced, locked and uptodate, or NULL for the caller to fall
+ * back to ptes.
+ */
+static struct page *shmem_alloc_huge_block(struct vm_area_struct *vma,
+					   unsigned long haddr,
+					   struct inode *inode, pgoff_t index)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	struct page *head, *page, *next;
+	swp_entry_t *entry;
+	LIST_HEAD(pages);
+	unsigned int i;
+	int nr, eof;
+	gfp_t gfp;
+
+	/* only a hole will do: no page of the block may be cached yet */
+	if (find_get_pages(mapping, index, 1, &page)) {
+		pgoff_t found = page->index;
+
+		page_cache_release(page);
+		if (found < index + HPAGE_PMD_NR)
+			return NULL;
+	}
+
+	spin_lock(&info->lock);
+	shmem_recalc_inode(inode);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		swp_entry_t swap;
+
+		entry = shmem_swp_alloc(info, index + i, SGP_CACHE);
+		if (IS_ERR(entry))
+			goto unlock;
+		swap = *entry;
+		shmem_swp_unmap(entry);
+		if (swap.val)
+			goto unlock;
+	}
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0 ||
+		    shmem_acct_blocks(info->flags, HPAGE_PMD_NR))
+			goto unlock;
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+		spin_lock(&inode->i_lock);
+		inode->i_blocks += HPAGE_PMD_NR * BLOCKS_PER_PAGE;
+		spin_unlock(&inode->i_lock);
+	} else if (shmem_acct_blocks(info->flags, HPAGE_PMD_NR))
+		goto unlock;
+	spin_unlock(&info->lock);
+
+	gfp = mapping_gfp_mask(mapping) | __GFP_NOMEMALLOC | __GFP_NORETRY |
+		__GFP_NOWARN | __GFP_NO_KSWAPD;
+	if (!transparent_hugepage_defrag(vma))
+		gfp &= ~__GFP_WAIT;
+	head = shmem_alloc_hugepage(gfp, info, index);
+	if (!head) {
+		count_vm_event(THP_FILE_FALLBACK);
+		shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+		shmem_free_blocks(inode, HPAGE_PMD_NR);
+		return NULL;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+
+	clear_huge_page(head, haddr, HPAGE_PMD_NR);
+	split_page(head, HPAGE_PMD_ORDER);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		page->index = index + i;
+		list_add(&page->lru, &pages);
+	}
+	nr = add_to_page_cache_list(mapping, &pages, GFP_KERNEL);
+
+	/*
+	 * As in shmem_getpage(): the block is accounted to the inode, and
+	 * shmem_recalc_inode() gives back what did not make it. The pages
+	 * stay !Uptodate, so nobody reads them, until it is known that no
+	 * index was swapped out meanwhile and the file still covers them.
+	 */
+	spin_lock(&info->lock);
+	info->alloced += HPAGE_PMD_NR;
+	info->flags |= SHMEM_PAGEIN;
+	eof = shmem_huge_beyond_eof(inode, index);
+	list_for_each_entry(page, &pages, lru) {
+		bool stale = eof;
+
+		if (!stale) {
+			entry = shmem_swp_entry(info, page->index, NULL);
+			if (entry) {
+				stale = entry->val != 0;
+				shmem_swp_unmap(entry);
+			}
+		}
+		if (stale)
+			nr--;
+		else
+			SetPageUptodate(page);
+	}
+	spin_unlock(&info->lock);
+
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		list_del(&page->lru);
+		if (!PageUptodate(page)) {
+			delete_from_page_cache(page);
+			unlock_page(page);
+			page_cache_release(page);
+			continue;
+		}
+		lru_cache_add_page_cache(page);
+		/* some index was taken: keep the others, as small pages */
+		if (nr < HPAGE_PMD_NR) {
+			unlock_page(page);
+			page_cache_release(page);
+		}
+	}
+	return nr == HPAGE_PMD_NR ? head : NULL;
+
+unlock:
+	spin_unlock(&info->lock);
+	return NULL;
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *head;
+	pgoff_t index;
+	int error, i;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	index = linear_page_index(vma, haddr);
+	if (index & (HPAGE_PMD_NR - 1) || !shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+	if (shmem_huge_beyond_eof(inode, index))
+		return VM_FAULT_FALLBACK;
+
+	head = shmem_find_huge_block(inode->i_mapping, index);
+	if (!head)
+		head = shmem_alloc_huge_block(vma, haddr, inode, index);
+	if (!head)
+		return VM_FAULT_FALLBACK;
+
+	/* the pages are locked now: recheck against truncation */
+	if (shmem_huge_beyond_eof(inode, index))
+		error = -EINVAL;
+	else
+		error = map_file_huge_pmd(vma, haddr, pmd, head);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		unlock_page(head + i);
+		if (error)
+			page_cache_release(head + i);
+	}
+
+	switch (error) {
+	case 0:
+		if (flags & FAULT_FLAG_WRITE)
+			file_update_time(vma->vm_file);
+		return 0;
+	case -ENOMEM:
+		return VM_FAULT_OOM;
+	case -EAGAIN:
+		/* raced with another fault: retry */
+		return 0;
+	default:
+		return VM_FAULT_FALLBACK;
+	}
+}
+
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int huge = SHMEM_SB(shm_mnt->mnt_sb)->huge;
+	int values[] = { SHMEM_HUGE_ALWAYS, SHMEM_HUGE_ADVISE,
+			 SHMEM_HUGE_NEVER };
+	int i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = values[i] == huge ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt, shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge < 0)
+		return huge;
+	SHMEM_SB(shm_mnt->mnt_sb)->huge = huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+int shmem_set_huge(struct file *file, int huge)
+{
+	return 0;
+}
+EXPORT_SYMBOL_GPL(shmem_set_huge);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *new)
 {
@@ -1607,6 +2016,12 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+/* Whether @vma maps a tmpfs file, shared anonymous memory or SysV shm */
+bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return vma->vm_ops == &shmem_vm_ops;
+}
+
 static struct inode *shmem_get_inode(struct super_block *sb, const struct inode *dir,
 				     int mode, dev_t dev, unsigned long flags)
 {
@@ -2477,6 +2892,12 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			if (huge < 0)
+				goto bad_val;
+			sbinfo->huge = huge;
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2523,6 +2944,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2546,6 +2968,8 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2773,6 +3197,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2915,6 +3342,18 @@ void shmem_truncate_range(struct inode *inode, loff_t start, loff_t end)
 }
 EXPORT_SYMBOL_GPL(shmem_truncate_range);
 
+int shmem_set_huge(struct file *file, int huge)
+{
+	return 0;
+}
+EXPORT_SYMBOL_GPL(shmem_set_huge);
+
+/* ramfs backed "shmem" uses generic_file_vm_ops, see below */
+bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return false;
+}
+
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 /**
  * mem_cgroup_get_shmem_target - find a page or entry assigned to the shmem file
@@ -75,6 +75,12 @@
  * SLUB assigns one slab for allocation to each processor.
  * Allocations only occur from these slabs called cpu slabs.
  *
+ * Each processor also keeps a short list of frozen partial slabs. A slab
+ * that regains free objects is put there instead of on the node partial
+ * list, and the list is refilled from the node partial list several slabs
+ * at a time. Both amortize the list_lock over many slabs. The list is
+ * only touched by its processor with interrupts disabled.
+ *
  * Slabs with free elements are kept on a partial list and during regular
  * operations no list for full slabs is used. If an object in a full slab is
  * freed then the slab will show up again on the partial lists.
@@ -97,11 +103,12 @@
  * 			when the slab is no longer needed.
  *
  * 			One use of this flag is to mark slabs that are
- * 			used for allocations. Then such a slab becomes a cpu
- * 			slab. The cpu slab may be equipped with an additional
- * 			freelist that allows lockless access to
- * 			free objects in addition to the regular freelist
- * 			that requires the slab lock.
+ * 			used for allocations or sit on a cpu partial
+ * 			list. Then such a slab belongs to a cpu. The cpu
+ * 			slab may be equipped with an additional freelist
+ * 			that allows lockless access to free objects in
+ * 			addition to the regular freelist that requires
+ * 			the slab lock.
  *
  * PageError		Slab requires special handling due to debug
  * 			options set. This moves	slab handling out of
@@ -1420,12 +1427,23 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 	return 0;
 }
 
+static inline int kmem_cache_has_cpu_partial(struct kmem_cache *s)
+{
+	return s->cpu_partial && !kmem_cache_debug(s);
+}
+
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * If c is given, further slabs are frozen and moved to the cpu partial
+ * list of c under the same list_lock until it holds about half of
+ * s->cpu_partial free objects.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	struct page *page = NULL, *page2, *t;
+	int available = 0;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1437,11 +1455,27 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page2, t, &n->partial, lru) {
+		if (!lock_and_freeze_slab(n, page2))
+			continue;
+
+		if (!page) {
+			/* The new cpu slab is returned locked */
+			page = page2;
+			if (!c || !kmem_cache_has_cpu_partial(s))
+				break;
+			continue;
+		}
+
+		available += page2->objects - page2->inuse;
+		list_add_tail(&page2->lru, &c->partial);
+		slab_unlock(page2);
+		stat(s, CPU_PARTIAL_NODE);
+		if (available > s->cpu_partial / 2)
+			break;
+	}
+	if (c)
+		c->partial_objects += available;
 	spin_unlock(&n->list_lock);
 	return page;
 }
@@ -1489,7 +1523,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n, NULL);
 			if (page) {
 				put_mems_allowed();
 				return page;
@@ -1504,12 +1538,13 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 /*
  * Get a partial page, lock it and return it.
  */
-static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
+static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node,
+				struct kmem_cache_cpu *c)
 {
 	struct page *page;
 	int searchnode = (node == NUMA_NO_NODE) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode), c);
 	if (page || node != NUMA_NO_NODE)
 		return page;
 
@@ -1626,8 +1661,12 @@ void init_kmem_cache_cpus(struct kmem_cache *s)
 {
 	int cpu;
 
-	for_each_possible_cpu(cpu)
-		per_cpu_ptr(s->cpu_slab, cpu)->tid = init_tid(cpu);
+	for_each_possible_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		c->tid = init_tid(cpu);
+		INIT_LIST_HEAD(&c->partial);
+	}
 }
 /*
  * Remove the cpu slab
@@ -1664,6 +1703,77 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	unfreeze_slab(s, page, tail);
 }
 
+/*
+ * Return the frozen slabs on the cpu partial list to the node partial
+ * lists. The list_lock of a node is kept across consecutive slabs of that
+ * node; the slab lock of the next slab is only trylocked under it to keep
+ * the lock order, if that fails the list_lock is dropped and retaken.
+ * Empty slabs beyond min_partial are freed.
+ *
+ * Interrupts must be disabled.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_node *n = NULL, *n2;
+	struct page *page, *t;
+	LIST_HEAD(discard);
+
+	list_for_each_entry_safe(page, t, &c->partial, lru) {
+		list_del(&page->lru);
+
+		n2 = get_node(s, page_to_nid(page));
+		if (n && (n != n2 || !slab_trylock(page))) {
+			spin_unlock(&n->list_lock);
+			n = NULL;
+		}
+		if (!n) {
+			slab_lock(page);
+			n = n2;
+			spin_lock(&n->list_lock);
+		}
+
+		__ClearPageSlubFrozen(page);
+		if (!page->inuse && n->nr_partial >= s->min_partial) {
+			list_add(&page->lru, &discard);
+			stat(s, DEACTIVATE_EMPTY);
+		} else {
+			n->nr_partial++;
+			list_add_tail(&page->lru, &n->partial);
+			stat(s, DEACTIVATE_TO_TAIL);
+		}
+		slab_unlock(page);
+	}
+	if (n)
+		spin_unlock(&n->list_lock);
+	c->partial_objects = 0;
+
+	list_for_each_entry_safe(page, t, &discard, lru) {
+		list_del(&page->lru);
+		stat(s, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
+/*
+ * Put a slab that was just frozen by a free onto the cpu partial list of
+ * this processor. If the list already holds s->cpu_partial free objects it
+ * is drained to the node lists first.
+ *
+ * Interrupts must be disabled.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_cpu *c = __this_cpu_ptr(s->cpu_slab);
+
+	if (c->partial_objects >= s->cpu_partial) {
+		unfreeze_partials(s, c);
+		stat(s, CPU_PARTIAL_DRAIN);
+	}
+	list_add(&page->lru, &c->partial);
+	c->partial_objects += page->objects - page->inuse;
+	stat(s, CPU_PARTIAL_FREE);
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1680,8 +1790,11 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
-		flush_slab(s, c);
+	if (likely(c)) {
+		if (c->page)
+			flush_slab(s, c);
+		unfreeze_partials(s, c);
+	}
 }
 
 static void flush_cpu_slab(void *d)
@@ -1847,7 +1960,22 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
-	page = get_partial(s, gfpflags, node);
+	if (!list_empty(&c->partial)) {
+		page = list_first_entry(&c->partial, struct page, lru);
+		if (node == NUMA_NO_NODE || page_to_nid(page) == node) {
+			list_del(&page->lru);
+			c->partial_objects -= page->objects - page->inuse;
+			if (list_empty(&c->partial) || c->partial_objects < 0)
+				c->partial_objects = 0;
+			stat(s, CPU_PARTIAL_ALLOC);
+			slab_lock(page);
+			c->node = page_to_nid(page);
+			c->page = page;
+			goto load_freelist;
+		}
+	}
+
+	page = get_partial(s, gfpflags, node, c);
 	if (page) {
 		stat(s, ALLOC_FROM_PARTIAL);
 		c->node = page_to_nid(page);
@@ -2061,9 +2189,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then add it, preferably to the partial list of this cpu.
 	 */
 	if (unlikely(!prior)) {
+		if (kmem_cache_has_cpu_partial(s)) {
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page);
+			local_irq_restore(flags);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(s, FREE_ADD_PARTIAL);
 	}
@@ -2600,6 +2735,23 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * cpu_partial determines the free objects kept on the cpu partial
+	 * lists of a processor. Fewer for large objects so that the memory
+	 * held per cpu stays bounded.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4146,6 +4298,29 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects && kmem_cache_debug(s))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4172,6 +4347,33 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long objects = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu) {
+		int x = per_cpu_ptr(s->cpu_slab, cpu)->partial_objects;
+
+		if (x > 0)
+			objects += x;
+	}
+
+	len = sprintf(buf, "%lu", objects);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		int x = per_cpu_ptr(s->cpu_slab, cpu)->partial_objects;
+
+		if (x > 0 && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d", cpu, x);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4492,6 +4694,10 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4500,10 +4706,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4549,6 +4757,10 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
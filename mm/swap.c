@@ -236,7 +236,8 @@ static void pagevec_move_tail_fn(struct page *page, void *arg)
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		if (!lru_gen_rotate_page(zone, page, true))
+			list_move_tail(&page->lru, &zone->lru[lru].list);
 		mem_cgroup_rotate_reclaimable_page(page);
 		(*pgmoved)++;
 	}
@@ -401,6 +402,18 @@ void lru_cache_add_lru(struct page *page, enum lru_list lru)
 	__lru_cache_add(page, lru);
 }
 
+/**
+ * lru_cache_add_page_cache - add a page cache page to a page list
+ * @page: the page, just inserted by add_to_page_cache_list()
+ *
+ * Puts it on the list add_to_page_cache_lru() would have chosen.
+ */
+void lru_cache_add_page_cache(struct page *page)
+{
+	__lru_cache_add(page, page_lru_base_type(page));
+}
+EXPORT_SYMBOL_GPL(lru_cache_add_page_cache);
+
 /**
  * add_page_to_unevictable_list - add a page to the unevictable list
  * @page:  the page to be added to the unevictable list
@@ -480,7 +493,8 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
+		if (!lru_gen_rotate_page(zone, page, true))
+			list_move_tail(&page->lru, &zone->lru[lru].list);
 		mem_cgroup_rotate_reclaimable_page(page);
 		__count_vm_event(PGROTATED);
 	}
@@ -662,7 +676,6 @@ void lru_add_page_tail(struct zone* zone,
 	int active;
 	enum lru_list lru;
 	const int file = 0;
-	struct list_head *head;
 
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
@@ -681,11 +694,14 @@ void lru_add_page_tail(struct zone* zone,
 			lru = LRU_INACTIVE_ANON;
 		}
 		update_page_reclaim_stat(zone, page_tail, file, active);
-		if (likely(PageLRU(page)))
-			head = page->lru.prev;
-		else
-			head = &zone->lru[lru].list;
-		__add_page_to_lru_list(zone, page_tail, lru, head);
+		if (likely(PageLRU(page))) {
+			/* next to the head, so in its generation too */
+			if (lru_gen_enabled())
+				set_page_lru_gen(page_tail, page_lru_gen(page));
+			__add_page_to_lru_list(zone, page_tail, lru,
+					       page->lru.prev);
+		} else
+			add_page_to_lru_list(zone, page_tail, lru);
 	} else {
 		SetPageUnevictable(page_tail);
 		add_page_to_lru_list(zone, page_tail, LRU_UNEVICTABLE);
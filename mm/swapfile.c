@@ -42,8 +42,51 @@ static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
 static void free_swap_count_continuations(struct swap_info_struct *);
 static sector_t map_swap_entry(swp_entry_t, struct block_device**);
+static unsigned char swap_entry_free(struct swap_info_struct *, swp_entry_t,
+				     unsigned char);
 
 static DEFINE_SPINLOCK(swap_lock);
+
+/*
+ * swap_lock is taken through these, so that /proc/vmstat shows how often
+ * it is taken and, with lock statistics, for how long it is held.
+ */
+#ifdef CONFIG_LOCK_STAT
+static DEFINE_PER_CPU(u64, swap_lock_stamp);
+static DEFINE_PER_CPU(u32, swap_lock_held_ns);
+
+static inline void swap_lock_stat_acquired(void)
+{
+	__this_cpu_write(swap_lock_stamp, local_clock());
+}
+
+static inline void swap_lock_stat_release(void)
+{
+	u64 ns = local_clock() - __this_cpu_read(swap_lock_stamp) +
+		 __this_cpu_read(swap_lock_held_ns);
+	u32 rem;
+
+	__count_vm_events(SWAP_LOCK_HELD_US, div_u64_rem(ns, NSEC_PER_USEC,
+							 &rem));
+	__this_cpu_write(swap_lock_held_ns, rem);
+}
+#else
+static inline void swap_lock_stat_acquired(void) {}
+static inline void swap_lock_stat_release(void) {}
+#endif
+
+static inline void lock_swap(void)
+{
+	spin_lock(&swap_lock);
+	swap_lock_stat_acquired();
+	__count_vm_event(SWAP_LOCK_ACQUIRED);
+}
+
+static inline void unlock_swap(void)
+{
+	swap_lock_stat_release();
+	spin_unlock(&swap_lock);
+}
 static unsigned int nr_swapfiles;
 long nr_swap_pages;
 long total_swap_pages;
@@ -221,7 +264,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			si->lowest_alloc = si->max;
 			si->highest_alloc = 0;
 		}
-		spin_unlock(&swap_lock);
+		unlock_swap();
 
 		/*
 		 * If seek is expensive, start searching for new cluster from
@@ -240,7 +283,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			if (si->swap_map[offset])
 				last_in_cluster = offset + SWAPFILE_CLUSTER;
 			else if (offset == last_in_cluster) {
-				spin_lock(&swap_lock);
+				lock_swap();
 				offset -= SWAPFILE_CLUSTER - 1;
 				si->cluster_next = offset;
 				si->cluster_nr = SWAPFILE_CLUSTER - 1;
@@ -261,7 +304,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			if (si->swap_map[offset])
 				last_in_cluster = offset + SWAPFILE_CLUSTER;
 			else if (offset == last_in_cluster) {
-				spin_lock(&swap_lock);
+				lock_swap();
 				offset -= SWAPFILE_CLUSTER - 1;
 				si->cluster_next = offset;
 				si->cluster_nr = SWAPFILE_CLUSTER - 1;
@@ -275,7 +318,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 		}
 
 		offset = scan_base;
-		spin_lock(&swap_lock);
+		lock_swap();
 		si->cluster_nr = SWAPFILE_CLUSTER - 1;
 		si->lowest_alloc = 0;
 	}
@@ -291,9 +334,9 @@ checks:
 	/* reuse swap entry of cache-only swap if not busy. */
 	if (vm_swap_full() && si->swap_map[offset] == SWAP_HAS_CACHE) {
 		int swap_was_freed;
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		swap_was_freed = __try_to_reclaim_swap(si, offset);
-		spin_lock(&swap_lock);
+		lock_swap();
 		/* entry was freed successfully, try to use this again */
 		if (swap_was_freed)
 			goto checks;
@@ -333,13 +376,13 @@ checks:
 			    si->lowest_alloc <= last_in_cluster)
 				last_in_cluster = si->lowest_alloc - 1;
 			si->flags |= SWP_DISCARDING;
-			spin_unlock(&swap_lock);
+			unlock_swap();
 
 			if (offset < last_in_cluster)
 				discard_swap_cluster(si, offset,
 					last_in_cluster - offset + 1);
 
-			spin_lock(&swap_lock);
+			lock_swap();
 			si->lowest_alloc = 0;
 			si->flags &= ~SWP_DISCARDING;
 
@@ -353,10 +396,10 @@ checks:
 			 * could defer that delay until swap_writepage,
 			 * but it's easier to keep this self-contained.
 			 */
-			spin_unlock(&swap_lock);
+			unlock_swap();
 			wait_on_bit(&si->flags, ilog2(SWP_DISCARDING),
 				wait_for_discard, TASK_UNINTERRUPTIBLE);
-			spin_lock(&swap_lock);
+			lock_swap();
 		} else {
 			/*
 			 * Note pages allocated by racing tasks while
@@ -372,14 +415,14 @@ checks:
 	return offset;
 
 scan:
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	while (++offset <= si->highest_bit) {
 		if (!si->swap_map[offset]) {
-			spin_lock(&swap_lock);
+			lock_swap();
 			goto checks;
 		}
 		if (vm_swap_full() && si->swap_map[offset] == SWAP_HAS_CACHE) {
-			spin_lock(&swap_lock);
+			lock_swap();
 			goto checks;
 		}
 		if (unlikely(--latency_ration < 0)) {
@@ -390,11 +433,11 @@ scan:
 	offset = si->lowest_bit;
 	while (++offset < scan_base) {
 		if (!si->swap_map[offset]) {
-			spin_lock(&swap_lock);
+			lock_swap();
 			goto checks;
 		}
 		if (vm_swap_full() && si->swap_map[offset] == SWAP_HAS_CACHE) {
-			spin_lock(&swap_lock);
+			lock_swap();
 			goto checks;
 		}
 		if (unlikely(--latency_ration < 0)) {
@@ -402,21 +445,21 @@ scan:
 			latency_ration = LATENCY_LIMIT;
 		}
 	}
-	spin_lock(&swap_lock);
+	lock_swap();
 
 no_page:
 	si->flags -= SWP_SCANNING;
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/* Called with swap_lock held, which may be dropped and retaken. */
+static swp_entry_t __get_swap_page(void)
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
 
-	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
 	nr_swap_pages--;
@@ -438,42 +481,154 @@ swp_entry_t get_swap_page(void)
 		swap_list.next = next;
 		/* This is called for allocating swap entry for cache */
 		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
+		if (offset)
 			return swp_entry(type, offset);
-		}
 		next = swap_list.next;
 	}
 
 	nr_swap_pages++;
 noswap:
-	spin_unlock(&swap_lock);
 	return (swp_entry_t) {0};
 }
 
+/*
+ * Each CPU keeps a few swap entries allocated ahead, so that swapping out
+ * does not take swap_lock for every page. The cached entries are marked
+ * SWAP_HAS_CACHE in swap_map, just like the ones handed out by
+ * get_swap_page(), and are accounted as used in nr_swap_pages.
+ */
+#define SWAP_SLOTS_CACHE_SIZE	64
+
+struct swap_slots_cache {
+	struct mutex lock;
+	int nr;
+	int cur;
+	swp_entry_t slots[SWAP_SLOTS_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool swap_slots_cache_ready;
+
+/* Fill @slots with up to @nr entries, taking swap_lock only once. */
+static int get_swap_pages(int nr, swp_entry_t slots[])
+{
+	int i;
+
+	lock_swap();
+	for (i = 0; i < nr; i++) {
+		slots[i] = __get_swap_page();
+		if (!slots[i].val)
+			break;
+	}
+	unlock_swap();
+	return i;
+}
+
+/* Give back entries that never got a page, taking swap_lock only once. */
+static void swapcache_free_entries(swp_entry_t slots[], int nr)
+{
+	int i;
+
+	if (!nr)
+		return;
+	lock_swap();
+	for (i = 0; i < nr; i++)
+		swap_entry_free(swap_info[swp_type(slots[i])], slots[i],
+				SWAP_HAS_CACHE);
+	unlock_swap();
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry = { 0 };
+	int batch;
+
+	if (!swap_slots_cache_ready) {
+		lock_swap();
+		entry = __get_swap_page();
+		unlock_swap();
+		return entry;
+	}
+
+	/* We may be preempted and migrate: any CPU's cache will do. */
+	cache = &per_cpu(swp_slots, raw_smp_processor_id());
+	mutex_lock(&cache->lock);
+	if (cache->nr) {
+		count_vm_event(SWAP_SLOTS_CACHE_HIT);
+	} else {
+		/* Don't hoard slots when swap space is getting short. */
+		batch = SWAP_SLOTS_CACHE_SIZE;
+		if (nr_swap_pages < 2 * batch * num_online_cpus())
+			batch = 1;
+		count_vm_event(SWAP_SLOTS_CACHE_REFILL);
+		cache->cur = 0;
+		cache->nr = get_swap_pages(batch, cache->slots);
+	}
+	if (cache->nr) {
+		entry = cache->slots[cache->cur++];
+		cache->nr--;
+	}
+	mutex_unlock(&cache->lock);
+
+	return entry;
+}
+
+/*
+ * Return all cached entries, so that swapoff does not find them in use.
+ * Entries can't come back from a device once SWP_WRITEOK is cleared.
+ */
+static void drain_swap_slots_caches(void)
+{
+	struct swap_slots_cache *cache;
+	int cpu;
+
+	if (!swap_slots_cache_ready)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		cache = &per_cpu(swp_slots, cpu);
+		mutex_lock(&cache->lock);
+		swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+		cache->nr = 0;
+		mutex_unlock(&cache->lock);
+	}
+}
+
+static int __init swap_slots_cache_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		mutex_init(&per_cpu(swp_slots, cpu).lock);
+	swap_slots_cache_ready = true;
+	return 0;
+}
+__initcall(swap_slots_cache_init);
+
 /* The only caller of this function is now susupend routine */
 swp_entry_t get_swap_page_of_type(int type)
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	si = swap_info[type];
 	if (si && (si->flags & SWP_WRITEOK)) {
 		nr_swap_pages--;
 		/* This is called for allocating swap entry, not cache */
 		offset = scan_swap_map(si, 1);
 		if (offset) {
-			spin_unlock(&swap_lock);
+			unlock_swap();
 			return swp_entry(type, offset);
 		}
 		nr_swap_pages++;
 	}
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	return (swp_entry_t) {0};
 }
 
-static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+static struct swap_info_struct *swap_info_check(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 	unsigned long offset, type;
@@ -491,7 +646,6 @@ static struct swap_info_struct *swap_info_get(swp_entry_t entry)
 		goto bad_offset;
 	if (!p->swap_map[offset])
 		goto bad_free;
-	spin_lock(&swap_lock);
 	return p;
 
 bad_free:
@@ -509,6 +663,16 @@ out:
 	return NULL;
 }
 
+static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+
+	p = swap_info_check(entry);
+	if (p)
+		lock_swap();
+	return p;
+}
+
 static unsigned char swap_entry_free(struct swap_info_struct *p,
 				     swp_entry_t entry, unsigned char usage)
 {
@@ -576,7 +740,7 @@ void swap_free(swp_entry_t entry)
 	p = swap_info_get(entry);
 	if (p) {
 		swap_entry_free(p, entry, 1);
-		spin_unlock(&swap_lock);
+		unlock_swap();
 	}
 }
 
@@ -593,7 +757,7 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
 		if (page)
 			mem_cgroup_uncharge_swapcache(page, entry, count != 0);
-		spin_unlock(&swap_lock);
+		unlock_swap();
 	}
 }
 
@@ -612,7 +776,7 @@ static inline int page_swapcount(struct page *page)
 	p = swap_info_get(entry);
 	if (p) {
 		count = swap_count(p->swap_map[swp_offset(entry)]);
-		spin_unlock(&swap_lock);
+		unlock_swap();
 	}
 	return count;
 }
@@ -679,6 +843,22 @@ int try_to_free_swap(struct page *page)
 	return 1;
 }
 
+/*
+ * The page was found in swap cache after its swap entry lost its last
+ * reference. Not mapped elsewhere, or swap space full? Free it!
+ * Also recheck PageSwapCache now page is locked.
+ */
+static void free_swap_cache_page(struct page *page)
+{
+	if (PageSwapCache(page) && !PageWriteback(page) &&
+			(!page_mapped(page) || vm_swap_full())) {
+		delete_from_swap_cache(page);
+		SetPageDirty(page);
+	}
+	unlock_page(page);
+	page_cache_release(page);
+}
+
 /*
  * Free the swap entry like above, but also try to
  * free the page cache entry if it is the last user.
@@ -700,22 +880,73 @@ int free_swap_and_cache(swp_entry_t entry)
 				page = NULL;
 			}
 		}
-		spin_unlock(&swap_lock);
+		unlock_swap();
 	}
-	if (page) {
-		/*
-		 * Not mapped elsewhere, or swap space full? Free it!
-		 * Also recheck PageSwapCache now page is locked (above).
-		 */
-		if (PageSwapCache(page) && !PageWriteback(page) &&
-				(!page_mapped(page) || vm_swap_full())) {
-			delete_from_swap_cache(page);
-			SetPageDirty(page);
+	if (page)
+		free_swap_cache_page(page);
+	return p != NULL;
+}
+
+/**
+ * swap_free_batch_add - queue a swap entry for free_swap_and_cache()
+ * @batch: batch to add to, flushed with swap_free_batch_flush()
+ * @entry: swap entry whose reference the caller drops
+ *
+ * Flushes the batch when it is full. Returns 0 if @entry is not a valid
+ * swap entry, just like free_swap_and_cache().
+ */
+int swap_free_batch_add(struct swap_free_batch *batch, swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+
+	if (non_swap_entry(entry))
+		return 1;
+
+	p = swap_info_check(entry);
+	if (!p)
+		return 0;
+
+	batch->entries[batch->nr++] = entry;
+	if (batch->nr == SWAP_FREE_BATCH)
+		swap_free_batch_flush(batch);
+	return 1;
+}
+
+/**
+ * swap_free_batch_flush - free_swap_and_cache() all queued swap entries
+ * @batch: batch to flush
+ */
+void swap_free_batch_flush(struct swap_free_batch *batch)
+{
+	struct page *pages[SWAP_FREE_BATCH];
+	struct page *page;
+	swp_entry_t entry;
+	int i, nr_pages = 0;
+
+	if (!batch->nr)
+		return;
+
+	lock_swap();
+	for (i = 0; i < batch->nr; i++) {
+		entry = batch->entries[i];
+		if (swap_entry_free(swap_info[swp_type(entry)], entry, 1) !=
+		    SWAP_HAS_CACHE)
+			continue;
+		page = find_get_page(&swapper_space, entry.val);
+		if (page && !trylock_page(page)) {
+			page_cache_release(page);
+			page = NULL;
 		}
-		unlock_page(page);
-		page_cache_release(page);
+		if (page)
+			pages[nr_pages++] = page;
 	}
-	return p != NULL;
+	unlock_swap();
+
+	count_vm_events(SWAP_FREE_BATCHED, batch->nr);
+	batch->nr = 0;
+
+	for (i = 0; i < nr_pages; i++)
+		free_swap_cache_page(pages[i]);
 }
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
@@ -741,7 +972,7 @@ int mem_cgroup_count_swap_user(swp_entry_t ent, struct page **pagep)
 	p = swap_info_get(ent);
 	if (p) {
 		count += swap_count(p->swap_map[swp_offset(ent)]);
-		spin_unlock(&swap_lock);
+		unlock_swap();
 	}
 
 	*pagep = page;
@@ -766,7 +997,7 @@ int swap_type_of(dev_t device, sector_t offset, struct block_device **bdev_p)
 	if (device)
 		bdev = bdget(device);
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	for (type = 0; type < nr_swapfiles; type++) {
 		struct swap_info_struct *sis = swap_info[type];
 
@@ -777,7 +1008,7 @@ int swap_type_of(dev_t device, sector_t offset, struct block_device **bdev_p)
 			if (bdev_p)
 				*bdev_p = bdgrab(sis->bdev);
 
-			spin_unlock(&swap_lock);
+			unlock_swap();
 			return type;
 		}
 		if (bdev == sis->bdev) {
@@ -787,13 +1018,13 @@ int swap_type_of(dev_t device, sector_t offset, struct block_device **bdev_p)
 				if (bdev_p)
 					*bdev_p = bdgrab(sis->bdev);
 
-				spin_unlock(&swap_lock);
+				unlock_swap();
 				bdput(bdev);
 				return type;
 			}
 		}
 	}
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	if (bdev)
 		bdput(bdev);
 
@@ -825,7 +1056,7 @@ unsigned int count_swap_pages(int type, int free)
 {
 	unsigned int n = 0;
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	if ((unsigned int)type < nr_swapfiles) {
 		struct swap_info_struct *sis = swap_info[type];
 
@@ -835,7 +1066,7 @@ unsigned int count_swap_pages(int type, int free)
 				n -= sis->inuse_pages;
 		}
 	}
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	return n;
 }
 #endif /* CONFIG_HIBERNATION */
@@ -1523,7 +1754,7 @@ static void enable_swap_info(struct swap_info_struct *p, int prio,
 {
 	int i, prev;
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	if (prio >= 0)
 		p->prio = prio;
 	else
@@ -1545,7 +1776,7 @@ static void enable_swap_info(struct swap_info_struct *p, int prio,
 		swap_list.head = swap_list.next = p->type;
 	else
 		swap_info[prev]->next = p->type;
-	spin_unlock(&swap_lock);
+	unlock_swap();
 }
 
 SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
@@ -1576,7 +1807,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 
 	mapping = victim->f_mapping;
 	prev = -1;
-	spin_lock(&swap_lock);
+	lock_swap();
 	for (type = swap_list.head; type >= 0; type = swap_info[type]->next) {
 		p = swap_info[type];
 		if (p->flags & SWP_WRITEOK) {
@@ -1587,14 +1818,14 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	}
 	if (type < 0) {
 		err = -EINVAL;
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		goto out_dput;
 	}
 	if (!security_vm_enough_memory(p->pages))
 		vm_unacct_memory(p->pages);
 	else {
 		err = -ENOMEM;
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		goto out_dput;
 	}
 	if (prev < 0)
@@ -1613,7 +1844,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	nr_swap_pages -= p->pages;
 	total_swap_pages -= p->pages;
 	p->flags &= ~SWP_WRITEOK;
-	spin_unlock(&swap_lock);
+	unlock_swap();
+
+	drain_swap_slots_caches();
 
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 	err = try_to_unuse(type);
@@ -1636,15 +1869,15 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 		free_swap_count_continuations(p);
 
 	mutex_lock(&swapon_mutex);
-	spin_lock(&swap_lock);
+	lock_swap();
 	drain_mmlist();
 
 	/* wait for anyone still in scan_swap_map */
 	p->highest_bit = 0;		/* cuts scans short */
 	while (p->flags >= SWP_SCANNING) {
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		schedule_timeout_uninterruptible(1);
-		spin_lock(&swap_lock);
+		lock_swap();
 	}
 
 	swap_file = p->swap_file;
@@ -1653,7 +1886,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
 	p->flags = 0;
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
 	/* Destroy swap account informatin */
@@ -1837,13 +2070,13 @@ static struct swap_info_struct *alloc_swap_info(void)
 	if (!p)
 		return ERR_PTR(-ENOMEM);
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	for (type = 0; type < nr_swapfiles; type++) {
 		if (!(swap_info[type]->flags & SWP_USED))
 			break;
 	}
 	if (type >= MAX_SWAPFILES) {
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		kfree(p);
 		return ERR_PTR(-EPERM);
 	}
@@ -1868,7 +2101,7 @@ static struct swap_info_struct *alloc_swap_info(void)
 	INIT_LIST_HEAD(&p->first_swap_extent.list);
 	p->flags = SWP_USED;
 	p->next = -1;
-	spin_unlock(&swap_lock);
+	unlock_swap();
 
 	return p;
 }
@@ -2147,10 +2380,10 @@ bad_swap:
 	}
 	destroy_swap_extents(p);
 	swap_cgroup_swapoff(p->type);
-	spin_lock(&swap_lock);
+	lock_swap();
 	p->swap_file = NULL;
 	p->flags = 0;
-	spin_unlock(&swap_lock);
+	unlock_swap();
 	vfree(swap_map);
 	if (swap_file) {
 		if (inode && S_ISREG(inode->i_mode)) {
@@ -2176,7 +2409,7 @@ void si_swapinfo(struct sysinfo *val)
 	unsigned int type;
 	unsigned long nr_to_be_unused = 0;
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	for (type = 0; type < nr_swapfiles; type++) {
 		struct swap_info_struct *si = swap_info[type];
 
@@ -2185,7 +2418,7 @@ void si_swapinfo(struct sysinfo *val)
 	}
 	val->freeswap = nr_swap_pages + nr_to_be_unused;
 	val->totalswap = total_swap_pages + nr_to_be_unused;
-	spin_unlock(&swap_lock);
+	unlock_swap();
 }
 
 /*
@@ -2216,7 +2449,7 @@ static int __swap_duplicate(swp_entry_t entry, unsigned char usage)
 	p = swap_info[type];
 	offset = swp_offset(entry);
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	if (unlikely(offset >= p->max))
 		goto unlock_out;
 
@@ -2251,7 +2484,7 @@ static int __swap_duplicate(swp_entry_t entry, unsigned char usage)
 	p->swap_map[offset] = count | has_cache;
 
 unlock_out:
-	spin_unlock(&swap_lock);
+	unlock_swap();
 out:
 	return err;
 
@@ -2320,7 +2553,7 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 	if (!base)		/* first page is swap header */
 		base++;
 
-	spin_lock(&swap_lock);
+	lock_swap();
 	if (end > si->max)	/* don't go beyond end of map */
 		end = si->max;
 
@@ -2340,7 +2573,7 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 		if (swap_count(si->swap_map[toff]) == SWAP_MAP_BAD)
 			break;
 	}
-	spin_unlock(&swap_lock);
+	unlock_swap();
 
 	/*
 	 * Indicate starting offset, and return number of pages to get:
@@ -2403,7 +2636,7 @@ int add_swap_count_continuation(swp_entry_t entry, gfp_t gfp_mask)
 	}
 
 	if (!page) {
-		spin_unlock(&swap_lock);
+		unlock_swap();
 		return -ENOMEM;
 	}
 
@@ -2451,7 +2684,7 @@ int add_swap_count_continuation(swp_entry_t entry, gfp_t gfp_mask)
 	list_add_tail(&page->lru, &head->lru);
 	page = NULL;			/* now it's attached, don't free it */
 out:
-	spin_unlock(&swap_lock);
+	unlock_swap();
 outer:
 	if (page)
 		__free_page(page);
@@ -43,6 +43,8 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -113,6 +115,9 @@ struct scan_control {
 	 * are scanned.
 	 */
 	nodemask_t	*nodemask;
+
+	/* Reclaim pages even if they have been referenced recently */
+	int ignore_references;
 };
 
 #define lru_to_page(_head) (list_entry((_head)->prev, struct page, lru))
@@ -745,7 +750,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			goto keep;
 
 		VM_BUG_ON(PageActive(page));
-		VM_BUG_ON(page_zone(page) != zone);
+		VM_BUG_ON(zone && page_zone(page) != zone);
 
 		sc->nr_scanned++;
 
@@ -780,7 +785,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		references = page_check_references(page, sc);
+		if (sc->ignore_references)
+			references = PAGEREF_RECLAIM;
+		else
+			references = page_check_references(page, sc);
 		switch (references) {
 		case PAGEREF_ACTIVATE:
 			goto activate_locked;
@@ -952,7 +960,8 @@ keep_lumpy:
 	 * back off and wait for congestion to clear because further reclaim
 	 * will encounter the same problem
 	 */
-	if (nr_dirty && nr_dirty == nr_congested && scanning_global_lru(sc))
+	if (zone && nr_dirty && nr_dirty == nr_congested &&
+	    scanning_global_lru(sc))
 		zone_set_flag(zone, ZONE_CONGESTED);
 
 	free_page_list(&free_pages);
@@ -962,6 +971,52 @@ keep_lumpy:
 	return nr_reclaimed;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+/**
+ * reclaim_pages_from_list - reclaim a list of isolated pages
+ * @page_list: pages isolated with isolate_lru_page(), possibly from
+ *             several zones, and accounted in NR_ISOLATED_ANON/FILE
+ *
+ * Pages are reclaimed regardless of recent references. Those which
+ * could not be reclaimed are put back on their LRU lists.
+ *
+ * Returns the number of reclaimed pages.
+ */
+unsigned long reclaim_pages_from_list(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.swappiness = vm_swappiness,
+		.order = 0,
+		.mem_cgroup = NULL,
+		.nodemask = NULL,
+		.ignore_references = 1,
+	};
+	unsigned long nr_reclaimed;
+	struct page *page;
+
+	list_for_each_entry(page, page_list, lru) {
+		dec_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		ClearPageActive(page);
+	}
+
+	reset_reclaim_mode(&sc);
+	nr_reclaimed = shrink_page_list(page_list, NULL, &sc);
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+
+	return nr_reclaimed;
+}
+#endif
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1173,6 +1228,481 @@ static unsigned long isolate_pages_global(unsigned long nr,
 								mode, file);
 }
 
+#ifdef CONFIG_LRU_GEN
+bool lru_gen_on __read_mostly = true;
+
+static int __init setup_lru_gen(char *str)
+{
+	return strtobool(str, &lru_gen_on) == 0;
+}
+__setup("lru_gen=", setup_lru_gen);
+
+void __meminit lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	int gen, file;
+
+	for (file = 0; file < 2; file++) {
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+			lrugen->timestamps[gen][file] = jiffies;
+		}
+		lrugen->min_seq[file] = 0;
+		lrugen->max_seq[file] = MIN_NR_GENS - 1;
+	}
+}
+
+/*
+ * Every mm is on lru_gen_mm_list from exec_mmap() or dup_mm() to its last
+ * mmput(), so that aging can scan its page tables. The walks are
+ * serialized by lru_gen_aging_mutex. max_seq is raised under the zone's
+ * lru_lock, and only while a zone is down to MIN_NR_GENS generations, so
+ * the generation a page table walk promotes to stays valid throughout.
+ */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	/* a failed dup_mm() never added it */
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Return the next mm after @prev with a reference held, which keeps it on
+ * the list, and drop the reference to @prev.
+ */
+static struct mm_struct *lru_gen_next_mm(struct mm_struct *prev)
+{
+	struct list_head *pos = prev ? &prev->lru_gen_list : &lru_gen_mm_list;
+	struct mm_struct *mm = NULL;
+
+	spin_lock(&lru_gen_mm_lock);
+	for (pos = pos->next; pos != &lru_gen_mm_list; pos = pos->next) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		if (atomic_inc_not_zero(&mm->mm_users))
+			break;
+		mm = NULL;
+	}
+	spin_unlock(&lru_gen_mm_lock);
+
+	if (prev)
+		mmput(prev);
+	return mm;
+}
+
+/* Move a page to the youngest generation, if it is on the generations */
+static void lru_gen_promote_page(struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	int file = page_is_file_cache(page);
+	unsigned long old, new;
+	int gen;
+
+	if (!PageLRU(page))
+		return;
+
+	gen = lru_gen_from_seq(zone->lrugen.max_seq[file]);
+	do {
+		old = ACCESS_ONCE(page->flags);
+		/* isolated meanwhile */
+		if (!(old & LRU_GEN_MASK))
+			return;
+		new = (old & ~LRU_GEN_MASK) |
+		      ((unsigned long)(gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+
+static unsigned long lru_gen_walk_pte_range(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	unsigned long nr = 0;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	do {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		/* no TLB flush: a stale young bit only delays the next one */
+		ptep_test_and_clear_young(vma, addr, pte);
+		lru_gen_promote_page(page);
+		nr++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	pte_unmap_unlock(orig_pte, ptl);
+
+	return nr;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static unsigned long lru_gen_walk_huge_pmd(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long nr = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) && !pmd_trans_splitting(*pmd) &&
+	    pmdp_test_and_clear_young(vma, addr & HPAGE_PMD_MASK, pmd)) {
+		struct page *page = pmd_page(*pmd);
+
+		/* a shmem huge pmd maps HPAGE_PMD_NR pages of their own */
+		if (PageCompound(page))
+			lru_gen_promote_page(page);
+		else
+			for (nr = 0; nr < HPAGE_PMD_NR; nr++)
+				lru_gen_promote_page(page + nr);
+		nr = HPAGE_PMD_NR;
+	}
+	spin_unlock(&mm->page_table_lock);
+
+	return nr;
+}
+#else
+static inline unsigned long lru_gen_walk_huge_pmd(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr)
+{
+	return 0;
+}
+#endif
+
+static unsigned long lru_gen_walk_pmd_range(struct vm_area_struct *vma,
+		pud_t *pud, unsigned long addr, unsigned long end)
+{
+	unsigned long next, nr = 0;
+	pmd_t *pmd;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		if (pmd_trans_huge(*pmd)) {
+			nr += lru_gen_walk_huge_pmd(vma, pmd, addr);
+			continue;
+		}
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+			continue;
+		nr += lru_gen_walk_pte_range(vma, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+
+	return nr;
+}
+
+static unsigned long lru_gen_walk_pud_range(struct vm_area_struct *vma,
+		pgd_t *pgd, unsigned long addr, unsigned long end)
+{
+	unsigned long next, nr = 0;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		nr += lru_gen_walk_pmd_range(vma, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+
+	return nr;
+}
+
+static unsigned long lru_gen_walk_range(struct vm_area_struct *vma,
+		unsigned long addr, unsigned long end)
+{
+	unsigned long next, nr = 0;
+	pgd_t *pgd;
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		nr += lru_gen_walk_pud_range(vma, pgd, addr, next);
+	} while (pgd++, addr = next, addr != end);
+
+	return nr;
+}
+
+/* Address space walked per mmap_sem hold, unless nobody needs the CPU */
+#define LRU_GEN_WALK_BATCH	(64 * PMD_SIZE)
+
+/*
+ * Promote the pages an mm accessed since its last walk. Mlocked pages are
+ * not on the generations, and sequentially read mappings are left to be
+ * evicted early.
+ */
+static unsigned long lru_gen_walk_mm(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	unsigned long addr = 0, end, nr = 0;
+
+	if (!down_read_trylock(&mm->mmap_sem))
+		goto skip;
+
+	while ((vma = find_vma(mm, addr))) {
+		addr = max(addr, vma->vm_start);
+		end = vma->vm_end;
+		if (end - addr > LRU_GEN_WALK_BATCH)
+			end = addr + LRU_GEN_WALK_BATCH;
+
+		if (!(vma->vm_flags & (VM_LOCKED | VM_HUGETLB | VM_IO |
+				       VM_PFNMAP | VM_SEQ_READ)))
+			nr += lru_gen_walk_range(vma, addr, end);
+		addr = end;
+
+		if (need_resched()) {
+			up_read(&mm->mmap_sem);
+			cond_resched();
+			if (!down_read_trylock(&mm->mmap_sem))
+				goto skip;
+		}
+	}
+	up_read(&mm->mmap_sem);
+
+	return nr;
+skip:
+	count_vm_event(LRU_GEN_WALK_SKIP);
+	return nr;
+}
+
+static bool lru_gen_need_aging(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+
+	return ACCESS_ONCE(lrugen->max_seq[file]) -
+	       ACCESS_ONCE(lrugen->min_seq[file]) + 1 <= MIN_NR_GENS;
+}
+
+/* Start a new youngest generation of @file pages in @zone, if it needs one */
+static bool lru_gen_inc_max_seq(struct zone *zone, int file)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	bool aged = false;
+	int gen;
+
+	spin_lock_irq(&zone->lru_lock);
+	/* aged by somebody else meanwhile */
+	if (lru_gen_need_aging(zone, file)) {
+		gen = lru_gen_from_seq(++lrugen->max_seq[file]);
+		lrugen->timestamps[gen][file] = jiffies;
+		aged = true;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (aged)
+		count_vm_event(LRU_GEN_AGING);
+	return aged;
+}
+
+/*
+ * Start a new youngest generation of @file pages in @zone and promote the
+ * pages found young in the page tables of every mm to it. The walk covers
+ * all zones: pages of other zones go to their own youngest generation.
+ *
+ * Reclaimers don't wait for another task's walk: they start the generation
+ * without one, and leave it to page_referenced() to find the young pages
+ * when they are isolated, as without the generations.
+ */
+static void lru_gen_age(struct zone *zone, int file, struct scan_control *sc)
+{
+	struct mm_struct *mm = NULL;
+	unsigned long nr = 0;
+
+	if (!mutex_trylock(&lru_gen_aging_mutex)) {
+		lru_gen_inc_max_seq(zone, file);
+		return;
+	}
+
+	if (!lru_gen_inc_max_seq(zone, file))
+		goto out;
+
+	/* the walk may drop the last reference to an mm, see mmput() */
+	if (!(sc->gfp_mask & __GFP_FS))
+		goto out;
+
+	while ((mm = lru_gen_next_mm(mm)))
+		nr += lru_gen_walk_mm(mm);
+	count_vm_events(LRU_GEN_PROMOTED, nr);
+out:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+#define LRU_GEN_SORT_BATCH 1024UL /* arbitrary lock hold batch size */
+
+/*
+ * Isolate pages of the oldest generation of @file pages. Pages promoted
+ * since they were put on its list are moved to the list of their
+ * generation instead; once the list is empty the next generation becomes
+ * the oldest, down to MIN_NR_GENS, which are left for aging.
+ *
+ * Appropriate locks must be held before calling this function.
+ */
+static unsigned long lru_gen_isolate_pages(struct zone *zone, int file,
+		unsigned long nr_to_scan, struct list_head *dst,
+		unsigned long *scanned)
+{
+	struct lru_gen *lrugen = &zone->lrugen;
+	unsigned long nr_taken = 0, nr_sorted = 0, scan = 0;
+
+	while (scan < nr_to_scan && nr_sorted < LRU_GEN_SORT_BATCH) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[file]);
+		struct list_head *src = &lrugen->lists[gen][file];
+		struct page *page;
+		int page_gen;
+
+		if (list_empty(src)) {
+			if (lru_gen_need_aging(zone, file))
+				break;
+			lrugen->min_seq[file]++;
+			continue;
+		}
+
+		page = lru_to_page(src);
+		prefetchw_prev_lru_page(page, src, flags);
+
+		VM_BUG_ON(!PageLRU(page));
+
+		page_gen = page_lru_gen(page);
+		if (page_gen >= 0 && page_gen != gen) {
+			list_move(&page->lru, &lrugen->lists[page_gen][file]);
+			nr_sorted++;
+			continue;
+		}
+
+		scan++;
+		switch (__isolate_lru_page(page, ISOLATE_INACTIVE, file)) {
+		case 0:
+			set_page_lru_gen(page, -1);
+			list_move(&page->lru, dst);
+			mem_cgroup_del_lru(page);
+			nr_taken += hpage_nr_pages(page);
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, src);
+			mem_cgroup_rotate_lru_list(page, page_lru(page));
+			break;
+
+		default:
+			BUG();
+		}
+	}
+
+	*scanned = scan;
+	return nr_taken;
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * The generations of each zone and type, oldest first: sequence number,
+ * age in milliseconds and number of pages. Pages are counted by the
+ * generation in their flags, one list at a time under zone->lru_lock.
+ */
+static int lru_gen_show(struct seq_file *m, void *v)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		struct lru_gen *lrugen = &zone->lrugen;
+		int file;
+
+		seq_printf(m, "node %d zone %s\n", zone_to_nid(zone),
+			   zone->name);
+		for (file = 0; file < 2; file++) {
+			unsigned long nr[MAX_NR_GENS] = { 0, };
+			unsigned long birth[MAX_NR_GENS];
+			unsigned long seq, min_seq, max_seq;
+			struct page *page;
+			int gen;
+
+			for (gen = 0; gen < MAX_NR_GENS; gen++) {
+				spin_lock_irq(&zone->lru_lock);
+				list_for_each_entry(page,
+						&lrugen->lists[gen][file], lru) {
+					int page_gen = page_lru_gen(page);
+
+					if (page_gen >= 0)
+						nr[page_gen] +=
+							hpage_nr_pages(page);
+				}
+				spin_unlock_irq(&zone->lru_lock);
+			}
+
+			spin_lock_irq(&zone->lru_lock);
+			min_seq = lrugen->min_seq[file];
+			max_seq = lrugen->max_seq[file];
+			for (gen = 0; gen < MAX_NR_GENS; gen++)
+				birth[gen] = lrugen->timestamps[gen][file];
+			spin_unlock_irq(&zone->lru_lock);
+
+			seq_printf(m, "  %s\n", file ? "file" : "anon");
+			for (seq = min_seq; seq <= max_seq; seq++) {
+				gen = lru_gen_from_seq(seq);
+				seq_printf(m, "  %10lu %10u %10lu\n", seq,
+					   jiffies_to_msecs(jiffies - birth[gen]),
+					   nr[gen]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int lru_gen_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_show, NULL);
+}
+
+static const struct file_operations lru_gen_fops = {
+	.open		= lru_gen_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lru_gen_debugfs_init(void)
+{
+	if (lru_gen_enabled())
+		debugfs_create_file("lru_gen", 0444, NULL, NULL,
+				    &lru_gen_fops);
+	return 0;
+}
+late_initcall(lru_gen_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+#else
+static inline bool lru_gen_need_aging(struct zone *zone, int file)
+{
+	return false;
+}
+
+static inline void lru_gen_age(struct zone *zone, int file,
+			       struct scan_control *sc)
+{
+}
+
+static inline unsigned long lru_gen_isolate_pages(struct zone *zone,
+		int file, unsigned long nr_to_scan, struct list_head *dst,
+		unsigned long *scanned)
+{
+	*scanned = 0;
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * clear_active_flags() is a helper for shrink_active_list(), clearing
  * any active bits from the pages in the list.
@@ -1418,15 +1948,23 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 	}
 
 	set_reclaim_mode(priority, sc, false);
+	if (lru_gen_enabled() && scanning_global_lru(sc) &&
+	    lru_gen_need_aging(zone, file))
+		lru_gen_age(zone, file, sc);
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
 
 	if (scanning_global_lru(sc)) {
-		nr_taken = isolate_pages_global(nr_to_scan,
-			&page_list, &nr_scanned, sc->order,
-			sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM ?
-					ISOLATE_BOTH : ISOLATE_INACTIVE,
-			zone, 0, file);
+		/* the generations have no active lists, nor lumpy reclaim */
+		if (lru_gen_enabled())
+			nr_taken = lru_gen_isolate_pages(zone, file,
+				nr_to_scan, &page_list, &nr_scanned);
+		else
+			nr_taken = isolate_pages_global(nr_to_scan,
+				&page_list, &nr_scanned, sc->order,
+				sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM ?
+						ISOLATE_BOTH : ISOLATE_INACTIVE,
+				zone, 0, file);
 		zone->pages_scanned += nr_scanned;
 		if (current_is_kswapd())
 			__count_zone_vm_events(PGSCAN_KSWAPD, zone,
@@ -1970,6 +2508,9 @@ restart:
 	}
 	sc->nr_reclaimed += nr_reclaimed;
 
+	mem_cgroup_vmpressure(sc->gfp_mask, sc->mem_cgroup,
+			      sc->nr_scanned - nr_scanned, nr_reclaimed);
+
 	/*
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
@@ -2101,6 +2642,8 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
 		sc->nr_scanned = 0;
+		mem_cgroup_vmpressure_prio(sc->gfp_mask, sc->mem_cgroup,
+					   priority);
 		if (!priority)
 			disable_swap_token(sc->mem_cgroup);
 		shrink_zones(priority, zonelist, sc);
@@ -3237,7 +3780,8 @@ retry:
 		enum lru_list l = page_lru_base_type(page);
 
 		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
+		if (!lru_gen_rotate_page(zone, page, false))
+			list_move(&page->lru, &zone->lru[l].list);
 		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
 		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
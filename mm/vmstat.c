@@ -602,6 +602,37 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * Return an index indicating how much of the available free memory is
+ * unusable for an allocation of the requested size.
+ */
+static int __unusable_free_index(unsigned int order,
+				struct contig_page_info *info)
+{
+	/* No free memory is interpreted as all free memory is unusable */
+	if (info->free_pages == 0)
+		return 1000;
+
+	/*
+	 * Index should be a value between 0 and 1. Return a value to 3
+	 * decimal places.
+	 *
+	 * 0 => no fragmentation
+	 * 1 => high fragmentation
+	 */
+	return div_u64((info->free_pages - (info->free_blocks_suitable << order)) * 1000ULL, info->free_pages);
+
+}
+
+/* Same as __unusable_free_index but allocs contig_page_info on stack */
+int unusable_free_index(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	return __unusable_free_index(order, &info);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -729,6 +760,9 @@ const char * const vmstat_text[] = {
 
 	TEXTS_FOR_ZONES("pgalloc")
 
+	"pgalloc_pcp_highorder",
+	"pgalloc_pcp_highorder_refill",
+
 	"pgfree",
 	"pgactivate",
 	"pgdeactivate",
@@ -763,6 +797,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_direct_pages_moved",
+	"compact_daemon_wake",
+	"compact_proactive",
+	"compact_proactive_pages_moved",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -784,6 +822,31 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc",
 	"thp_collapse_alloc_failed",
 	"thp_split",
+	"thp_file_alloc",
+	"thp_file_fallback",
+	"thp_file_mapped",
+	"thp_file_split",
+#endif
+
+#ifdef CONFIG_SWAP
+	"swap_slots_cache_hit",
+	"swap_slots_cache_refill",
+	"swap_free_batched",
+	"swap_lock_acquired",
+#ifdef CONFIG_LOCK_STAT
+	"swap_lock_held_us",
+#endif
+#endif
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
+
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_walk_skip",
+	"lru_gen_promoted",
 #endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
@@ -1221,28 +1284,6 @@ module_init(setup_vmstat)
 
 static struct dentry *extfrag_debug_root;
 
-/*
- * Return an index indicating how much of the available free memory is
- * unusable for an allocation of the requested size.
- */
-static int unusable_free_index(unsigned int order,
-				struct contig_page_info *info)
-{
-	/* No free memory is interpreted as all free memory is unusable */
-	if (info->free_pages == 0)
-		return 1000;
-
-	/*
-	 * Index should be a value between 0 and 1. Return a value to 3
-	 * decimal places.
-	 *
-	 * 0 => no fragmentation
-	 * 1 => high fragmentation
-	 */
-	return div_u64((info->free_pages - (info->free_blocks_suitable << order)) * 1000ULL, info->free_pages);
-
-}
-
 static void unusable_show_print(struct seq_file *m,
 					pg_data_t *pgdat, struct zone *zone)
 {
@@ -1255,7 +1296,7 @@ static void unusable_show_print(struct seq_file *m,
 				zone->name);
 	for (order = 0; order < MAX_ORDER; ++order) {
 		fill_contig_page_info(zone, order, &info);
-		index = unusable_free_index(order, &info);
+		index = __unusable_free_index(order, &info);
 		seq_printf(m, "%d.%03d ", index / 1000, index % 1000);
 	}
 
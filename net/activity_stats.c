@@ -14,79 +14,416 @@
  * Author: Mike Chan (mike@android.com)
  */
 
+#include <linux/hash.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/suspend.h>
+#include <linux/workqueue.h>
+#include <net/activity_stats.h>
 #include <net/net_namespace.h>
 
 /*
  * Track transmission rates in buckets (power of 2).
- * 1,2,4,8...512 seconds.
+ * 1/16,1/8,1/4,1/2,1,2,4,8...512 seconds.
  *
  * Buckets represent the count of network transmissions at least
- * N seconds apart, where N is 1 << bucket index.
+ * N seconds apart, where N is (1 << bucket index) / 16.
+ *
+ * Transmissions are tracked globally, per network interface and per uid.
+ * The time of the last transmission is advanced with a cmpxchg, and only
+ * once it is at least one bucket old, so a burst of packets just reads it.
+ * The CPU that wins the cmpxchg accounts the interval in its own counters,
+ * which are summed up when read through proc.
+ *
+ * Per-cpu counters can't be allocated in the atomic context transmissions
+ * are accounted from, so uid entries are created from a work item. Until
+ * then, the transmissions of a new uid are only counted globally.
  */
-#define BUCKET_MAX 10
+#define BUCKET_MIN_SHIFT	4
+#define BUCKET_MAX		(10 + BUCKET_MIN_SHIFT)
+#define BUCKET_MIN_NS		((s64)NSEC_PER_SEC >> BUCKET_MIN_SHIFT)
+#define BUCKET_MS(i)		(((unsigned long)MSEC_PER_SEC << (i)) >> BUCKET_MIN_SHIFT)
+#define BUCKET_SEC(i)		(1 << ((i) - BUCKET_MIN_SHIFT))
+
+#define ACTIVITY_HASH_BITS	6
+#define ACTIVITY_UID_PENDING	16
+
+struct activity_buckets {
+	unsigned long count[BUCKET_MAX];
+};
+
+struct activity_track {
+	atomic64_t last_transmit;
+	struct activity_buckets __percpu *buckets;
+};
+
+struct activity_dev {
+	struct hlist_node link;
+	struct net_device *dev;
+	char name[IFNAMSIZ];
+	struct activity_track track;
+	struct rcu_head rcu;
+};
+
+struct activity_uid {
+	struct hlist_node link;
+	uid_t uid;
+	struct activity_track track;
+};
 
 /* Track network activity frequency */
-static unsigned long activity_stats[BUCKET_MAX];
-static ktime_t last_transmit;
+static DEFINE_PER_CPU(struct activity_buckets, activity_global_buckets);
+static struct activity_track activity_global = {
+	.buckets = &activity_global_buckets,
+};
+static struct hlist_head activity_dev_hash[1 << ACTIVITY_HASH_BITS];
+static struct hlist_head activity_uid_hash[1 << ACTIVITY_HASH_BITS];
 static ktime_t suspend_time;
-static DEFINE_SPINLOCK(activity_lock);
+/* Serializes insertion into and removal from the hash tables */
+static DEFINE_MUTEX(activity_lock);
+
+/* uids waiting for activity_uid_work to create their entries */
+static uid_t activity_uid_pending[ACTIVITY_UID_PENDING];
+static unsigned int activity_nr_uid_pending;
+static DEFINE_SPINLOCK(activity_pending_lock);
+
+static void activity_uid_work_fn(struct work_struct *work);
+static DECLARE_WORK(activity_uid_work, activity_uid_work_fn);
+
+static int activity_track_init(struct activity_track *track)
+{
+	atomic64_set(&track->last_transmit, 0);
+	track->buckets = alloc_percpu(struct activity_buckets);
+	return track->buckets ? 0 : -ENOMEM;
+}
 
-void activity_stats_update(void)
+static void activity_track_update(struct activity_track *track, s64 now)
 {
+	s64 last = atomic64_read(&track->last_transmit);
+	s64 delta = now - last;
 	int i;
+
+	/*
+	 * Check if the time delta between network activity is within the
+	 * minimum bucket range.
+	 */
+	if (delta < BUCKET_MIN_NS)
+		return;
+	if (atomic64_cmpxchg(&track->last_transmit, last, now) != last)
+		return;
+
+	for (i = BUCKET_MAX - 1; i > 0; i--)
+		if (delta >= (BUCKET_MIN_NS << i))
+			break;
+	this_cpu_inc(track->buckets->count[i]);
+}
+
+static unsigned long activity_track_sum(struct activity_track *track, int i)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(track->buckets, cpu)->count[i];
+	return sum;
+}
+
+static struct activity_uid *activity_uid_find(uid_t uid)
+{
+	struct hlist_node *node;
+	struct activity_uid *entry;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(entry, node,
+			&activity_uid_hash[hash_32(uid, ACTIVITY_HASH_BITS)],
+			link) {
+		if (entry->uid == uid) {
+			rcu_read_unlock();
+			return entry;
+		}
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
+/* uid entries are created after the first transmission and never freed. */
+static void activity_uid_create(uid_t uid)
+{
+	struct activity_uid *entry;
+
+	mutex_lock(&activity_lock);
+	if (activity_uid_find(uid))
+		goto out;
+
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		goto out;
+	if (activity_track_init(&entry->track)) {
+		kfree(entry);
+		goto out;
+	}
+	entry->uid = uid;
+	hlist_add_head_rcu(&entry->link,
+			&activity_uid_hash[hash_32(uid, ACTIVITY_HASH_BITS)]);
+out:
+	mutex_unlock(&activity_lock);
+}
+
+static void activity_uid_work_fn(struct work_struct *work)
+{
+	uid_t uids[ACTIVITY_UID_PENDING];
+	unsigned int i, nr;
+
+	spin_lock_irq(&activity_pending_lock);
+	nr = activity_nr_uid_pending;
+	memcpy(uids, activity_uid_pending, nr * sizeof(uid_t));
+	activity_nr_uid_pending = 0;
+	spin_unlock_irq(&activity_pending_lock);
+
+	for (i = 0; i < nr; i++)
+		activity_uid_create(uids[i]);
+}
+
+/* Have an entry created for @uid. A uid dropped here is requested again. */
+static void activity_uid_request(uid_t uid)
+{
 	unsigned long flags;
-	ktime_t now;
-	s64 delta;
+	unsigned int i;
+
+	spin_lock_irqsave(&activity_pending_lock, flags);
+	for (i = 0; i < activity_nr_uid_pending; i++)
+		if (activity_uid_pending[i] == uid)
+			goto out;
+	if (i < ACTIVITY_UID_PENDING) {
+		activity_uid_pending[i] = uid;
+		activity_nr_uid_pending++;
+	}
+out:
+	spin_unlock_irqrestore(&activity_pending_lock, flags);
+	schedule_work(&activity_uid_work);
+}
+
+/**
+ * activity_stats_update - account a transmission by a uid
+ * @uid: uid of the sending task
+ *
+ * Does not sleep.
+ */
+void activity_stats_update(uid_t uid)
+{
+	struct activity_uid *entry;
+	s64 now = ktime_to_ns(ktime_get());
+
+	activity_track_update(&activity_global, now);
+
+	entry = activity_uid_find(uid);
+	if (likely(entry))
+		activity_track_update(&entry->track, now);
+	else
+		activity_uid_request(uid);
+}
+
+/**
+ * activity_stats_dev_xmit - account a transmission on a network interface
+ * @dev: transmitting device
+ *
+ * Called with rcu_read_lock_bh() held.
+ */
+void activity_stats_dev_xmit(struct net_device *dev)
+{
+	struct hlist_node *node;
+	struct activity_dev *entry;
+
+	hlist_for_each_entry_rcu(entry, node,
+			&activity_dev_hash[hash_ptr(dev, ACTIVITY_HASH_BITS)],
+			link) {
+		if (entry->dev == dev) {
+			activity_track_update(&entry->track,
+					      ktime_to_ns(ktime_get()));
+			return;
+		}
+	}
+}
+
+static void activity_dev_free_rcu(struct rcu_head *head)
+{
+	struct activity_dev *entry = container_of(head, struct activity_dev, rcu);
+
+	free_percpu(entry->track.buckets);
+	kfree(entry);
+}
+
+static int activity_dev_event(struct notifier_block *nb,
+			      unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct activity_dev *entry;
 
-	spin_lock_irqsave(&activity_lock, flags);
-	now = ktime_get();
-	delta = ktime_to_ns(ktime_sub(now, last_transmit));
+	if (dev->flags & IFF_LOOPBACK)
+		return NOTIFY_DONE;
 
-	for (i = BUCKET_MAX - 1; i >= 0; i--) {
-		/*
-		 * Check if the time delta between network activity is within the
-		 * minimum bucket range.
-		 */
-		if (delta < (1000000000ULL << i))
-			continue;
+	head = &activity_dev_hash[hash_ptr(dev, ACTIVITY_HASH_BITS)];
 
-		activity_stats[i]++;
-		last_transmit = now;
+	switch (event) {
+	case NETDEV_REGISTER:
+		entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			break;
+		if (activity_track_init(&entry->track)) {
+			kfree(entry);
+			break;
+		}
+		entry->dev = dev;
+		strlcpy(entry->name, dev->name, IFNAMSIZ);
+		mutex_lock(&activity_lock);
+		hlist_add_head_rcu(&entry->link, head);
+		mutex_unlock(&activity_lock);
+		break;
+
+	case NETDEV_CHANGENAME:
+	case NETDEV_UNREGISTER:
+		mutex_lock(&activity_lock);
+		hlist_for_each_entry(entry, node, head, link) {
+			if (entry->dev != dev)
+				continue;
+			if (event == NETDEV_CHANGENAME) {
+				strlcpy(entry->name, dev->name, IFNAMSIZ);
+			} else {
+				hlist_del_rcu(&entry->link);
+				/* Readers run under rcu_read_lock_bh() */
+				call_rcu_bh(&entry->rcu, activity_dev_free_rcu);
+			}
+			break;
+		}
+		mutex_unlock(&activity_lock);
 		break;
 	}
-	spin_unlock_irqrestore(&activity_lock, flags);
+
+	return NOTIFY_DONE;
 }
 
-static int activity_stats_read_proc(char *page, char **start, off_t off,
-					int count, int *eof, void *data)
+static struct notifier_block activity_dev_notifier_block = {
+	.notifier_call = activity_dev_event,
+};
+
+/* The seconds buckets only, in the format this file always had */
+static int activity_stats_show(struct seq_file *m, void *v)
 {
 	int i;
-	int len;
-	char *p = page;
 
-	/* Only print if offset is 0, or we have enough buffer space */
-	if (off || count < (30 * BUCKET_MAX + 22))
-		return -ENOMEM;
+	seq_printf(m, "Min Bucket(sec) Count\n");
+	for (i = BUCKET_MIN_SHIFT; i < BUCKET_MAX; i++)
+		seq_printf(m, "%15d %lu\n", BUCKET_SEC(i),
+			   activity_track_sum(&activity_global, i));
+	return 0;
+}
 
-	len = snprintf(p, count, "Min Bucket(sec) Count\n");
-	count -= len;
-	p += len;
+static int activity_ms_show(struct seq_file *m, void *v)
+{
+	int i;
 
-	for (i = 0; i < BUCKET_MAX; i++) {
-		len = snprintf(p, count, "%15d %lu\n", 1 << i, activity_stats[i]);
-		count -= len;
-		p += len;
+	seq_printf(m, "Min Bucket(ms) Count\n");
+	for (i = 0; i < BUCKET_MAX; i++)
+		seq_printf(m, "%14lu %lu\n", BUCKET_MS(i),
+			   activity_track_sum(&activity_global, i));
+	return 0;
+}
+
+static void activity_show_header(struct seq_file *m, const char *what)
+{
+	int i;
+
+	seq_printf(m, "%-16s", what);
+	for (i = 0; i < BUCKET_MAX; i++)
+		seq_printf(m, " %lu", BUCKET_MS(i));
+	seq_putc(m, '\n');
+}
+
+static void activity_show_track(struct seq_file *m,
+				struct activity_track *track)
+{
+	int i;
+
+	for (i = 0; i < BUCKET_MAX; i++)
+		seq_printf(m, " %lu", activity_track_sum(track, i));
+	seq_putc(m, '\n');
+}
+
+static int activity_dev_show(struct seq_file *m, void *v)
+{
+	struct hlist_node *node;
+	struct activity_dev *entry;
+	int i;
+
+	activity_show_header(m, "Interface");
+	/* device entries are freed with call_rcu_bh() */
+	rcu_read_lock_bh();
+	for (i = 0; i < ARRAY_SIZE(activity_dev_hash); i++) {
+		hlist_for_each_entry_rcu(entry, node,
+				&activity_dev_hash[i], link) {
+			seq_printf(m, "%-16s", entry->name);
+			activity_show_track(m, &entry->track);
+		}
 	}
-	*eof = 1;
+	rcu_read_unlock_bh();
+	return 0;
+}
+
+static int activity_uid_show(struct seq_file *m, void *v)
+{
+	struct hlist_node *node;
+	struct activity_uid *entry;
+	int i;
 
-	return p - page;
+	activity_show_header(m, "Uid");
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(activity_uid_hash); i++) {
+		hlist_for_each_entry_rcu(entry, node,
+				&activity_uid_hash[i], link) {
+			seq_printf(m, "%-16u", entry->uid);
+			activity_show_track(m, &entry->track);
+		}
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
+static int activity_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, PDE(inode)->data, NULL);
+}
+
+static const struct file_operations activity_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= activity_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void activity_track_shift(struct activity_track *track, s64 delta)
+{
+	atomic64_sub(delta, &track->last_transmit);
 }
 
 static int activity_stats_notifier(struct notifier_block *nb,
 					unsigned long event, void *dummy)
 {
+	struct hlist_node *node;
+	struct activity_dev *dev_entry;
+	struct activity_uid *uid_entry;
+	s64 delta;
+	int i;
+
 	switch (event) {
 		case PM_SUSPEND_PREPARE:
 			suspend_time = ktime_get_real();
@@ -94,7 +431,21 @@ static int activity_stats_notifier(struct notifier_block *nb,
 
 		case PM_POST_SUSPEND:
 			suspend_time = ktime_sub(ktime_get_real(), suspend_time);
-			last_transmit = ktime_sub(last_transmit, suspend_time);
+			delta = ktime_to_ns(suspend_time);
+
+			activity_track_shift(&activity_global, delta);
+			rcu_read_lock_bh();
+			for (i = 0; i < (1 << ACTIVITY_HASH_BITS); i++) {
+				hlist_for_each_entry_rcu(dev_entry, node,
+						&activity_dev_hash[i], link)
+					activity_track_shift(&dev_entry->track,
+							     delta);
+				hlist_for_each_entry_rcu(uid_entry, node,
+						&activity_uid_hash[i], link)
+					activity_track_shift(&uid_entry->track,
+							     delta);
+			}
+			rcu_read_unlock_bh();
 	}
 
 	return 0;
@@ -106,10 +457,21 @@ static struct notifier_block activity_stats_notifier_block = {
 
 static int  __init activity_stats_init(void)
 {
-	create_proc_read_entry("activity", S_IRUGO,
-			init_net.proc_net_stat, activity_stats_read_proc, NULL);
+	int ret;
+
+	proc_create_data("activity", S_IRUGO, init_net.proc_net_stat,
+			 &activity_stats_fops, activity_stats_show);
+	proc_create_data("activity_ms", S_IRUGO, init_net.proc_net_stat,
+			 &activity_stats_fops, activity_ms_show);
+	proc_create_data("activity_dev", S_IRUGO, init_net.proc_net_stat,
+			 &activity_stats_fops, activity_dev_show);
+	proc_create_data("activity_uid", S_IRUGO, init_net.proc_net_stat,
+			 &activity_stats_fops, activity_uid_show);
+
+	ret = register_netdevice_notifier(&activity_dev_notifier_block);
+	if (ret)
+		return ret;
 	return register_pm_notifier(&activity_stats_notifier_block);
 }
 
 subsys_initcall(activity_stats_init);
-
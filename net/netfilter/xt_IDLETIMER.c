@@ -4,6 +4,11 @@
  * Netfilter module to trigger a timer when packet matches.
  * After timer expires a kevent will be sent.
  *
+ * Matching packets only record the time of last activity; the timer is
+ * armed when a label goes active and re-evaluated when it fires.
+ * Transitions between active and idle are reported as uevents, queued
+ * and sent in batches from a work item.
+ *
  * Copyright (C) 2004, 2010 Nokia Corporation
  * Written by Timo Teras <ext-timo.teras@nokia.com>
  *
@@ -40,6 +45,9 @@
 #include <linux/kobject.h>
 #include <linux/workqueue.h>
 #include <linux/sysfs.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
 
 struct idletimer_tg_attr {
 	struct attribute attr;
@@ -50,17 +58,32 @@ struct idletimer_tg_attr {
 struct idletimer_tg {
 	struct list_head entry;
 	struct timer_list timer;
-	struct work_struct work;
 
 	struct kobject *kobj;
 	struct idletimer_tg_attr attr;
 
 	unsigned int refcnt;
+
+	/* written by the packet path, only when jiffies has moved */
+	unsigned long last_active;
+	unsigned long timeout;
+	int active;
+
+	/* pending notification, protected by notify_lock */
+	struct list_head notify_entry;
+	bool notify_active;
+	ktime_t notify_time;
 };
 
 static LIST_HEAD(idletimer_tg_list);
 static DEFINE_MUTEX(list_mutex);
 
+static LIST_HEAD(notify_list);
+static DEFINE_SPINLOCK(notify_lock);
+
+static void idletimer_tg_notify_work(struct work_struct *work);
+static DECLARE_WORK(notify_work, idletimer_tg_notify_work);
+
 static struct kobject *idletimer_tg_kobj;
 
 static
@@ -87,8 +110,8 @@ static ssize_t idletimer_tg_show(struct kobject *kobj, struct attribute *attr,
 	mutex_lock(&list_mutex);
 
 	timer =	__idletimer_tg_find_by_label(attr->name);
-	if (timer)
-		expires = timer->timer.expires;
+	if (timer && timer->active)
+		expires = timer->last_active + timer->timeout;
 
 	mutex_unlock(&list_mutex);
 
@@ -99,21 +122,93 @@ static ssize_t idletimer_tg_show(struct kobject *kobj, struct attribute *attr,
 	return sprintf(buf, "0\n");
 }
 
-static void idletimer_tg_work(struct work_struct *work)
+/*
+ * Send all queued transitions. Holding list_mutex keeps the timers from
+ * being destroyed while we use their names.
+ */
+static void idletimer_tg_notify_work(struct work_struct *work)
 {
-	struct idletimer_tg *timer = container_of(work, struct idletimer_tg,
-						  work);
+	struct idletimer_tg *timer;
+	char label[MAX_IDLETIMER_LABEL_SIZE + 10];
+	char state[16];
+	char time[32];
+	char *envp[] = { label, state, time, NULL };
+	bool active;
+	ktime_t stamp;
 
-	sysfs_notify(idletimer_tg_kobj, NULL, timer->attr.attr.name);
+	mutex_lock(&list_mutex);
+	for (;;) {
+		spin_lock_bh(&notify_lock);
+		if (list_empty(&notify_list)) {
+			spin_unlock_bh(&notify_lock);
+			break;
+		}
+		timer = list_first_entry(&notify_list, struct idletimer_tg,
+					 notify_entry);
+		list_del_init(&timer->notify_entry);
+		active = timer->notify_active;
+		stamp = timer->notify_time;
+		spin_unlock_bh(&notify_lock);
+
+		snprintf(label, sizeof(label), "LABEL=%s",
+			 timer->attr.attr.name);
+		snprintf(state, sizeof(state), "STATE=%s",
+			 active ? "active" : "idle");
+		snprintf(time, sizeof(time), "TIME_NS=%lld",
+			 ktime_to_ns(stamp));
+
+		if (!active)
+			sysfs_notify(idletimer_tg_kobj, NULL,
+				     timer->attr.attr.name);
+		kobject_uevent_env(idletimer_tg_kobj, KOBJ_CHANGE, envp);
+	}
+	mutex_unlock(&list_mutex);
+}
+
+/*
+ * Queue a transition. A label that flips again before the work has run
+ * is reported once, with its latest state.
+ */
+static void idletimer_tg_queue_notify(struct idletimer_tg *timer, bool active)
+{
+	spin_lock_bh(&notify_lock);
+	timer->notify_active = active;
+	timer->notify_time = ktime_get_real();
+	if (list_empty(&timer->notify_entry))
+		list_add_tail(&timer->notify_entry, &notify_list);
+	spin_unlock_bh(&notify_lock);
+
+	schedule_work(&notify_work);
 }
 
 static void idletimer_tg_expired(unsigned long data)
 {
 	struct idletimer_tg *timer = (struct idletimer_tg *) data;
+	unsigned long expires = ACCESS_ONCE(timer->last_active) +
+				timer->timeout;
+
+	/* There has been traffic since the timer was armed. */
+	if (time_after(expires, jiffies)) {
+		mod_timer(&timer->timer, expires);
+		return;
+	}
 
 	pr_debug("timer %s expired\n", timer->attr.attr.name);
 
-	schedule_work(&timer->work);
+	timer->active = 0;
+	smp_mb();
+	/*
+	 * A packet may have seen us still active, don't lose it. If it saw
+	 * us inactive instead, it has re-armed the timer itself.
+	 */
+	expires = ACCESS_ONCE(timer->last_active) + timer->timeout;
+	if (time_after(expires, jiffies)) {
+		if (!xchg(&timer->active, 1))
+			mod_timer(&timer->timer, expires);
+		return;
+	}
+
+	idletimer_tg_queue_notify(timer, false);
 }
 
 static int idletimer_tg_create(struct idletimer_tg_info *info)
@@ -147,11 +242,13 @@ static int idletimer_tg_create(struct idletimer_tg_info *info)
 	setup_timer(&info->timer->timer, idletimer_tg_expired,
 		    (unsigned long) info->timer);
 	info->timer->refcnt = 1;
+	INIT_LIST_HEAD(&info->timer->notify_entry);
 
+	info->timer->timeout = msecs_to_jiffies(info->timeout * 1000);
+	info->timer->last_active = jiffies;
+	info->timer->active = 1;
 	mod_timer(&info->timer->timer,
-		  msecs_to_jiffies(info->timeout * 1000) + jiffies);
-
-	INIT_WORK(&info->timer->work, idletimer_tg_work);
+		  info->timer->timeout + jiffies);
 
 	return 0;
 
@@ -170,14 +267,27 @@ static unsigned int idletimer_tg_target(struct sk_buff *skb,
 					 const struct xt_action_param *par)
 {
 	const struct idletimer_tg_info *info = par->targinfo;
+	struct idletimer_tg *timer = info->timer;
+	unsigned long now = jiffies;
+
+	BUG_ON(!timer);
+
+	/*
+	 * Avoid dirtying the cache line more than once per jiffy. The barrier
+	 * pairs with the one in idletimer_tg_expired(): either it sees the
+	 * new last_active, or we see active cleared.
+	 */
+	if (timer->last_active != now) {
+		timer->last_active = now;
+		smp_mb();
+	}
 
-	pr_debug("resetting timer %s, timeout period %u\n",
-		 info->label, info->timeout);
-
-	BUG_ON(!info->timer);
-
-	mod_timer(&info->timer->timer,
-		  msecs_to_jiffies(info->timeout * 1000) + jiffies);
+	if (unlikely(!timer->active) && !xchg(&timer->active, 1)) {
+		pr_debug("timer %s active again, timeout period %u\n",
+			 info->label, info->timeout);
+		mod_timer(&timer->timer, now + timer->timeout);
+		idletimer_tg_queue_notify(timer, true);
+	}
 
 	return XT_CONTINUE;
 }
@@ -206,8 +316,12 @@ static int idletimer_tg_checkentry(const struct xt_tgchk_param *par)
 	info->timer = __idletimer_tg_find_by_label(info->label);
 	if (info->timer) {
 		info->timer->refcnt++;
+		info->timer->timeout = msecs_to_jiffies(info->timeout * 1000);
+		info->timer->last_active = jiffies;
+		if (!xchg(&info->timer->active, 1))
+			idletimer_tg_queue_notify(info->timer, true);
 		mod_timer(&info->timer->timer,
-			  msecs_to_jiffies(info->timeout * 1000) + jiffies);
+			  info->timer->timeout + jiffies);
 
 		pr_debug("increased refcnt of timer %s to %u\n",
 			 info->label, info->timer->refcnt);
@@ -237,6 +351,9 @@ static void idletimer_tg_destroy(const struct xt_tgdtor_param *par)
 
 		list_del(&info->timer->entry);
 		del_timer_sync(&info->timer->timer);
+		spin_lock_bh(&notify_lock);
+		list_del(&info->timer->notify_entry);
+		spin_unlock_bh(&notify_lock);
 		sysfs_remove_file(idletimer_tg_kobj, &info->timer->attr.attr);
 		kfree(info->timer->attr.attr.name);
 		kfree(info->timer);
@@ -301,6 +418,7 @@ out:
 static void __exit idletimer_tg_exit(void)
 {
 	xt_unregister_target(&idletimer_tg);
+	flush_work_sync(&notify_work);
 
 	device_destroy(idletimer_tg_class, MKDEV(0, 0));
 	class_destroy(idletimer_tg_class);
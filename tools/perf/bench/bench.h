@@ -4,6 +4,13 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_filefault(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_seqread(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_shmscan(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_mtfault(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_appswitch(int argc, const char **argv, const char *prefix __used);
+extern int bench_io_randread(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_tcp(int argc, const char **argv, const char *prefix __used);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
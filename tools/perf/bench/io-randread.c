@@ -0,0 +1,288 @@
+/*
+ * io-randread.c
+ *
+ * randread: Random O_DIRECT reads from a file or block device
+ *
+ * A number of threads each read blocks at random offsets of the target with
+ * pread(), one at a time, bypassing the page cache. The reads per second
+ * and the distribution of the time each read took are reported. Against
+ * the null_blk driver (Documentation/block/null_blk.txt) this measures the
+ * cost of the block layer path the device was set up with.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+static const char	*file_name;
+static const char	*bs_str		= "4KB";
+static const char	*length_str;
+static int		nr_threads	= 4;
+static int		runtime		= 5;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file_name, "file",
+		    "File or block device to read (required)"),
+	OPT_STRING('b', "block-size", &bs_str, "4KB",
+		    "Specify size of each read. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('l', "length", &length_str, "length",
+		    "Read only this much of the target"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of reading threads"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify run time in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_io_randread_usage[] = {
+	"perf bench io randread <options>",
+	NULL
+};
+
+/*
+ * Latencies in nanoseconds are kept in a histogram with 16 buckets per
+ * power of two, which is within about 6% of the real value.
+ */
+#define LAT_SUB_BITS	4
+#define LAT_SUB		(1 << LAT_SUB_BITS)
+#define LAT_BUCKETS	(64 * LAT_SUB)
+
+static unsigned int lat_bucket(unsigned long long ns)
+{
+	unsigned int msb, shift;
+
+	if (ns < LAT_SUB)
+		return ns;
+	msb = 63 - __builtin_clzll(ns);
+	shift = msb - LAT_SUB_BITS;
+	return (shift + 1) * LAT_SUB + ((ns >> shift) & (LAT_SUB - 1));
+}
+
+static unsigned long long lat_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < LAT_SUB)
+		return bucket;
+	shift = bucket / LAT_SUB - 1;
+	return (unsigned long long)(LAT_SUB + bucket % LAT_SUB) << shift;
+}
+
+struct reader {
+	pthread_t		thread;
+	unsigned int		seed;
+	unsigned long long	ios;
+	unsigned long long	total_ns;
+	unsigned long long	max_ns;
+	unsigned long long	hist[LAT_BUCKETS];
+	int			err;
+};
+
+static volatile int done;
+static int fd;
+static size_t bs;
+static unsigned long long nr_blocks;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *read_thread(void *arg)
+{
+	struct reader *r = arg;
+	unsigned long long block, start, ns;
+	void *buf;
+
+	/* O_DIRECT wants the buffer aligned to the logical block size */
+	if (posix_memalign(&buf, 4096, bs)) {
+		r->err = ENOMEM;
+		return NULL;
+	}
+
+	while (!done) {
+		block = (((unsigned long long)rand_r(&r->seed) << 31) |
+			 rand_r(&r->seed)) % nr_blocks;
+
+		start = now_ns();
+		if (pread(fd, buf, bs, block * bs) != (ssize_t)bs) {
+			r->err = errno ? errno : EIO;
+			break;
+		}
+		ns = now_ns() - start;
+
+		r->ios++;
+		r->total_ns += ns;
+		if (ns > r->max_ns)
+			r->max_ns = ns;
+		r->hist[lat_bucket(ns)]++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/* Latency below which @pct percent of the reads completed */
+static unsigned long long percentile(unsigned long long *hist,
+				     unsigned long long ios, double pct)
+{
+	unsigned long long sum = 0, want = ios * pct / 100;
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum > want)
+			return lat_value(i);
+	}
+	return lat_value(LAT_BUCKETS - 1);
+}
+
+int bench_io_randread(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	static unsigned long long hist[LAT_BUCKETS];
+	unsigned long long ios = 0, start, usecs, total_ns = 0, max_ns = 0;
+	struct reader *readers;
+	off_t size;
+	int i, j, nr, err = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_io_randread_usage, 0);
+
+	if (!file_name || nr_threads <= 0 || runtime <= 0) {
+		usage_with_options(bench_io_randread_usage, options);
+		return 1;
+	}
+
+	bs = (size_t)perf_atoll((char *)bs_str);
+	if ((s64)bs <= 0 || bs % 512) {
+		fprintf(stderr, "Invalid block size:%s\n", bs_str);
+		return 1;
+	}
+
+	fd = open(file_name, O_RDONLY | O_DIRECT);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", file_name,
+			strerror(errno));
+		return 1;
+	}
+
+	/* works for block devices as well as regular files */
+	size = lseek(fd, 0, SEEK_END);
+	if (length_str) {
+		s64 len = perf_atoll((char *)length_str);
+
+		if (len <= 0) {
+			fprintf(stderr, "Invalid length:%s\n", length_str);
+			goto err_close;
+		}
+		if (len < size)
+			size = len;
+	}
+	nr_blocks = size > 0 ? size / bs : 0;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s is smaller than one block\n", file_name);
+		goto err_close;
+	}
+
+	readers = calloc(nr_threads, sizeof(*readers));
+	if (!readers)
+		goto err_close;
+
+	start = now_ns();
+	for (nr = 0; nr < nr_threads; nr++) {
+		readers[nr].seed = getpid() + nr;
+		if (pthread_create(&readers[nr].thread, NULL, read_thread,
+				   &readers[nr])) {
+			fprintf(stderr, "Cannot create thread\n");
+			done = 1;
+			break;
+		}
+	}
+	if (!done)
+		sleep(runtime);
+	done = 1;
+	for (i = 0; i < nr; i++) {
+		struct reader *r = &readers[i];
+
+		pthread_join(r->thread, NULL);
+		if (r->err)
+			err = r->err;
+		ios += r->ios;
+		total_ns += r->total_ns;
+		if (r->max_ns > max_ns)
+			max_ns = r->max_ns;
+		for (j = 0; j < LAT_BUCKETS; j++)
+			hist[j] += r->hist[j];
+	}
+	usecs = (now_ns() - start) / 1000;
+
+	free(readers);
+	close(fd);
+
+	if (nr < nr_threads)
+		return 1;
+	if (err) {
+		fprintf(stderr, "Read from %s failed: %s\n", file_name,
+			strerror(err));
+		return 1;
+	}
+	if (!ios)
+		return 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads reading %zu byte blocks of %s\n\n",
+		       nr_threads, bs, file_name);
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14lf reads/sec\n",
+		       usecs ? (double)ios * 1000000 / usecs : 0);
+		printf(" %14lf MB/sec\n",
+		       usecs ? (double)ios * bs / usecs : 0);
+		printf(" %17s: %.3lf [usec]\n", "Average",
+		       (double)total_ns / ios / 1000);
+		printf(" %17s: %.3lf [usec]\n", "50th percentile",
+		       (double)percentile(hist, ios, 50) / 1000);
+		printf(" %17s: %.3lf [usec]\n", "99th percentile",
+		       (double)percentile(hist, ios, 99) / 1000);
+		printf(" %17s: %.3lf [usec]\n", "99.9th percentile",
+		       (double)percentile(hist, ios, 99.9) / 1000);
+		printf(" %17s: %.3lf [usec]\n", "Maximum",
+		       (double)max_ns / 1000);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu %llu %llu %llu\n",
+		       usecs ? ios * 1000000 / usecs : 0, total_ns / ios,
+		       percentile(hist, ios, 99), max_ns);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+
+err_close:
+	close(fd);
+	return 1;
+}
@@ -0,0 +1,261 @@
+/*
+ * mem-appswitch.c
+ *
+ * appswitch: Switch between applications whose working sets exceed memory
+ *
+ * A number of simulated applications each have an anonymous working set
+ * and, optionally, a file working set read through a shared mapping. They
+ * are brought to the foreground in turn for several rounds; switching to an
+ * application touches all of its working set. The time each switch takes
+ * and the major faults it causes are reported, together with the swap-ins
+ * and the aging work of the multi-generation LRU (lru_gen_aging and
+ * lru_gen_promoted in /proc/vmstat) over the whole run.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static const char	*anon_str	= "64MB";
+static const char	*file_str	= "0";
+static const char	*dir_name	= ".";
+static int		nr_apps		= 8;
+static int		rounds		= 5;
+
+static const struct option options[] = {
+	OPT_STRING('s', "size", &anon_str, "64MB",
+		    "Specify anonymous working set of each application. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('F', "file-size", &file_str, "0",
+		    "Specify file working set of each application"),
+	OPT_STRING('d', "dir", &dir_name, ".",
+		    "Directory to create the files in"),
+	OPT_INTEGER('n', "apps", &nr_apps,
+		    "Specify number of applications"),
+	OPT_INTEGER('r', "rounds", &rounds,
+		    "Specify number of rounds through all applications"),
+	OPT_END()
+};
+
+static const char * const bench_mem_appswitch_usage[] = {
+	"perf bench mem appswitch <options>",
+	NULL
+};
+
+struct app {
+	char	*anon;
+	char	*file;
+};
+
+static unsigned long page_size;
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0;
+	char key[64];
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", key, &val) == 2) {
+		if (!strcmp(key, name))
+			break;
+		val = 0;
+	}
+	fclose(fp);
+	return val;
+}
+
+/* Create, fill and map a file of @len bytes, or return NULL */
+static char *map_file(size_t len)
+{
+	char name[PATH_MAX], *buf, *p = NULL;
+	size_t off;
+	int fd;
+
+	snprintf(name, sizeof(name), "%s/perf-bench-appswitch.XXXXXX",
+		 dir_name);
+	fd = mkstemp(name);
+	if (fd < 0)
+		return NULL;
+	unlink(name);
+
+	buf = malloc(page_size);
+	if (!buf)
+		goto out;
+	memset(buf, 1, page_size);
+	for (off = 0; off < len; off += page_size)
+		if (write(fd, buf, page_size) != (ssize_t)page_size)
+			goto out_free;
+
+	p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		p = NULL;
+out_free:
+	free(buf);
+out:
+	close(fd);
+	return p;
+}
+
+static unsigned long touch(struct app *app, size_t anon_len, size_t file_len)
+{
+	volatile char *p;
+	unsigned long sum = 0;
+	size_t off;
+
+	p = app->anon;
+	for (off = 0; off < anon_len; off += page_size)
+		p[off]++;
+	p = app->file;
+	for (off = 0; off < file_len; off += page_size)
+		sum += p[off];
+	return sum;
+}
+
+int bench_mem_appswitch(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop;
+	unsigned long long usecs, total = 0, max = 0, majflt = 0;
+	unsigned long long pgmajfault, pswpin, aging, promoted;
+	volatile unsigned long sum = 0;
+	size_t anon_len, file_len;
+	struct app *apps;
+	int i, r, nr_switches;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_appswitch_usage, 0);
+
+	if (nr_apps < 2 || rounds <= 0) {
+		usage_with_options(bench_mem_appswitch_usage, options);
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	anon_len = (size_t)perf_atoll((char *)anon_str);
+	if ((s64)anon_len <= 0) {
+		fprintf(stderr, "Invalid size:%s\n", anon_str);
+		return 1;
+	}
+	file_len = (size_t)perf_atoll((char *)file_str);
+	if ((s64)file_len < 0) {
+		fprintf(stderr, "Invalid file size:%s\n", file_str);
+		return 1;
+	}
+	anon_len = (anon_len + page_size - 1) & ~(page_size - 1);
+	file_len = (file_len + page_size - 1) & ~(page_size - 1);
+
+	apps = calloc(nr_apps, sizeof(*apps));
+	if (!apps)
+		return 1;
+
+	/* launch every application once, which is not measured */
+	for (i = 0; i < nr_apps; i++) {
+		apps[i].anon = mmap(NULL, anon_len, PROT_READ | PROT_WRITE,
+				    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (apps[i].anon == MAP_FAILED) {
+			apps[i].anon = NULL;
+			fprintf(stderr, "Cannot map working set: %s\n",
+				strerror(errno));
+			goto err;
+		}
+		if (file_len) {
+			apps[i].file = map_file(file_len);
+			if (!apps[i].file) {
+				fprintf(stderr, "Cannot create file in %s: %s\n",
+					dir_name, strerror(errno));
+				goto err;
+			}
+		}
+		sum += touch(&apps[i], anon_len, file_len);
+	}
+
+	pgmajfault = read_vmstat("pgmajfault");
+	pswpin = read_vmstat("pswpin");
+	aging = read_vmstat("lru_gen_aging");
+	promoted = read_vmstat("lru_gen_promoted");
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nr_apps; i++) {
+			getrusage(RUSAGE_SELF, &ru_start);
+			gettimeofday(&start, NULL);
+			sum += touch(&apps[i], anon_len, file_len);
+			gettimeofday(&stop, NULL);
+			getrusage(RUSAGE_SELF, &ru_stop);
+
+			timersub(&stop, &start, &diff);
+			usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+			total += usecs;
+			if (usecs > max)
+				max = usecs;
+			majflt += ru_stop.ru_majflt - ru_start.ru_majflt;
+		}
+	}
+	pgmajfault = read_vmstat("pgmajfault") - pgmajfault;
+	pswpin = read_vmstat("pswpin") - pswpin;
+	aging = read_vmstat("lru_gen_aging") - aging;
+	promoted = read_vmstat("lru_gen_promoted") - promoted;
+
+	for (i = 0; i < nr_apps; i++) {
+		munmap(apps[i].anon, anon_len);
+		if (apps[i].file)
+			munmap(apps[i].file, file_len);
+	}
+	free(apps);
+
+	nr_switches = rounds * nr_apps;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d applications with %zu bytes anonymous and %zu bytes file memory, %d rounds\n\n",
+		       nr_apps, anon_len, file_len, rounds);
+		printf(" %14s: %llu.%03llu [msec]\n", "Average switch",
+		       total / nr_switches / 1000,
+		       total / nr_switches % 1000);
+		printf(" %14s: %llu.%03llu [msec]\n", "Slowest switch",
+		       max / 1000, max % 1000);
+		printf(" %14lf major faults/switch\n",
+		       (double)majflt / nr_switches);
+		printf(" %14llu pgmajfault\n", pgmajfault);
+		printf(" %14llu pswpin\n", pswpin);
+		printf(" %14llu lru_gen_aging\n", aging);
+		printf(" %14llu lru_gen_promoted\n", promoted);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu %llu %llu\n",
+		       total / nr_switches, max, majflt / nr_switches);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+
+err:
+	for (i = 0; i < nr_apps; i++) {
+		if (apps[i].anon)
+			munmap(apps[i].anon, anon_len);
+		if (apps[i].file)
+			munmap(apps[i].file, file_len);
+	}
+	free(apps);
+	return 1;
+}
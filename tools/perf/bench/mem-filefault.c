@@ -0,0 +1,201 @@
+/*
+ * mem-filefault.c
+ *
+ * filefault: Fault in pages of a cached file through mmap()
+ *
+ * The file is read once so that it sits in page cache, then it is mapped
+ * and every page is touched, which measures the cost of minor faults on
+ * file mappings (e.g. with and without fault-around).
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static const char	*length_str	= "64MB";
+static const char	*file_name;
+static int		iterations	= 10;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify length of the file to create. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('f', "file", &file_name, "file",
+		    "Use an existing file instead of creating one"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of times the file is mapped and touched"),
+	OPT_END()
+};
+
+static const char * const bench_mem_filefault_usage[] = {
+	"perf bench mem filefault <options>",
+	NULL
+};
+
+static char tmp_name[] = "perf-bench-filefault.XXXXXX";
+
+static int create_file(size_t len)
+{
+	char buf[65536];
+	size_t done;
+	ssize_t ret;
+	int fd;
+
+	/* Not in /tmp, which often is tmpfs rather than a real filesystem. */
+	fd = mkstemp(tmp_name);
+	if (fd < 0)
+		return -1;
+	unlink(tmp_name);
+
+	memset(buf, 0x5a, sizeof(buf));
+	for (done = 0; done < len; done += ret) {
+		ret = write(fd, buf, min(sizeof(buf), len - done));
+		if (ret <= 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+/* Pull the whole file into page cache. */
+static int warm_file(int fd, size_t len)
+{
+	char buf[65536];
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < len; done += ret) {
+		ret = pread(fd, buf, sizeof(buf), done);
+		if (ret <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int touch_file(int fd, size_t len, size_t page_size)
+{
+	volatile char *p;
+	char *map;
+	size_t off;
+	int sum = 0;
+
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	p = map;
+	for (off = 0; off < len; off += page_size)
+		sum += p[off];
+	munmap(map, len);
+	return sum;
+}
+
+int bench_mem_filefault(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop;
+	unsigned long long usecs;
+	unsigned long minflt, majflt, pages;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	size_t len;
+	int fd, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_filefault_usage, 0);
+
+	if (iterations <= 0) {
+		usage_with_options(bench_mem_filefault_usage, options);
+		return 1;
+	}
+
+	if (file_name) {
+		fd = open(file_name, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st)) {
+			fprintf(stderr, "Cannot open %s: %s\n", file_name,
+				strerror(errno));
+			return 1;
+		}
+		len = st.st_size;
+	} else {
+		len = (size_t)perf_atoll((char *)length_str);
+		if ((s64)len <= 0) {
+			fprintf(stderr, "Invalid length:%s\n", length_str);
+			return 1;
+		}
+		fd = create_file(len);
+		if (fd < 0) {
+			fprintf(stderr, "Cannot create file: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	if (!len || warm_file(fd, len)) {
+		fprintf(stderr, "Cannot read file\n");
+		close(fd);
+		return 1;
+	}
+	pages = (len + page_size - 1) / page_size;
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		if (touch_file(fd, len, page_size) < 0) {
+			fprintf(stderr, "Cannot map file: %s\n",
+				strerror(errno));
+			close(fd);
+			return 1;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_stop);
+	close(fd);
+
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	minflt = ru_stop.ru_minflt - ru_start.ru_minflt;
+	majflt = ru_stop.ru_majflt - ru_start.ru_majflt;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Touched %lu pages of a cached file %d times\n\n",
+		       pages, iterations);
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14lf usecs/page\n",
+		       (double)usecs / ((double)pages * iterations));
+		printf(" %14lu minor faults\n", minflt);
+		printf(" %14lu major faults\n", majflt);
+		printf(" %14lf faults/page\n",
+		       (double)(minflt + majflt) / ((double)pages * iterations));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu %lu\n",
+		       usecs / 1000000, (usecs % 1000000) / 1000,
+		       minflt + majflt);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * mem-mtfault.c
+ *
+ * mtfault: Page faults in a threaded process while other threads map memory
+ *
+ * Fault threads each touch every page of their own part of a shared region
+ * and then drop it again with MADV_DONTNEED, over and over, while mapper
+ * threads mmap(), mprotect() and munmap() small areas of their own, which
+ * takes mmap_sem for writing. Faults and mapping operations per second are
+ * reported, together with how many faults the kernel handled without
+ * mmap_sem (speculative_pgfault in /proc/vmstat) and how many it had to
+ * redo with it (speculative_pgfault_abort).
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char	*length_str	= "64MB";
+static const char	*file_name;
+static int		nr_faulters	= 4;
+static int		nr_mappers	= 1;
+static int		runtime		= 5;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify length of the region faulted in. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('f', "file", &file_name, "file",
+		    "Map this file shared and read it instead of "
+		    "writing anonymous memory"),
+	OPT_INTEGER('t', "threads", &nr_faulters,
+		    "Specify number of fault threads"),
+	OPT_INTEGER('m', "mappers", &nr_mappers,
+		    "Specify number of mmap/mprotect/munmap threads"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify run time in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_mem_mtfault_usage[] = {
+	"perf bench mem mtfault <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t		thread;
+	char			*start;
+	size_t			len;
+	unsigned long long	ops;
+};
+
+static volatile int done;
+static unsigned long page_size;
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0;
+	char key[64];
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", key, &val) == 2) {
+		if (!strcmp(key, name))
+			break;
+		val = 0;
+	}
+	fclose(fp);
+	return val;
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	volatile char *p = (volatile char *)w->start;
+	unsigned long sum = 0;
+	size_t off;
+
+	while (!done) {
+		for (off = 0; off < w->len && !done; off += page_size) {
+			if (file_name)
+				sum += p[off];
+			else
+				p[off] = 1;
+			w->ops++;
+		}
+		madvise(w->start, w->len, MADV_DONTNEED);
+	}
+	return (void *)sum;
+}
+
+static void *map_thread(void *arg)
+{
+	struct worker *w = arg;
+	size_t len = 16 * page_size;
+	char *p;
+
+	while (!done) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			break;
+		p[0] = 1;
+		mprotect(p, page_size, PROT_READ);
+		munmap(p, len);
+		w->ops++;
+	}
+	return NULL;
+}
+
+int bench_mem_mtfault(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usecs, faults = 0, maps = 0, spf, spf_abort;
+	struct worker *workers;
+	size_t len, part;
+	char *region;
+	struct stat st;
+	int fd = -1, i, nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_mtfault_usage, 0);
+
+	if (nr_faulters <= 0 || nr_mappers < 0 || runtime <= 0) {
+		usage_with_options(bench_mem_mtfault_usage, options);
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	len = (size_t)perf_atoll((char *)length_str);
+	if ((s64)len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	if (file_name) {
+		fd = open(file_name, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st)) {
+			fprintf(stderr, "Cannot open %s: %s\n", file_name,
+				strerror(errno));
+			return 1;
+		}
+		/* pages past the end of the file would SIGBUS */
+		len = min(len, (size_t)st.st_size);
+	}
+
+	part = (len / nr_faulters) & ~(page_size - 1);
+	if (!part) {
+		fprintf(stderr, "Length %s too small for %d threads\n",
+			length_str, nr_faulters);
+		goto err_close;
+	}
+	len = part * nr_faulters;
+
+	if (file_name)
+		region = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	else
+		region = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		fprintf(stderr, "Cannot map region: %s\n", strerror(errno));
+		goto err_close;
+	}
+
+	nr = nr_faulters + nr_mappers;
+	workers = calloc(nr, sizeof(*workers));
+	if (!workers)
+		goto err_unmap;
+
+	spf = read_vmstat("speculative_pgfault");
+	spf_abort = read_vmstat("speculative_pgfault_abort");
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		struct worker *w = &workers[i];
+
+		if (i < nr_faulters) {
+			w->start = region + i * part;
+			w->len = part;
+		}
+		if (pthread_create(&w->thread, NULL,
+				   i < nr_faulters ? fault_thread : map_thread,
+				   w)) {
+			fprintf(stderr, "Cannot create thread\n");
+			done = 1;
+			nr = i;
+			break;
+		}
+	}
+	if (!done)
+		sleep(runtime);
+	done = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (i < nr_faulters)
+			faults += workers[i].ops;
+		else
+			maps += workers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	spf = read_vmstat("speculative_pgfault") - spf;
+	spf_abort = read_vmstat("speculative_pgfault_abort") - spf_abort;
+
+	if (nr < nr_faulters + nr_mappers)
+		goto err_free;
+	free(workers);
+	munmap(region, len);
+	if (fd >= 0)
+		close(fd);
+
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d fault threads on %zu bytes of %s, %d mapper threads\n\n",
+		       nr_faulters, len, file_name ? file_name : "anonymous memory",
+		       nr_mappers);
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14lf faults/sec\n",
+		       usecs ? (double)faults * 1000000 / usecs : 0);
+		if (nr_mappers)
+			printf(" %14lf mmap+munmap/sec\n",
+			       usecs ? (double)maps * 1000000 / usecs : 0);
+		printf(" %14llu faults without mmap_sem\n", spf);
+		printf(" %14llu faults redone with mmap_sem\n", spf_abort);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu %llu %llu %llu\n",
+		       usecs ? faults * 1000000 / usecs : 0,
+		       usecs ? maps * 1000000 / usecs : 0, spf, spf_abort);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+
+err_free:
+	free(workers);
+err_unmap:
+	munmap(region, len);
+err_close:
+	if (fd >= 0)
+		close(fd);
+	return 1;
+}
@@ -0,0 +1,202 @@
+/*
+ * mem-seqread.c
+ *
+ * seqread: Read a file or block device sequentially from a cold page cache
+ *
+ * The page cache of the target is dropped with POSIX_FADV_DONTNEED before
+ * every pass, then the target is read with read(2). On a ramdisk (brd) or a
+ * loop device backed by a tmpfs file the I/O itself is a memory copy, so the
+ * result is dominated by readahead and page cache insertion.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static const char	*size_str	= "1MB";
+static const char	*length_str;
+static const char	*file_name;
+static int		iterations	= 5;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file_name, "file",
+		    "File or block device to read, e.g. /dev/ram0 or /dev/loop0"),
+	OPT_STRING('s', "size", &size_str, "1MB",
+		    "Specify size of each read(2). "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('l', "length", &length_str, "length",
+		    "Read only this much of the target"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of passes over the target"),
+	OPT_END()
+};
+
+static const char * const bench_mem_seqread_usage[] = {
+	"perf bench mem seqread -f <file> <options>",
+	NULL
+};
+
+static int drop_cache(int fd)
+{
+	/* Only clean pages are dropped, which is all a reader leaves */
+	return posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int read_pass(int fd, char *buf, size_t bsize, size_t len)
+{
+	size_t done;
+	ssize_t ret;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return -1;
+	for (done = 0; done < len; done += ret) {
+		ret = read(fd, buf, min(bsize, len - done));
+		if (ret < 0)
+			return -1;
+		if (!ret)
+			break;
+	}
+	return 0;
+}
+
+int bench_mem_seqread(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop;
+	unsigned long long usecs, sys_usecs;
+	struct stat st;
+	size_t bsize, len;
+	char *buf;
+	int fd, i;
+	double mb;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_seqread_usage, 0);
+
+	if (!file_name || iterations <= 0) {
+		usage_with_options(bench_mem_seqread_usage, options);
+		return 1;
+	}
+
+	bsize = (size_t)perf_atoll((char *)size_str);
+	if ((s64)bsize <= 0) {
+		fprintf(stderr, "Invalid size:%s\n", size_str);
+		return 1;
+	}
+
+	fd = open(file_name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", file_name,
+			strerror(errno));
+		return 1;
+	}
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "Cannot stat %s: %s\n", file_name,
+			strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	if (S_ISBLK(st.st_mode)) {
+		off_t end = lseek(fd, 0, SEEK_END);
+
+		len = end > 0 ? (size_t)end : 0;
+	} else
+		len = st.st_size;
+	if (length_str) {
+		size_t limit = (size_t)perf_atoll((char *)length_str);
+
+		if ((s64)limit <= 0) {
+			fprintf(stderr, "Invalid length:%s\n", length_str);
+			close(fd);
+			return 1;
+		}
+		len = min(len, limit);
+	}
+	if (!len) {
+		fprintf(stderr, "%s is empty\n", file_name);
+		close(fd);
+		return 1;
+	}
+
+	buf = malloc(bsize);
+	if (!buf) {
+		close(fd);
+		return 1;
+	}
+
+	usecs = 0;
+	sys_usecs = 0;
+	for (i = 0; i < iterations; i++) {
+		if (drop_cache(fd)) {
+			fprintf(stderr, "Cannot drop page cache of %s\n",
+				file_name);
+			goto err;
+		}
+
+		getrusage(RUSAGE_SELF, &ru_start);
+		gettimeofday(&start, NULL);
+		if (read_pass(fd, buf, bsize, len)) {
+			fprintf(stderr, "Cannot read %s: %s\n", file_name,
+				strerror(errno));
+			goto err;
+		}
+		gettimeofday(&stop, NULL);
+		getrusage(RUSAGE_SELF, &ru_stop);
+
+		timersub(&stop, &start, &diff);
+		usecs += diff.tv_sec * 1000000ULL + diff.tv_usec;
+		timersub(&ru_stop.ru_stime, &ru_start.ru_stime, &diff);
+		sys_usecs += diff.tv_sec * 1000000ULL + diff.tv_usec;
+	}
+	free(buf);
+	close(fd);
+
+	mb = (double)len * iterations / (1024 * 1024);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Read %zu bytes of %s %d times, %zu bytes per read\n\n",
+		       len, file_name, iterations, bsize);
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14s: %llu.%03llu [sec]\n", "System time",
+		       sys_usecs / 1000000, (sys_usecs % 1000000) / 1000);
+		printf(" %14lf MB/Sec\n", usecs ? mb * 1000000 / usecs : 0);
+		printf(" %14lf usecs/page of system time\n",
+		       (double)sys_usecs /
+		       ((double)len * iterations / sysconf(_SC_PAGESIZE)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu %llu.%03llu\n",
+		       usecs / 1000000, (usecs % 1000000) / 1000,
+		       sys_usecs / 1000000, (sys_usecs % 1000000) / 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+
+err:
+	free(buf);
+	close(fd);
+	return 1;
+}
@@ -0,0 +1,248 @@
+/*
+ * mem-shmscan.c
+ *
+ * shmscan: Scan a shared tmpfs mapping and count dTLB misses
+ *
+ * A file on tmpfs is mapped shared at a 2MB aligned address, every page is
+ * touched once, and the mapping is then read end to end several times. The
+ * scan throughput and the dTLB read misses it takes are reported, together
+ * with the number of huge pmds the kernel mapped (thp_file_mapped in
+ * /proc/vmstat), so that runs with huge=never and huge=always on the mount
+ * (or transparent_hugepage/shmem_enabled for /dev/shm) can be compared.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#endif
+
+#define HPAGE_SIZE	(2UL << 20)
+
+static const char	*length_str	= "256MB";
+static const char	*dir_name	= "/dev/shm";
+static int		iterations	= 10;
+static bool		advise;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "256MB",
+		    "Specify length of the file to scan, rounded up to 2MB. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('d', "dir", &dir_name, "/dev/shm",
+		    "tmpfs directory to create the file in"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of scans over the mapping"),
+	OPT_BOOLEAN('a', "advise", &advise,
+		    "madvise(MADV_HUGEPAGE) the mapping, for huge=advise"),
+	OPT_END()
+};
+
+static const char * const bench_mem_shmscan_usage[] = {
+	"perf bench mem shmscan <options>",
+	NULL
+};
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0;
+	char key[64];
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", key, &val) == 2) {
+		if (!strcmp(key, name))
+			break;
+		val = 0;
+	}
+	fclose(fp);
+	return val;
+}
+
+static int open_dtlb_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return sys_perf_event_open(&attr, 0, -1, -1, 0);
+}
+
+/* Map @fd shared at an address with the same 2MB offset as file offset 0 */
+static char *map_aligned(int fd, size_t len)
+{
+	char *area, *aligned;
+
+	area = mmap(NULL, len + HPAGE_SIZE, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *)(((unsigned long)area + HPAGE_SIZE - 1) &
+			   ~(HPAGE_SIZE - 1));
+	if (aligned > area)
+		munmap(area, aligned - area);
+	munmap(aligned + len, area + HPAGE_SIZE - aligned);
+
+	if (mmap(aligned, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 fd, 0) == MAP_FAILED) {
+		munmap(aligned, len);
+		return NULL;
+	}
+	return aligned;
+}
+
+static unsigned long scan(const char *p, size_t len)
+{
+	const unsigned long *q = (const unsigned long *)p;
+	const unsigned long *end = (const unsigned long *)(p + len);
+	unsigned long sum = 0;
+
+	while (q < end)
+		sum += *q++;
+	return sum;
+}
+
+int bench_mem_shmscan(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usecs, fault_usecs, misses = 0, mapped;
+	unsigned long page_size = sysconf(_SC_PAGESIZE);
+	volatile unsigned long sum = 0;
+	char name[PATH_MAX];
+	size_t len, off;
+	int fd, counter, i;
+	char *p;
+	double gb;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_shmscan_usage, 0);
+
+	if (iterations <= 0) {
+		usage_with_options(bench_mem_shmscan_usage, options);
+		return 1;
+	}
+
+	len = (size_t)perf_atoll((char *)length_str);
+	if ((s64)len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+	len = (len + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1);
+
+	snprintf(name, sizeof(name), "%s/perf-bench-shmscan.XXXXXX",
+		 dir_name);
+	fd = mkstemp(name);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot create file in %s: %s\n", dir_name,
+			strerror(errno));
+		return 1;
+	}
+	unlink(name);
+	if (ftruncate(fd, len)) {
+		fprintf(stderr, "Cannot size file: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	p = map_aligned(fd, len);
+	if (!p) {
+		fprintf(stderr, "Cannot map file: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+	if (advise && madvise(p, len, MADV_HUGEPAGE))
+		fprintf(stderr, "madvise(MADV_HUGEPAGE) failed: %s\n",
+			strerror(errno));
+
+	mapped = read_vmstat("thp_file_mapped");
+	gettimeofday(&start, NULL);
+	for (off = 0; off < len; off += page_size)
+		p[off] = 1;
+	gettimeofday(&stop, NULL);
+	mapped = read_vmstat("thp_file_mapped") - mapped;
+	timersub(&stop, &start, &diff);
+	fault_usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	counter = open_dtlb_counter();
+	if (counter < 0)
+		fprintf(stderr, "dTLB miss counter not available: %s\n",
+			strerror(errno));
+
+	if (counter >= 0)
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++)
+		sum += scan(p, len);
+	gettimeofday(&stop, NULL);
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+			goto err;
+		close(counter);
+	}
+
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	munmap(p, len);
+	close(fd);
+
+	gb = (double)len * iterations / (1024 * 1024 * 1024);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Scanned %zu bytes of %s %d times, %llu huge pmds mapped\n\n",
+		       len, dir_name, iterations, mapped);
+		printf(" %14s: %llu.%03llu [sec]\n", "Fault time",
+		       fault_usecs / 1000000, (fault_usecs % 1000000) / 1000);
+		printf(" %14s: %llu.%03llu [sec]\n", "Scan time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14lf GB/Sec\n", usecs ? gb * 1000000 / usecs : 0);
+		if (counter >= 0)
+			printf(" %14lf dTLB misses/page\n",
+			       (double)misses /
+			       ((double)len * iterations / page_size));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu %llu\n",
+		       usecs / 1000000, (usecs % 1000000) / 1000, misses);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+
+err:
+	close(counter);
+	munmap(p, len);
+	close(fd);
+	return 1;
+}
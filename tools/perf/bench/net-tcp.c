@@ -0,0 +1,280 @@
+/*
+ *
+ * net-tcp.c
+ *
+ * tcp: Benchmark for TCP streaming over the loopback device
+ *
+ * Every pair of processes pushes data through its own connection to
+ * 127.0.0.1, which exercises the per-packet accounting done on the TCP
+ * send and receive paths (e.g. CONFIG_UID_STAT).
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define UID_STAT_ENABLED	"/sys/module/uid_stat/parameters/enabled"
+
+static int pairs = 1;
+static int msg_size = 16384;
+static int total_mb = 1024;
+static bool compare;
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "pairs", &pairs,
+		    "Specify number of sender/receiver pairs"),
+	OPT_INTEGER('s', "size", &msg_size,
+		    "Specify size of each send() and recv() in bytes"),
+	OPT_INTEGER('m', "megabytes", &total_mb,
+		    "Specify amount of data sent by each pair in MB"),
+	OPT_BOOLEAN('c', "compare-uid-stat", &compare,
+		    "Run with uid_stat accounting enabled and disabled"),
+	OPT_END()
+};
+
+static const char * const bench_net_tcp_usage[] = {
+	"perf bench net tcp <options>",
+	NULL
+};
+
+static void die_errno(const char *what)
+{
+	fprintf(stderr, "%s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static void tcp_sender(unsigned short port, unsigned long long bytes)
+{
+	struct sockaddr_in addr;
+	char *buf;
+	int fd;
+
+	buf = calloc(1, msg_size);
+	if (!buf)
+		die_errno("calloc");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die_errno("socket");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = port;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die_errno("connect");
+
+	while (bytes) {
+		size_t len = bytes < (unsigned long long)msg_size ?
+			bytes : (size_t)msg_size;
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die_errno("write");
+		}
+		bytes -= ret;
+	}
+	close(fd);
+	exit(0);
+}
+
+static void tcp_receiver(int lfd)
+{
+	char *buf;
+	int fd;
+
+	buf = malloc(msg_size);
+	if (!buf)
+		die_errno("malloc");
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		die_errno("accept");
+	close(lfd);
+
+	for (;;) {
+		ssize_t ret = read(fd, buf, msg_size);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die_errno("read");
+		}
+		if (!ret)
+			break;
+	}
+	close(fd);
+	exit(0);
+}
+
+/* Returns the time in usecs for all pairs to transfer their data. */
+static unsigned long long run_tcp(unsigned long long bytes)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	struct timeval start, stop, diff;
+	int i, wait_stat;
+	pid_t pid;
+
+	/* Don't let the children flush our buffered output again. */
+	fflush(stdout);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < pairs; i++) {
+		int lfd = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (lfd < 0)
+			die_errno("socket");
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+		    listen(lfd, 1) ||
+		    getsockname(lfd, (struct sockaddr *)&addr, &addrlen))
+			die_errno("listen");
+
+		pid = fork();
+		if (pid < 0)
+			die_errno("fork");
+		if (!pid)
+			tcp_receiver(lfd);
+		close(lfd);
+
+		pid = fork();
+		if (pid < 0)
+			die_errno("fork");
+		if (!pid)
+			tcp_sender(addr.sin_port, bytes);
+	}
+
+	for (i = 0; i < 2 * pairs; i++) {
+		if (wait(&wait_stat) < 0)
+			die_errno("wait");
+		if (!WIFEXITED(wait_stat) || WEXITSTATUS(wait_stat)) {
+			fprintf(stderr, "child failed\n");
+			exit(1);
+		}
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	return diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+static int uid_stat_get(void)
+{
+	char val[16];
+	int fd, ret;
+
+	fd = open(UID_STAT_ENABLED, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, val, sizeof(val) - 1);
+	close(fd);
+	if (ret <= 0)
+		return -1;
+	val[ret] = '\0';
+	return atoi(val);
+}
+
+static int uid_stat_set(int enabled)
+{
+	int fd, ret;
+
+	fd = open(UID_STAT_ENABLED, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, enabled ? "1" : "0", 1);
+	close(fd);
+	return ret == 1 ? 0 : -1;
+}
+
+static void print_result(const char *label, unsigned long long usecs,
+			 unsigned long long bytes)
+{
+	double mb = (double)bytes * pairs / (1024 * 1024);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		if (label)
+			printf(" %s\n", label);
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       usecs / 1000000, (usecs % 1000000) / 1000);
+		printf(" %14lf MB/sec\n\n",
+		       mb / ((double)usecs / 1000000));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", mb / ((double)usecs / 1000000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+int bench_net_tcp(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	unsigned long long bytes, usecs;
+	int saved;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_tcp_usage, 0);
+
+	if (pairs <= 0 || msg_size <= 0 || total_mb <= 0) {
+		usage_with_options(bench_net_tcp_usage, options);
+		return 1;
+	}
+	bytes = (unsigned long long)total_mb * 1024 * 1024;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d pairs sending %d MB each in %d byte chunks"
+		       " over loopback\n\n", pairs, total_mb, msg_size);
+
+	if (!compare) {
+		print_result(NULL, run_tcp(bytes), bytes);
+		return 0;
+	}
+
+	saved = uid_stat_get();
+	if (saved < 0 || uid_stat_set(1)) {
+		fprintf(stderr, "Cannot control %s: %s\n",
+			UID_STAT_ENABLED, strerror(errno));
+		return 1;
+	}
+
+	usecs = run_tcp(bytes);
+	print_result("uid_stat enabled:", usecs, bytes);
+
+	uid_stat_set(0);
+	usecs = run_tcp(bytes);
+	print_result("uid_stat disabled:", usecs, bytes);
+
+	uid_stat_set(saved);
+	return 0;
+}
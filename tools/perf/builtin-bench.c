@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  io    ... block I/O performance
+ *  net   ... networking stack performance
  *
  */
 
@@ -52,12 +54,47 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "filefault",
+	  "Fault in pages of a cached file through mmap()",
+	  bench_mem_filefault },
+	{ "seqread",
+	  "Sequential read() of a file or device from a cold page cache",
+	  bench_mem_seqread },
+	{ "shmscan",
+	  "Scan a shared tmpfs mapping and count dTLB misses",
+	  bench_mem_shmscan },
+	{ "mtfault",
+	  "Page faults in threads racing with mmap() and munmap()",
+	  bench_mem_mtfault },
+	{ "appswitch",
+	  "Switch between applications that do not all fit in memory",
+	  bench_mem_appswitch },
 	suite_all,
 	{ NULL,
 	  NULL,
 	  NULL             }
 };
 
+static struct bench_suite io_suites[] = {
+	{ "randread",
+	  "Random O_DIRECT reads from a file or block device",
+	  bench_io_randread },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL              }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "tcp",
+	  "Stream data over TCP connections on the loopback device",
+	  bench_net_tcp },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +108,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "io",
+	  "block I/O performance",
+	  io_suites },
+	{ "net",
+	  "networking stack performance",
+	  net_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -30,7 +30,7 @@ struct slabinfo {
 	int aliases, align, cache_dma, cpu_slabs, destroy_by_rcu;
 	int hwcache_align, object_size, objs_per_slab;
 	int sanity_checks, slab_size, store_user, trace;
-	int order, poison, reclaim_account, red_zone;
+	int order, poison, reclaim_account, red_zone, cpu_partial;
 	unsigned long partial, objects, slabs, objects_partial, objects_total;
 	unsigned long alloc_fastpath, alloc_slowpath;
 	unsigned long free_fastpath, free_slowpath;
@@ -39,6 +39,9 @@ struct slabinfo {
 	unsigned long cpuslab_flush, deactivate_full, deactivate_empty;
 	unsigned long deactivate_to_head, deactivate_to_tail;
 	unsigned long deactivate_remote_frees, order_fallback;
+	unsigned long cpu_partial_alloc, cpu_partial_free;
+	unsigned long cpu_partial_node, cpu_partial_drain;
+	unsigned long slabs_cpu_partial;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -452,6 +455,11 @@ static void slab_stats(struct slabinfo *s)
 		s->alloc_from_partial * 100 / total_alloc,
 		s->free_remove_partial * 100 / total_free);
 
+	printf("Cpu partial list     %8lu %8lu %3lu %3lu\n",
+		s->cpu_partial_alloc, s->cpu_partial_free,
+		s->cpu_partial_alloc * 100 / total_alloc,
+		s->cpu_partial_free * 100 / total_free);
+
 	printf("RemoteObj/SlabFrozen %8lu %8lu %3lu %3lu\n",
 		s->deactivate_remote_frees, s->free_frozen,
 		s->deactivate_remote_frees * 100 / total_alloc,
@@ -465,6 +473,28 @@ static void slab_stats(struct slabinfo *s)
 	if (s->alloc_refill)
 		printf("Refill %8lu\n", s->alloc_refill);
 
+	/*
+	 * New cpu slabs come from the cpu partial list, the node partial
+	 * list or the page allocator. Slabs that regain free objects go to
+	 * the cpu or the node partial list. Everything not served by the
+	 * cpu partial list took the node list_lock.
+	 */
+	total = s->cpu_partial_alloc + s->alloc_from_partial + s->alloc_slab;
+	if (total)
+		printf("Cpu partial alloc hits %lu%% (%lu of %lu new cpu slabs)\n",
+			s->cpu_partial_alloc * 100 / total,
+			s->cpu_partial_alloc, total);
+
+	total = s->cpu_partial_free + s->free_add_partial;
+	if (total)
+		printf("Cpu partial free hits %lu%% (%lu of %lu partial slabs)\n",
+			s->cpu_partial_free * 100 / total,
+			s->cpu_partial_free, total);
+
+	if (s->cpu_partial_node || s->cpu_partial_drain)
+		printf("Cpu partial refill %lu slabs, drain %lu lists\n",
+			s->cpu_partial_node, s->cpu_partial_drain);
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail;
 
@@ -511,6 +541,8 @@ static void report(struct slabinfo *s)
 			s->align, s->objs_per_slab, onoff(s->trace),
 			((page_size << s->order) - s->objs_per_slab * s->slab_size) *
 			s->slabs);
+	printf("CpuPartial: %5d objects per cpu, %lu free objects held\n",
+			s->cpu_partial, s->slabs_cpu_partial);
 
 	ops(s);
 	show_tracking(s);
@@ -1190,6 +1222,12 @@ static void read_slab_dir(void)
 			slab->deactivate_to_tail = get_obj("deactivate_to_tail");
 			slab->deactivate_remote_frees = get_obj("deactivate_remote_frees");
 			slab->order_fallback = get_obj("order_fallback");
+			slab->cpu_partial = get_obj("cpu_partial");
+			slab->slabs_cpu_partial = get_obj("slabs_cpu_partial");
+			slab->cpu_partial_alloc = get_obj("cpu_partial_alloc");
+			slab->cpu_partial_free = get_obj("cpu_partial_free");
+			slab->cpu_partial_node = get_obj("cpu_partial_node");
+			slab->cpu_partial_drain = get_obj("cpu_partial_drain");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;